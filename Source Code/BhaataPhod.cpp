@@ -6,6 +6,41 @@
 #include <SFML/System.hpp>
 #include <cmath>
 #include <SFML/Audio.hpp>
+#include <SFML/Network.hpp>
+#include <SFML/OpenGL.hpp>
+#include "BhaataPhodBatch.h"
+#include "BhaataPhodCore.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
+#include <coroutine>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <limits>
+#include <map>
+#include <memory_resource>
+#include <mutex>
+#include <new>
+#include <random>
+#include <span>
+#include <sstream>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#if defined(__linux__)
+#include <malloc.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
 
 // Utility function to get the angle between two points
 float getAngle(const sf::Vector2f& start, const sf::Vector2f& end) {
@@ -14,474 +49,5191 @@ float getAngle(const sf::Vector2f& start, const sf::Vector2f& end) {
     return std::atan2(dy, dx) * 180 / 3.14159265; // Convert to degrees
 }
 
-class UFO_Bullet {
-public:
-    UFO_Bullet(const sf::Texture& texture, const sf::Vector2f& position, float rotation) {
-		sprite.setTexture(texture);
-		sprite.setOrigin(texture.getSize().x / 2, texture.getSize().y / 2);
-		sprite.setPosition(position);
-		sprite.setRotation(rotation);
-	}
-
-    void update(float deltaTime) {
-		float rotation = sprite.getRotation() - 90; // Adjust as needed
-		float radian = rotation * 3.14159265 / 180;
-		sprite.move(std::cos(radian) * 700.f * deltaTime, std::sin(radian) * 700.f * deltaTime); // Adjust the speed here
-	}
-
-    void draw(sf::RenderWindow& window) const {
-		window.draw(sprite);
-	}
-
-    sf::FloatRect getBounds() const {
-		return sprite.getGlobalBounds();
-	}
+// Everything the renderer needs to draw one sprite
+struct SpriteState {
+    const sf::Texture* texture;
+    sf::IntRect textureRect;
+    sf::Vector2f position;
+    sf::Vector2f origin;
+    sf::Vector2f scale;
+    float rotation;
+
+    static SpriteState capture(const sf::Sprite& sprite) {
+        return SpriteState{ sprite.getTexture(), sprite.getTextureRect(), sprite.getPosition(), sprite.getOrigin(), sprite.getScale(), sprite.getRotation() };
+    }
 
-    sf::Vector2f getPosition() const {
-		return sprite.getPosition();
-	}
-private:
-    sf::Sprite sprite;
+    void apply(sf::Sprite& sprite) const {
+        sprite.setTexture(*texture);
+        sprite.setTextureRect(textureRect);
+        sprite.setPosition(position);
+        sprite.setOrigin(origin);
+        sprite.setScale(scale);
+        sprite.setRotation(rotation);
+    }
 };
 
-class UFO_Boss {
+// Calls into the global heap from the threads that opt in, counted by the
+// operator new the game installs (the batch library leaves the host's alone).
+// Soak runs check that the simulation stops allocating once it has warmed up.
+namespace HeapCalls {
+    inline std::atomic<std::uint64_t> count{ 0 };
+    inline thread_local bool counted = false;
+}
+
+// Small work-stealing thread pool. Every thread owns a job deque: the owner pops
+// from the back, idle threads steal from the front of the others. The calling
+// thread takes part in parallelFor and only returns once every chunk is done.
+// Jobs are plain records in fixed rings, so handing out chunks does not allocate
+// once the rings have grown to the deepest split.
+class JobSystem {
 public:
-    UFO_Boss(const sf::Vector2f& position, const sf::Vector2u& windowSize, const sf::Texture& texture)
-        : windowSize(windowSize) {
+    explicit JobSystem(unsigned workerCount = std::max(1u, std::thread::hardware_concurrency()) - 1) {
+        for (unsigned i = 0; i <= workerCount; ++i) {
+            queues.push_back(std::make_unique<Queue>());
+        }
+        for (unsigned i = 1; i <= workerCount; ++i) {
+            workers.emplace_back([this, i] { workerLoop(i); });
+        }
+    }
 
-		sprite.setTexture(texture);
-		sprite.setOrigin(texture.getSize().x / 2, texture.getSize().y / 2);
-		sprite.setPosition(position);
-	}
+    ~JobSystem() {
+        stopping = true;
+        wake.notify_all();
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
 
-    void draw(sf::RenderWindow& window) const {
-		window.draw(sprite);
-	}
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
 
-    sf::FloatRect getBounds() const {
-		return sprite.getGlobalBounds();
-	}
+    // Calls fn(begin, end) over [0, count) in chunks of `grain`. Small ranges run inline.
+    template <typename Fn>
+    void parallelFor(size_t count, size_t grain, Fn&& fn) {
+        if (count == 0) {
+            return;
+        }
+        if (workers.empty() || count <= grain) {
+            fn(size_t(0), count);
+            return;
+        }
 
-    sf::Vector2f getPosition() const {
-		return sprite.getPosition();
-	}
+        using Callable = std::remove_reference_t<Fn>;
+        std::atomic<size_t> remaining((count + grain - 1) / grain);
+        size_t chunk = 0;
+        for (size_t begin = 0; begin < count; begin += grain, ++chunk) {
+            Job job;
+            job.call = [](void* callable, size_t begin, size_t end) {
+                (*static_cast<Callable*>(callable))(begin, end);
+            };
+            job.callable = const_cast<void*>(static_cast<const void*>(std::addressof(fn)));
+            job.remaining = &remaining;
+            job.begin = begin;
+            job.end = std::min(begin + grain, count);
+            Queue& queue = *queues[chunk % queues.size()];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            queue.pushBack(job);
+        }
+        pendingJobs.fetch_add(static_cast<int>(chunk));
+        wake.notify_all();
 
-    void update(sf::Vector2f playerPosition, float deltaTime) {
-		//UFO Boss follows the player
-		sf::Vector2f directionToPlayer = playerPosition - sprite.getPosition();
-		float length = std::sqrt(directionToPlayer.x * directionToPlayer.x + directionToPlayer.y * directionToPlayer.y);
-		directionToPlayer /= length; // Normalize the vector
-		sprite.move(directionToPlayer * 600.f * deltaTime);
+        while (remaining.load(std::memory_order_acquire) > 0) {
+            if (!runOne(0)) {
+                std::this_thread::yield();
+            }
+        }
+    }
 
-		// Screen wrapping
-        sf::Vector2f position = sprite.getPosition();
-        if (position.x < 0) position.x = windowSize.x;
-        if (position.x > windowSize.x) position.x = 0;
-        if (position.y < 0) position.y = windowSize.y;
-        if (position.y > windowSize.y) position.y = 0;
-        sprite.setPosition(position);
-	}
+    size_t threadCount() const {
+        return queues.size();
+    }
 
 private:
-	sf::Sprite sprite;
-    bool wasShooting = false;
-    sf::Vector2u windowSize;
-};
+    // One chunk of a parallelFor. `callable` is the caller's function object,
+    // which outlives the job because parallelFor waits for every chunk.
+    struct Job {
+        void (*call)(void* callable, size_t begin, size_t end) = nullptr;
+        void* callable = nullptr;
+        std::atomic<size_t>* remaining = nullptr;
+        size_t begin = 0;
+        size_t end = 0;
+    };
+
+    // Double-ended ring of jobs. It only grows, doubling when full.
+    struct Queue {
+        std::mutex mutex;
+        std::vector<Job> ring = std::vector<Job>(64);
+        size_t head = 0; // Front job
+        size_t size = 0;
+
+        void pushBack(const Job& job) {
+            if (size == ring.size()) {
+                std::vector<Job> grown(ring.size() * 2);
+                for (size_t i = 0; i < size; ++i) {
+                    grown[i] = ring[(head + i) % ring.size()];
+                }
+                ring.swap(grown);
+                head = 0;
+            }
+            ring[(head + size++) % ring.size()] = job;
+        }
 
-class Medkit {
-public:
-    Medkit(const sf::Texture& texture, const sf::Vector2f& position) {
-		sprite.setTexture(texture);
-		sprite.setOrigin(texture.getSize().x / 2, texture.getSize().y / 2);
-		sprite.setPosition(position);
-	}
+        Job popBack() {
+            return ring[(head + --size) % ring.size()];
+        }
 
-    void draw(sf::RenderWindow& window) const {
-		window.draw(sprite);
-	}
+        Job popFront() {
+            Job job = ring[head];
+            head = (head + 1) % ring.size();
+            --size;
+            return job;
+        }
+    };
+
+    // Run one job from our own queue, or steal one from another thread
+    bool runOne(size_t self) {
+        Job job;
+        for (size_t offset = 0; offset < queues.size() && !job.call; ++offset) {
+            Queue& queue = *queues[(self + offset) % queues.size()];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if (queue.size == 0) {
+                continue;
+            }
+            job = offset == 0 ? queue.popBack() : queue.popFront();
+        }
+        if (!job.call) {
+            return false;
+        }
+        pendingJobs.fetch_sub(1);
+        job.call(job.callable, job.begin, job.end);
+        job.remaining->fetch_sub(1, std::memory_order_release);
+        return true;
+    }
 
-    sf::FloatRect getBounds() const {
-		return sprite.getGlobalBounds();
-	}
+    void workerLoop(size_t self) {
+        // Workers only ever run simulation jobs, so all of their heap calls count
+        HeapCalls::counted = true;
+        while (!stopping) {
+            if (!runOne(self)) {
+                std::unique_lock<std::mutex> lock(wakeMutex);
+                wake.wait_for(lock, std::chrono::milliseconds(1), [this] { return stopping || pendingJobs > 0; });
+            }
+        }
+    }
 
-    sf::Vector2f getPosition() const {
-		return sprite.getPosition();
-	}
-private:
-    sf::Sprite sprite;
+    std::vector<std::unique_ptr<Queue>> queues; // queues[0] belongs to the calling thread
+    std::vector<std::thread> workers;
+    std::mutex wakeMutex;
+    std::condition_variable wake;
+    std::atomic<bool> stopping{ false };
+    std::atomic<int> pendingJobs{ 0 };
 };
 
-class Health {
+// Uniform grid broadphase. Entity indices are bucketed per cell with a counting
+// sort, so each cell lists its entities in ascending index order.
+class SpatialGrid {
 public:
-    Health(const sf::Texture& fullHeartTex, const sf::Texture& halfHeartTex, int maxHearts)
-        : fullHeartTexture(fullHeartTex), halfHeartTexture(halfHeartTex), maxHearts(maxHearts), currentHearts(maxHearts * 2) {
-        heartSize = sf::Vector2f(fullHeartTexture.getSize());
-    }
+    explicit SpatialGrid(float cellSize) : cellSize(cellSize) {}
 
-    void draw(sf::RenderWindow& window) {
-        for (int i = 0; i < maxHearts; ++i) {
-            sf::Sprite heartSprite;
-            if (i * 2 + 1 < currentHearts) {
-                heartSprite.setTexture(fullHeartTexture);
-            }
-            else if (i * 2 + 1 == currentHearts) {
-                heartSprite.setTexture(halfHeartTexture);
-            }
-            else {
-                break; // No more hearts to draw
-            }
-            heartSprite.setPosition(10.f + i * (heartSize.x + 30.f), 10.f); // Position hearts with some spacing
-            window.draw(heartSprite);
+    // Cells cover `area`; anything outside it is bucketed in the nearest border cell
+    void build(const std::vector<sf::FloatRect>& bounds, const sf::FloatRect& area) {
+        origin = sf::Vector2f(area.left, area.top);
+        cols = std::max(1, static_cast<int>(std::ceil(area.width / cellSize)));
+        rows = std::max(1, static_cast<int>(std::ceil(area.height / cellSize)));
+        cellStart.assign(static_cast<size_t>(cols) * rows + 1, 0);
+
+        for (const auto& rect : bounds) {
+            forEachCell(rect, [&](size_t cell) { ++cellStart[cell + 1]; });
+        }
+        for (size_t cell = 1; cell < cellStart.size(); ++cell) {
+            cellStart[cell] += cellStart[cell - 1];
         }
-    }
 
-    void takeDamage(int damage) {
-        currentHearts -= damage;
-        if (currentHearts < 0) currentHearts = 0;
+        entries.resize(cellStart.back());
+        cursor.assign(cellStart.begin(), cellStart.end() - 1);
+        for (size_t i = 0; i < bounds.size(); ++i) {
+            forEachCell(bounds[i], [&](size_t cell) { entries[cursor[cell]++] = static_cast<std::uint32_t>(i); });
+        }
     }
 
-    void resetHealth() {
-        currentHearts = maxHearts * 2;
+    // Appends the indices bucketed in every cell `area` touches. May contain duplicates.
+    void query(const sf::FloatRect& area, std::vector<std::uint32_t>& out) const {
+        forEachCell(area, [&](size_t cell) {
+            out.insert(out.end(), entries.begin() + cellStart[cell], entries.begin() + cellStart[cell + 1]);
+        });
     }
 
-    int getCurrentHearts() const {
-        return currentHearts;
+private:
+    // Cells outside the area are clamped onto the border cells
+    template <typename Fn>
+    void forEachCell(const sf::FloatRect& rect, Fn&& fn) const {
+        float x = rect.left - origin.x;
+        float y = rect.top - origin.y;
+        int left = std::min(std::max(static_cast<int>(std::floor(x / cellSize)), 0), cols - 1);
+        int right = std::min(std::max(static_cast<int>(std::floor((x + rect.width) / cellSize)), 0), cols - 1);
+        int top = std::min(std::max(static_cast<int>(std::floor(y / cellSize)), 0), rows - 1);
+        int bottom = std::min(std::max(static_cast<int>(std::floor((y + rect.height) / cellSize)), 0), rows - 1);
+        for (int row = top; row <= bottom; ++row) {
+            for (int col = left; col <= right; ++col) {
+                fn(static_cast<size_t>(row) * cols + col);
+            }
+        }
     }
 
-private:
-    const sf::Texture& fullHeartTexture;
-    const sf::Texture& halfHeartTexture;
-    int maxHearts;
-    int currentHearts;
-    sf::Vector2f heartSize;
+    float cellSize;
+    sf::Vector2f origin;
+    int cols = 0;
+    int rows = 0;
+    std::vector<std::uint32_t> cellStart;
+    std::vector<std::uint32_t> cursor;
+    std::vector<std::uint32_t> entries;
 };
 
+enum class LODTier {
+    Near, // On screen or close to the player, updated every tick
+    Far   // Off screen and distant, updated every Nth tick
+};
+
+// Per-entity bookkeeping for the LODScheduler
+struct LODState {
+    LODTier tier = LODTier::Near;
+    int phase = -1;          // Tick offset within the far interval, assigned on first schedule
+    float pendingTime = 0.f; // Time accumulated since the entity was last stepped
+    bool active = true;      // Whether the entity was stepped (and should be collision-tested) this tick
+};
 
-class Animation {
+// Sorts entities into tiers by distance from the player and visibility.
+// Far entities are stepped every `farInterval` ticks with the accumulated time,
+// and their phases are handed out round-robin so the far work is spread evenly.
+class LODScheduler {
 public:
-    Animation(const sf::Texture& texture, int frameWidth, int frameHeight, int numFrames, float frameTime)
-        : frameWidth(frameWidth), frameHeight(frameHeight), numFrames(numFrames), frameTime(frameTime), currentFrame(0), elapsedTime(0.f) {
-        sprite.setTexture(texture);
-        sprite.setOrigin(frameWidth / 2, frameHeight / 2);
-        sprite.setTextureRect(sf::IntRect(0, 0, frameWidth, frameHeight));
-    }
+    LODScheduler(float nearRadius, int farInterval)
+        : nearRadius(nearRadius), farInterval(farInterval) {}
 
-    void setPosition(const sf::Vector2f& position) {
-        sprite.setPosition(position);
+    void beginTick(const sf::Vector2f& playerPosition, const sf::FloatRect& viewBounds) {
+        this->playerPosition = playerPosition;
+        this->viewBounds = viewBounds;
+        ++tick;
     }
 
-    void update(float deltaTime) {
-        elapsedTime += deltaTime;
-        if (elapsedTime >= frameTime) {
-            currentFrame = (currentFrame + 1) % numFrames;
-            elapsedTime = 0.f;
-            int column = currentFrame % (sprite.getTexture()->getSize().x / frameWidth);
-            int row = currentFrame / (sprite.getTexture()->getSize().x / frameWidth);
-            sprite.setTextureRect(sf::IntRect(column * frameWidth, row * frameHeight, frameWidth, frameHeight));
+    // Hands out phases round-robin. Must run serially, in entity order.
+    void assignPhase(LODState& lod) {
+        if (lod.phase < 0) {
+            lod.phase = nextPhase;
+            nextPhase = (nextPhase + 1) % farInterval;
         }
     }
 
-    sf::FloatRect getBounds() const {
-        return sprite.getGlobalBounds();
+    // Returns the time step to apply to the entity this tick, or 0 if it sleeps.
+    // Only touches `lod`, so it is safe to call from several threads at once.
+    float schedule(LODState& lod, const sf::FloatRect& bounds, float deltaTime) const {
+        float dx = bounds.left + bounds.width / 2.f - playerPosition.x;
+        float dy = bounds.top + bounds.height / 2.f - playerPosition.y;
+        bool isNear = viewBounds.intersects(bounds) || dx * dx + dy * dy < nearRadius * nearRadius;
+        lod.tier = isNear ? LODTier::Near : LODTier::Far;
+
+        lod.pendingTime += deltaTime;
+        lod.active = isNear || (tick + lod.phase) % farInterval == 0;
+        if (!lod.active) {
+            return 0.f;
+        }
+        float step = lod.pendingTime;
+        lod.pendingTime = 0.f;
+        return step;
     }
 
-    void draw(sf::RenderWindow& window) const {
-        window.draw(sprite);
+    void reset() {
+        tick = 0;
+        nextPhase = 0;
     }
 
-    bool isFinished() const {
-        return currentFrame == numFrames - 1;
+    // Phases already handed out stay valid, they just repeat sooner or later
+    void setFarInterval(int interval) {
+        farInterval = interval;
+        nextPhase %= farInterval;
     }
 
 private:
-    sf::Sprite sprite;
-    int frameWidth;
-    int frameHeight;
-    int numFrames;
-    float frameTime;
-    int currentFrame;
-    float elapsedTime;
+    float nearRadius;
+    int farInterval;
+    unsigned tick = 0;
+    int nextPhase = 0;
+    sf::Vector2f playerPosition;
+    sf::FloatRect viewBounds;
 };
 
-class Player {
+// Grid of unit directions toward the player, rebuilt once per tick and sampled
+// by every homing entity instead of each one normalizing its own vector.
+class FlowField {
 public:
-    Player(const sf::Texture& idleTexture, const sf::Texture& thrustingTexture, const sf::Vector2f& position, const sf::Vector2u& windowSize)
-        : textureIdle(idleTexture), textureThrusting(thrustingTexture), velocity(0.f, 0.f), thrust(20.f), // Increase thrust // Decrease thrust duration
-        windowSize(windowSize), isThrusting(false) {
-        sprite.setTexture(textureIdle);
-        sprite.setOrigin(textureIdle.getSize().x / 2, textureIdle.getSize().y / 2);
-        sprite.setPosition(position);
-
-        if (!thrustbuffer.loadFromFile("Materials/thrust.wav")) {
-            std::cerr << "Error loading resources from file" << std::endl;
-            exit(-1);
-        }
-        thrustsound.setBuffer(thrustbuffer);
-    }
-    sf::SoundBuffer thrustbuffer;
-    sf::Sound thrustsound;
-
-    void update(float deltaTime) {
-        // Change the sprite based on whether the player is thrusting
-        if (sf::Keyboard::isKeyPressed(sf::Keyboard::Up)) {
-            isThrusting = true;
-            sprite.setTexture(textureThrusting);
-            if (sprite.getTexture() == &textureThrusting) {
-                thrustsound.play();
-            }
-            if (sprite.getTexture() == &textureIdle) {
-                thrustsound.stop();
+    FlowField(float cellSize, bool wrap)
+        : cellSize(cellSize), wrap(wrap) {}
+
+    // Rebuild the field over `area`, which is also the span a wrapping field wraps
+    // across. Cells within `avoidRadius` of an obstacle are pushed away from it, the
+    // push fading linearly from full strength at the obstacle to nothing at the radius.
+    void build(const sf::Vector2f& target, const sf::FloatRect& area, std::span<const sf::Vector2f> obstacles = {}) {
+        origin = sf::Vector2f(area.left, area.top);
+        worldSize = sf::Vector2f(area.width, area.height);
+        cols = std::max(1, static_cast<int>(std::ceil(area.width / cellSize)));
+        rows = std::max(1, static_cast<int>(std::ceil(area.height / cellSize)));
+        directions.resize(static_cast<size_t>(cols) * rows);
+        pushes.assign(obstacles.empty() ? 0 : directions.size(), sf::Vector2f(0.f, 0.f));
+
+        for (int row = 0; row < rows; ++row) {
+            for (int col = 0; col < cols; ++col) {
+                sf::Vector2f center = cellCenter(col, row);
+                directions[row * cols + col] = normalized(shortestDelta(center, target));
+                for (const auto& obstacle : obstacles) {
+                    pushes[row * cols + col] += push(obstacle, center);
+                }
             }
-            //thrustTimer += deltaTime;
-            //if (thrustTimer >= thrustDuration) {
-            //    isThrusting = false;
-            //    thrustsound.stop();
-            //    sprite.setTexture(textureIdle);
-            //}
-        }
-        else {
-            isThrusting = false;
-            //thrustTimer = 0.f;
-            sprite.setTexture(textureIdle);
         }
+    }
 
-        // Apply thrust
-        if (isThrusting) {
-            float rotation = sprite.getRotation() - 90;
-            float radian = rotation * 3.14159265 / 180;
-            velocity.x += std::cos(radian) * thrust * deltaTime;
-            velocity.y += std::sin(radian) * thrust * deltaTime;
+    sf::Vector2f sample(const sf::Vector2f& position) const {
+        if (directions.empty()) {
+            return sf::Vector2f(0.f, 0.f);
         }
-        else {
-            // Slow down the ship when not thrusting (optional)
-            velocity *= 0.95f; // Adjust the factor as needed
+        int col = std::min(std::max(static_cast<int>((position.x - origin.x) / cellSize), 0), cols - 1);
+        int row = std::min(std::max(static_cast<int>((position.y - origin.y) / cellSize), 0), rows - 1);
+        if (pushes.empty()) {
+            return directions[row * cols + col];
         }
-
-        const float maxSpeed = 500.f;
-        float speed = std::sqrt(velocity.x * velocity.x + velocity.y * velocity.y);
-        if (speed > maxSpeed) {
-            velocity /= speed; // Normalize the vector
-			velocity *= maxSpeed;
-		}
-
-        // Apply inertia
-        //sprite.move(velocity * deltaTime);
-        sprite.move(velocity);
-
-        // Screen wrapping
-        sf::Vector2f position = sprite.getPosition();
-        if (position.x < 0) position.x = windowSize.x;
-        if (position.x > windowSize.x) position.x = 0;
-        if (position.y < 0) position.y = windowSize.y;
-        if (position.y > windowSize.y) position.y = 0;
-        sprite.setPosition(position);
+        return normalized(directions[row * cols + col] + pushes[row * cols + col]);
     }
 
-    void draw(sf::RenderWindow& window) {
-        window.draw(sprite);
+    // Sample for an entity that was passed to build() as an obstacle at `position`,
+    // taking its own push back out so it is only steered away from the others
+    sf::Vector2f sampleAsObstacle(const sf::Vector2f& position) const {
+        if (directions.empty() || pushes.empty()) {
+            return sample(position);
+        }
+        int col = std::min(std::max(static_cast<int>((position.x - origin.x) / cellSize), 0), cols - 1);
+        int row = std::min(std::max(static_cast<int>((position.y - origin.y) / cellSize), 0), rows - 1);
+        sf::Vector2f others = pushes[row * cols + col] - push(position, cellCenter(col, row));
+        return normalized(directions[row * cols + col] + others);
     }
 
-    sf::Vector2f getPosition() const {
-        return sprite.getPosition();
+private:
+    sf::Vector2f cellCenter(int col, int row) const {
+        return sf::Vector2f(origin.x + (col + 0.5f) * cellSize, origin.y + (row + 0.5f) * cellSize);
     }
 
-    float getRotation() const {
-        return sprite.getRotation();
+    // Push an obstacle applies at `point`
+    sf::Vector2f push(const sf::Vector2f& obstacle, const sf::Vector2f& point) const {
+        sf::Vector2f away = shortestDelta(obstacle, point);
+        float distance = std::sqrt(away.x * away.x + away.y * away.y);
+        if (distance <= 0.f || distance >= avoidRadius) {
+            return sf::Vector2f(0.f, 0.f);
+        }
+        return away / distance * (1.f - distance / avoidRadius);
     }
 
-    sf::FloatRect getBounds() const {
-        return sprite.getGlobalBounds();
+    // Delta from `from` to `to`, taking the short way around when the world wraps
+    sf::Vector2f shortestDelta(const sf::Vector2f& from, const sf::Vector2f& to) const {
+        sf::Vector2f delta = to - from;
+        if (wrap) {
+            if (delta.x > worldSize.x / 2.f) delta.x -= worldSize.x;
+            if (delta.x < -(worldSize.x / 2.f)) delta.x += worldSize.x;
+            if (delta.y > worldSize.y / 2.f) delta.y -= worldSize.y;
+            if (delta.y < -(worldSize.y / 2.f)) delta.y += worldSize.y;
+        }
+        return delta;
     }
 
-    sf::Sprite getSprite() const {
-        return sprite;
+    static sf::Vector2f normalized(const sf::Vector2f& vector) {
+        float length = std::sqrt(vector.x * vector.x + vector.y * vector.y);
+        return length > 0.f ? vector / length : sf::Vector2f(0.f, 0.f);
     }
 
-    void setPosition(const sf::Vector2f& position) {
-		sprite.setPosition(position);
-	}
-
-    void updateRotation(const sf::Vector2f& mousePosition) {
-        sf::Vector2f direction = mousePosition - sprite.getPosition();
-        float angle = std::atan2(direction.y, direction.x) * 180 / 3.14159265 + 90; // Convert to degrees and adjust
-        sprite.setRotation(angle);
-    }
+    float cellSize;
+    bool wrap;
+    float avoidRadius = 300.f;
+    int cols = 0;
+    int rows = 0;
+    sf::Vector2f origin;
+    sf::Vector2f worldSize;
+    std::vector<sf::Vector2f> directions;
+    std::vector<sf::Vector2f> pushes;
+};
 
-private:
-    sf::Sprite sprite;
-    sf::Texture textureIdle;
-    sf::Texture textureThrusting;
-    sf::Vector2f velocity;
-    float thrust;
-    float thrustTimer = 0;
-    sf::Vector2u windowSize;
-    bool isThrusting;
+// Everything a behaviour script remembers between suspensions. It lives in the
+// scripted entity rather than in the coroutine frame, so it is saved with the
+// entity and a script rebuilt after World::loadState carries on from the same step.
+struct ScriptState {
+    std::uint8_t step = 0;
+    std::uint8_t counter = 0;
+    float wakeTime = 0.f; // World time the current timed wait ends
 };
 
-class Projectile {
+// Fixed-size blocks for coroutine frames, recycled through a free list so that
+// starting a script does not touch the heap once the pool has warmed up. Frames
+// too big for a block fall back to operator new.
+class ScriptFramePool {
 public:
-    Projectile(const sf::Texture& texture, const sf::Vector2f& position, float rotation) {
-        sprite.setTexture(texture);
-        sprite.setOrigin(texture.getSize().x / 2, texture.getSize().y / 2);
-        sprite.setPosition(position);
-        sprite.setRotation(rotation);
+    static const size_t blockSize = 512;
+
+    // Every frame is prefixed with the pool it came from, for operator delete
+    static void* allocateFrame(size_t size, ScriptFramePool& pool) {
+        unsigned char* block = static_cast<unsigned char*>(pool.allocate(size + frameHeader));
+        ScriptFramePool* owner = &pool;
+        std::memcpy(block, &owner, sizeof(owner));
+        return block + frameHeader;
     }
 
-    void update(float deltaTime) {
-        float rotation = sprite.getRotation() - 90; // Adjust as needed
-        float radian = rotation * 3.14159265 / 180;
-        sprite.move(std::cos(radian) * 600.f * deltaTime, std::sin(radian) * 600.f * deltaTime); // Adjust the speed here
+    static void releaseFrame(void* frame, size_t size) {
+        unsigned char* block = static_cast<unsigned char*>(frame) - frameHeader;
+        ScriptFramePool* owner = nullptr;
+        std::memcpy(&owner, block, sizeof(owner));
+        owner->release(block, size + frameHeader);
     }
 
-    void draw(sf::RenderWindow& window) const {
-        window.draw(sprite);
+    size_t slabCount() const {
+        return slabs.size();
     }
 
-    sf::FloatRect getBounds() const {
-        return sprite.getGlobalBounds();
-    }
+private:
+    static const size_t frameHeader = alignof(std::max_align_t);
+    static const size_t blocksPerSlab = 64;
 
-    sf::Vector2f getPosition() const {
-        return sprite.getPosition();
+    union Block {
+        Block* next;
+        alignas(std::max_align_t) unsigned char bytes[blockSize];
+    };
+
+    void* allocate(size_t size) {
+        if (size > blockSize) {
+            return ::operator new(size);
+        }
+        if (!freeList) {
+            slabs.push_back(std::make_unique<Block[]>(blocksPerSlab));
+            for (size_t i = 0; i < blocksPerSlab; ++i) {
+                slabs.back()[i].next = freeList;
+                freeList = &slabs.back()[i];
+            }
+        }
+        Block* block = freeList;
+        freeList = block->next;
+        return block;
     }
 
-private:
-    sf::Sprite sprite;
-    sf::Vector2u windowSize;
-};
+    void release(void* pointer, size_t size) {
+        if (size > blockSize) {
+            ::operator delete(pointer);
+            return;
+        }
+        Block* block = static_cast<Block*>(pointer);
+        block->next = freeList;
+        freeList = block;
+    }
 
-enum class EnemyType {
-    Normal,
-    Fast,
-    Direct
+    std::vector<std::unique_ptr<Block[]>> slabs;
+    Block* freeList = nullptr;
 };
 
-class Enemy {
+// A behaviour script: a coroutine that starts suspended and is owned by the
+// ScriptScheduler it is started on. Scripts must be member functions of an object
+// with a getScriptFrames() pool, which their frames are allocated from.
+class Script {
 public:
-    Enemy(const sf::Texture& texture, const sf::Texture& texture2, const sf::Vector2f& position, const sf::Vector2f& initialDirection, EnemyType type)
-        : type(type), direction(initialDirection) {
+    struct promise_type {
+        std::uint32_t owner = 0;
+        bool cancelled = false;
 
-        if (type == EnemyType::Direct) {
-            sprite.setTexture(texture2);
+        Script get_return_object() {
+            return Script(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+
+        std::suspend_always initial_suspend() noexcept {
+            return {};
+        }
+
+        // Stay suspended at the end so the scheduler can see the script is done
+        std::suspend_always final_suspend() noexcept {
+            return {};
+        }
+
+        void return_void() {}
+
+        void unhandled_exception() {
+            std::terminate();
+        }
+
+        template <typename Host, typename... Args>
+        static void* operator new(std::size_t size, Host& host, Args&&...) {
+            return ScriptFramePool::allocateFrame(size, host.getScriptFrames());
+        }
+
+        static void operator delete(void* frame, std::size_t size) {
+            ScriptFramePool::releaseFrame(frame, size);
+        }
+    };
+
+    using Handle = std::coroutine_handle<promise_type>;
+
+    Script(Script&& other) noexcept : handle(std::exchange(other.handle, nullptr)) {}
+    Script(const Script&) = delete;
+    Script& operator=(const Script&) = delete;
+
+    ~Script() {
+        if (handle) {
+            handle.destroy();
+        }
+    }
+
+    Handle release() {
+        return std::exchange(handle, nullptr);
+    }
+
+private:
+    explicit Script(Handle handle) : handle(handle) {}
+
+    Handle handle;
+};
+
+// Runs behaviour scripts. Scripts asleep on a timer sit in a heap ordered by wake
+// time and are not looked at until they are due, so thousands of waiting scripts
+// cost nothing per tick; scripts waiting on a condition have it polled every run.
+// Ties are broken by start order, which keeps runs deterministic.
+class ScriptScheduler {
+public:
+    ScriptScheduler() = default;
+    ScriptScheduler(const ScriptScheduler&) = delete;
+    ScriptScheduler& operator=(const ScriptScheduler&) = delete;
+
+    ~ScriptScheduler() {
+        clear();
+    }
+
+    // Take over `script` for `owner`, cancelling any script the owner already had.
+    // It first runs on the next run().
+    void start(std::uint32_t owner, Script script) {
+        cancel(owner);
+        Script::Handle handle = script.release();
+        handle.promise().owner = owner;
+        owners.insert(findOwner(owner), Owner{ owner, handle });
+        pushTimer(0.f, handle);
+    }
+
+    bool has(std::uint32_t owner) const {
+        auto found = findOwner(owner);
+        return found != owners.end() && found->owner == owner;
+    }
+
+    // The script is destroyed the next time it would have been resumed
+    void cancel(std::uint32_t owner) {
+        auto found = findOwner(owner);
+        if (found != owners.end() && found->owner == owner) {
+            found->handle.promise().cancelled = true;
+            owners.erase(found);
+        }
+    }
+
+    // Resume every script whose timer is due or whose condition now holds. A script
+    // resumes at most once per run, even if it waits for no time at all.
+    void run(float time) {
+        now = time;
+        std::uint64_t firstDeferred = nextOrder;
+        // Conditions parked from here on, by timer or condition resumes alike, are
+        // left for the next run
+        size_t count = conditions.size();
+        while (!timers.empty() && timers.front().wakeTime <= now) {
+            std::pop_heap(timers.begin(), timers.end(), Timer::later);
+            Timer timer = timers.back();
+            timers.pop_back();
+            if (timer.order >= firstDeferred) {
+                deferred.push_back(timer);
+                continue;
+            }
+            resume(timer.handle);
+        }
+        for (const Timer& timer : deferred) {
+            timers.push_back(timer);
+            std::push_heap(timers.begin(), timers.end(), Timer::later);
+        }
+        deferred.clear();
+
+        size_t write = 0;
+        for (size_t read = 0; read < count; ++read) {
+            Condition condition = conditions[read];
+            if (condition.handle.promise().cancelled || condition.check(condition.awaiter)) {
+                ready.push_back(condition.handle);
+            }
+            else {
+                conditions[write++] = condition;
+            }
+        }
+        conditions.erase(conditions.begin() + write, conditions.begin() + count);
+        for (Script::Handle handle : ready) {
+            resume(handle);
+        }
+        ready.clear();
+    }
+
+    void clear() {
+        for (const Timer& timer : timers) {
+            timer.handle.destroy();
+        }
+        for (const Condition& condition : conditions) {
+            condition.handle.destroy();
+        }
+        timers.clear();
+        conditions.clear();
+        owners.clear();
+    }
+
+    size_t size() const {
+        return owners.size();
+    }
+
+    struct TimerAwaiter {
+        ScriptScheduler& scheduler;
+        float wakeTime;
+
+        bool await_ready() const noexcept {
+            return false;
+        }
+
+        void await_suspend(Script::Handle handle) {
+            scheduler.pushTimer(wakeTime, handle);
+        }
+
+        void await_resume() const noexcept {}
+    };
+
+    template <typename Predicate>
+    struct ConditionAwaiter {
+        ScriptScheduler& scheduler;
+        Predicate predicate;
+
+        bool await_ready() {
+            return predicate();
+        }
+
+        // The awaiter lives in the suspended frame, so the scheduler can point at it
+        void await_suspend(Script::Handle handle) {
+            scheduler.conditions.push_back(Condition{ handle, &ConditionAwaiter::check, this });
+        }
+
+        void await_resume() const noexcept {}
+
+        static bool check(void* awaiter) {
+            return static_cast<ConditionAwaiter*>(awaiter)->predicate();
+        }
+    };
+
+    // co_await wait(state, seconds): sleep, keeping the wake time in the script's state
+    TimerAwaiter wait(ScriptState& state, float seconds) {
+        state.wakeTime = now + seconds;
+        return TimerAwaiter{ *this, state.wakeTime };
+    }
+
+    // co_await sleepUntil(time): sleep until a wake time saved earlier
+    TimerAwaiter sleepUntil(float wakeTime) {
+        return TimerAwaiter{ *this, wakeTime };
+    }
+
+    // co_await until(predicate): sleep until the predicate holds, checked once per run
+    template <typename Predicate>
+    ConditionAwaiter<Predicate> until(Predicate predicate) {
+        return ConditionAwaiter<Predicate>{ *this, std::move(predicate) };
+    }
+
+private:
+    struct Timer {
+        float wakeTime;
+        std::uint64_t order;
+        Script::Handle handle;
+
+        // Heap comparison: the earliest wake time, then the earliest pushed, comes first
+        static bool later(const Timer& a, const Timer& b) {
+            return a.wakeTime != b.wakeTime ? a.wakeTime > b.wakeTime : a.order > b.order;
+        }
+    };
+
+    struct Condition {
+        Script::Handle handle;
+        bool (*check)(void*);
+        void* awaiter;
+    };
+
+    struct Owner {
+        std::uint32_t owner;
+        Script::Handle handle;
+    };
+
+    // First entry not below `owner`. Ids are handed out in increasing order, so
+    // new owners go on the end and starting a script does not shift the others.
+    std::vector<Owner>::iterator findOwner(std::uint32_t owner) {
+        return std::lower_bound(owners.begin(), owners.end(), owner, [](const Owner& entry, std::uint32_t id) { return entry.owner < id; });
+    }
+
+    std::vector<Owner>::const_iterator findOwner(std::uint32_t owner) const {
+        return std::lower_bound(owners.begin(), owners.end(), owner, [](const Owner& entry, std::uint32_t id) { return entry.owner < id; });
+    }
+
+    void pushTimer(float wakeTime, Script::Handle handle) {
+        timers.push_back(Timer{ wakeTime, nextOrder++, handle });
+        std::push_heap(timers.begin(), timers.end(), Timer::later);
+    }
+
+    void resume(Script::Handle handle) {
+        if (!handle.promise().cancelled) {
+            handle.resume();
+            if (!handle.done()) {
+                return;
+            }
+            auto found = findOwner(handle.promise().owner);
+            if (found != owners.end() && found->handle == handle) {
+                owners.erase(found);
+            }
+        }
+        handle.destroy();
+    }
+
+    float now = 0.f;
+    std::uint64_t nextOrder = 0;
+    std::vector<Timer> timers; // Min-heap on Timer::later
+    std::vector<Condition> conditions;
+    std::vector<Owner> owners; // Sorted by owner; a flat vector, so starting scripts does not allocate once it has grown
+
+    // Scratch buffers reused across runs
+    std::vector<Timer> deferred;
+    std::vector<Script::Handle> ready;
+};
+
+// How a UFO fires. A volley is `shots` shots `interval` seconds apart, each shot
+// launching `bullets` bullets around the aim direction; the whole pattern turns
+// by `spin` degrees from one shot to the next.
+enum class BulletPatternKind : std::uint8_t {
+    AimedBurst, // `bullets` in a line straight at the target
+    Spread,     // `bullets` fanned evenly over `arc` degrees
+    Ring,       // `bullets` evenly around the full circle
+    Spiral      // Like Ring, with a spin that winds the shots into arms
+};
+
+struct BulletPattern {
+    BulletPatternKind kind;
+    int bullets;
+    float arc;          // Degrees, Spread only
+    float speed;        // Launch speed in pixels per second
+    float acceleration; // Pixels per second squared, along the heading
+    float turnRate;     // Degrees per second the heading curves after launch
+    float spin;         // Degrees
+    int shots;
+    float interval;
+};
+
+// Every UFO bullet in the world, stored as parallel arrays of fixed capacity so
+// firing never allocates. Motion is a few straight loops over the arrays that
+// the compiler vectorizes, and the whole pool goes to the renderer as one
+// vertex array of quads. Bullets past capacity are not fired and are counted
+// in droppedCount() instead.
+class BulletPool {
+public:
+    BulletPool(const sf::Texture& texture, size_t capacity) : texture(texture), capacity(capacity) {
+        for (std::vector<float>* field : fields()) {
+            field->resize(capacity);
+        }
+        removed.resize(capacity);
+    }
+
+    // Fire shot number `shot` of a volley from `origin`, centred on `aim` degrees
+    void emit(const BulletPattern& pattern, const sf::Vector2f& origin, float aim, int shot) {
+        const size_t firstNew = count;
+        float base = aim + pattern.spin * shot;
+        float step = 0.f;
+        switch (pattern.kind) {
+        case BulletPatternKind::Spread:
+            step = pattern.bullets > 1 ? pattern.arc / (pattern.bullets - 1) : 0.f;
+            base -= pattern.arc / 2.f;
+            break;
+        case BulletPatternKind::Ring:
+        case BulletPatternKind::Spiral:
+            step = 360.f / pattern.bullets;
+            break;
+        default:
+            break;
+        }
+        for (int i = 0; i < pattern.bullets && count < capacity; ++i, ++count) {
+            float radian = (base + step * i) * 3.14159265f / 180.f;
+            // A burst leaves together and strings out into a line as the slower ones fall behind
+            float speedScale = pattern.kind == BulletPatternKind::AimedBurst ? 1.f - 0.08f * i : 1.f;
+            x[count] = lastX[count] = origin.x;
+            y[count] = lastY[count] = origin.y;
+            dirX[count] = std::cos(radian);
+            dirY[count] = std::sin(radian);
+            speed[count] = pattern.speed * speedScale;
+            acceleration[count] = pattern.acceleration;
+            turnRate[count] = pattern.turnRate * 3.14159265f / 180.f;
+            age[count] = 0.f;
+        }
+        dropped += pattern.bullets - (count - firstNew);
+    }
+
+    void update(float deltaTime) {
+        float* px = x.data();
+        float* py = y.data();
+        float* plastX = lastX.data();
+        float* plastY = lastY.data();
+        float* pdirX = dirX.data();
+        float* pdirY = dirY.data();
+        float* pspeed = speed.data();
+        const float* pacceleration = acceleration.data();
+        const float* pturnRate = turnRate.data();
+        float* page = age.data();
+        for (size_t i = 0; i < count; ++i) {
+            plastX[i] = px[i];
+            plastY[i] = py[i];
+        }
+        // Turning uses a short series in place of cos and sin, which keeps the loop
+        // vectorizable. It is only accurate for small angles, so a long tick or a
+        // fast turn is split into substeps of at most maxTurnStep radians, and the
+        // heading is renormalized afterwards so the series error cannot build up.
+        float fastestTurn = 0.f;
+        for (size_t i = 0; i < count; ++i) {
+            fastestTurn = std::max(fastestTurn, std::abs(pturnRate[i]));
+        }
+        if (fastestTurn > 0.f) {
+            int substeps = std::max(1, static_cast<int>(std::ceil(fastestTurn * deltaTime / maxTurnStep)));
+            float stepTime = deltaTime / substeps;
+            for (int step = 0; step < substeps; ++step) {
+                for (size_t i = 0; i < count; ++i) {
+                    float angle = pturnRate[i] * stepTime;
+                    float cosine = 1.f - angle * angle * 0.5f;
+                    float sine = angle - angle * angle * angle * (1.f / 6.f);
+                    float turnedX = pdirX[i] * cosine - pdirY[i] * sine;
+                    pdirY[i] = pdirX[i] * sine + pdirY[i] * cosine;
+                    pdirX[i] = turnedX;
+                }
+            }
+            for (size_t i = 0; i < count; ++i) {
+                float length = std::sqrt(pdirX[i] * pdirX[i] + pdirY[i] * pdirY[i]);
+                pdirX[i] /= length;
+                pdirY[i] /= length;
+            }
+        }
+        for (size_t i = 0; i < count; ++i) {
+            pspeed[i] += pacceleration[i] * deltaTime;
+            px[i] += pdirX[i] * pspeed[i] * deltaTime;
+            py[i] += pdirY[i] * pspeed[i] * deltaTime;
+            page[i] += deltaTime;
+        }
+    }
+
+    // Remove the bullets outside `area` or older than `maxLifetime` seconds
+    void cull(const sf::FloatRect& area, float maxLifetime) {
+        const float right = area.left + area.width;
+        const float bottom = area.top + area.height;
+        for (size_t i = 0; i < count; ++i) {
+            removed[i] = (age[i] > maxLifetime) | (x[i] < area.left) | (x[i] > right) | (y[i] < area.top) | (y[i] > bottom);
+        }
+        compact();
+    }
+
+    // Remove the bullets whose position `outside` returns true for
+    template <typename Fn>
+    void removeIf(Fn outside) {
+        for (size_t i = 0; i < count; ++i) {
+            removed[i] = outside(sf::Vector2f(x[i], y[i]));
+        }
+        compact();
+    }
+
+    // The first bullet whose path since the last update crossed `target`, or -1
+    int findSweptHit(const sf::FloatRect& target) const {
+        for (size_t i = 0; i < count; ++i) {
+            if (sweepBox(sf::Vector2f(lastX[i], lastY[i]), sf::Vector2f(x[i], y[i]), halfExtents(i), target) >= 0.f) {
+                return static_cast<int>(i);
+            }
+        }
+        return -1;
+    }
+
+    // Replaces the bullet with the last one
+    void erase(size_t index) {
+        --count;
+        for (std::vector<float>* field : fields()) {
+            (*field)[index] = (*field)[count];
+        }
+    }
+
+    void clear() {
+        count = 0;
+    }
+
+    size_t size() const {
+        return count;
+    }
+
+    // Bullets not fired because the pool was full, since construction
+    size_t droppedCount() const {
+        return dropped;
+    }
+
+    sf::Vector2f getPosition(size_t index) const {
+        return sf::Vector2f(x[index], y[index]);
+    }
+
+    // Sprite rotation in degrees; the texture points up, so heading plus 90
+    float getRotation(size_t index) const {
+        return std::atan2(dirY[index], dirX[index]) * 180.f / 3.14159265f + 90.f;
+    }
+
+    float getWidth() const {
+        return static_cast<float>(texture.getSize().x);
+    }
+
+    const sf::Texture& getTexture() const {
+        return texture;
+    }
+
+    // Append a textured quad per bullet overlapping the view. The heading is
+    // already a unit vector, so rotating the corners needs no trigonometry.
+    void capture(const sf::FloatRect& viewBounds, std::vector<sf::Vertex>& quads) const {
+        const float w = static_cast<float>(texture.getSize().x);
+        const float h = static_cast<float>(texture.getSize().y);
+        const float reach = std::max(w, h) / 2.f;
+        const sf::Vector2f corners[4] = { { -w / 2.f, -h / 2.f }, { w / 2.f, -h / 2.f }, { w / 2.f, h / 2.f }, { -w / 2.f, h / 2.f } };
+        const sf::Vector2f texCoords[4] = { { 0.f, 0.f }, { w, 0.f }, { w, h }, { 0.f, h } };
+        for (size_t i = 0; i < count; ++i) {
+            if (x[i] + reach < viewBounds.left || x[i] - reach > viewBounds.left + viewBounds.width ||
+                y[i] + reach < viewBounds.top || y[i] - reach > viewBounds.top + viewBounds.height) {
+                continue;
+            }
+            for (int corner = 0; corner < 4; ++corner) {
+                const sf::Vector2f& local = corners[corner];
+                sf::Vector2f position(x[i] - local.x * dirY[i] - local.y * dirX[i], y[i] + local.x * dirX[i] - local.y * dirY[i]);
+                quads.push_back(sf::Vertex(position, texCoords[corner]));
+            }
+        }
+    }
+
+    void saveState(StateWriter& writer) const {
+        writer.write(static_cast<std::uint32_t>(count));
+        for (const std::vector<float>* field : fields()) {
+            writer.writeBytes(field->data(), count * sizeof(float));
+        }
+    }
+
+    void loadState(StateReader& reader) {
+        std::uint32_t saved = 0;
+        reader.read(saved);
+        count = std::min(static_cast<size_t>(saved), capacity);
+        for (std::vector<float>* field : fields()) {
+            reader.readBytes(field->data(), count * sizeof(float));
+            reader.skip((saved - count) * sizeof(float));
+        }
+    }
+
+private:
+    // Half size of the box around the rotated sprite
+    sf::Vector2f halfExtents(size_t index) const {
+        const float w = static_cast<float>(texture.getSize().x);
+        const float h = static_cast<float>(texture.getSize().y);
+        float alongX = std::abs(dirX[index]);
+        float alongY = std::abs(dirY[index]);
+        return sf::Vector2f((alongY * w + alongX * h) / 2.f, (alongX * w + alongY * h) / 2.f);
+    }
+
+    // Fills each removed slot with the last kept bullet
+    void compact() {
+        for (size_t i = 0; i < count;) {
+            if (!removed[i]) {
+                ++i;
+                continue;
+            }
+            --count;
+            removed[i] = removed[count];
+            for (std::vector<float>* field : fields()) {
+                (*field)[i] = (*field)[count];
+            }
+        }
+    }
+
+    std::array<std::vector<float>*, 10> fields() {
+        return { &x, &y, &lastX, &lastY, &dirX, &dirY, &speed, &acceleration, &turnRate, &age };
+    }
+
+    std::array<const std::vector<float>*, 10> fields() const {
+        return { &x, &y, &lastX, &lastY, &dirX, &dirY, &speed, &acceleration, &turnRate, &age };
+    }
+
+    static constexpr float maxTurnStep = 0.2f; // Radians
+
+    const sf::Texture& texture;
+    size_t capacity;
+    size_t count = 0;
+    size_t dropped = 0;
+    std::vector<float> x, y, lastX, lastY; // Position now and before the last update, for swept hits
+    std::vector<float> dirX, dirY;         // Unit heading
+    std::vector<float> speed, acceleration, turnRate, age;
+    std::vector<std::uint8_t> removed;     // Scratch flags for cull and removeIf
+};
+
+class UFO_Boss {
+public:
+    // `wrap` is off in worlds bigger than the screen, where the UFO stops at the edge instead
+    UFO_Boss(const sf::Vector2f& position, const sf::Vector2u& windowSize, const sf::Texture& texture, bool wrap = true)
+        : windowSize(windowSize), wrap(wrap) {
+
+		sprite.setTexture(texture);
+		sprite.setOrigin(texture.getSize().x / 2, texture.getSize().y / 2);
+		sprite.setPosition(position);
+	}
+
+    void draw(sf::RenderWindow& window) const {
+		window.draw(sprite);
+	}
+
+    const sf::Sprite& getSprite() const {
+		return sprite;
+	}
+
+    sf::FloatRect getBounds() const {
+		return sprite.getGlobalBounds();
+	}
+
+    sf::Vector2f getPosition() const {
+		return sprite.getPosition();
+	}
+
+    void update(const FlowField& flowField, float deltaTime) {
+		//UFO Boss follows the player
+		sprite.move(flowField.sampleAsObstacle(sprite.getPosition()) * 600.f * deltaTime);
+
+		// Screen wrapping
+        sf::Vector2f position = sprite.getPosition();
+        if (wrap) {
+            if (position.x < 0) position.x = windowSize.x;
+            if (position.x > windowSize.x) position.x = 0;
+            if (position.y < 0) position.y = windowSize.y;
+            if (position.y > windowSize.y) position.y = 0;
+        }
+        else {
+            position.x = std::min(std::max(position.x, 0.f), static_cast<float>(windowSize.x));
+            position.y = std::min(std::max(position.y, 0.f), static_cast<float>(windowSize.y));
+        }
+        sprite.setPosition(position);
+	}
+
+    LODState lod;
+    std::uint32_t id = 0; // Stable handle its behaviour script finds it by
+    ScriptState script;
+
+    void saveState(StateWriter& writer) const {
+        writeSprite(writer, sprite);
+        writer.write(lod);
+        writer.write(id);
+        writer.write(script);
+    }
+
+    void loadState(StateReader& reader) {
+        readSprite(reader, sprite);
+        reader.read(lod);
+        reader.read(id);
+        reader.read(script);
+    }
+
+private:
+	sf::Sprite sprite;
+    sf::Vector2u windowSize;
+    bool wrap;
+};
+
+class Medkit {
+public:
+    Medkit(const sf::Texture& texture, const sf::Vector2f& position) {
+		sprite.setTexture(texture);
+		sprite.setOrigin(texture.getSize().x / 2, texture.getSize().y / 2);
+		sprite.setPosition(position);
+	}
+
+    void update(float deltaTime) {
+		age += deltaTime;
+	}
+
+    void draw(sf::RenderWindow& window) const {
+		window.draw(sprite);
+	}
+
+    const sf::Sprite& getSprite() const {
+		return sprite;
+	}
+
+    sf::FloatRect getBounds() const {
+		return sprite.getGlobalBounds();
+	}
+
+    sf::Vector2f getPosition() const {
+		return sprite.getPosition();
+	}
+
+    float getAge() const {
+		return age;
+	}
+
+    void saveState(StateWriter& writer) const {
+        writeSprite(writer, sprite);
+        writer.write(age);
+    }
+
+    void loadState(StateReader& reader) {
+        readSprite(reader, sprite);
+        reader.read(age);
+    }
+
+private:
+    sf::Sprite sprite;
+    float age = 0.f; // Seconds since the medkit was dropped
+};
+
+class Health {
+public:
+    Health(const sf::Texture& fullHeartTex, const sf::Texture& halfHeartTex, int maxHearts)
+        : fullHeartTexture(fullHeartTex), halfHeartTexture(halfHeartTex), maxHearts(maxHearts), currentHearts(maxHearts * 2) {
+    }
+
+    void takeDamage(int damage) {
+        currentHearts -= damage;
+        if (currentHearts < 0) currentHearts = 0;
+    }
+
+    void resetHealth() {
+        currentHearts = maxHearts * 2;
+    }
+
+    void setCurrentHearts(int hearts) {
+        currentHearts = hearts;
+    }
+
+    int getCurrentHearts() const {
+        return currentHearts;
+    }
+
+    int getMaxHearts() const {
+        return maxHearts;
+    }
+
+    const sf::Texture& getFullHeartTexture() const {
+        return fullHeartTexture;
+    }
+
+    const sf::Texture& getHalfHeartTexture() const {
+        return halfHeartTexture;
+    }
+
+private:
+    const sf::Texture& fullHeartTexture;
+    const sf::Texture& halfHeartTexture;
+    int maxHearts;
+    int currentHearts;
+};
+
+
+enum class AnimationLoop {
+    Once,  // Finishes when it reaches its last frame
+    Repeat
+};
+
+// Immutable sprite-sheet animation, built once and shared by every instance that plays it
+struct AnimationClip {
+    const sf::Texture* texture = nullptr;
+    std::vector<sf::IntRect> frames; // Source rect of each frame
+    float frameTime = 0.f;
+    AnimationLoop loop = AnimationLoop::Once;
+    sf::Vector2f origin;
+    float scale = 1.f; // How many times smaller than full size the loaded sheet is
+
+    // Frame sizes are at full size. Frames run left to right, then top to bottom.
+    static AnimationClip fromSheet(const sf::Texture& texture, int frameWidth, int frameHeight, int numFrames, float frameTime, AnimationLoop loop, float textureScale = 1.f) {
+        AnimationClip clip;
+        clip.texture = &texture;
+        clip.frameTime = frameTime;
+        clip.loop = loop;
+        clip.scale = textureScale;
+        int width = static_cast<int>(frameWidth / textureScale);
+        int height = static_cast<int>(frameHeight / textureScale);
+        int columns = std::max(static_cast<int>(texture.getSize().x) / width, 1);
+        for (int frame = 0; frame < numFrames; ++frame) {
+            clip.frames.push_back(sf::IntRect(frame % columns * width, frame / columns * height, width, height));
+        }
+        clip.origin = sf::Vector2f(width / 2, height / 2);
+        return clip;
+    }
+
+    SpriteState capture(size_t frame, const sf::Vector2f& position) const {
+        return SpriteState{ texture, frames[frame], position, origin, sf::Vector2f(scale, scale), 0.f };
+    }
+
+    // Same arithmetic as sf::Sprite::getGlobalBounds, so collisions match it exactly
+    sf::FloatRect bounds(size_t frame, const sf::Vector2f& position) const {
+        float left = -origin.x * scale + position.x;
+        float top = -origin.y * scale + position.y;
+        return sf::FloatRect(left, top, (scale * frames[frame].width + left) - left, (scale * frames[frame].height + top) - top);
+    }
+};
+
+// Index of each clip in WorldTextures::animationClips
+enum AnimationClipId : std::uint16_t {
+    ExplosionClip,
+    ShockwaveClip
+};
+
+// One playing animation
+struct AnimationInstance {
+    std::uint16_t clip;
+    std::uint16_t frame;
+    float elapsed;
+    sf::Vector2f position;
+};
+
+// Live animations as small records over a shared clip table. Playing one
+// appends a record, and the whole pool steps in one pass without allocating.
+class AnimationPool {
+public:
+    explicit AnimationPool(const std::vector<AnimationClip>& clips, size_t capacity = 256) : clips(clips) {
+        instances.reserve(capacity);
+    }
+
+    void play(AnimationClipId clip, const sf::Vector2f& position) {
+        instances.push_back(AnimationInstance{ clip, 0, 0.f, position });
+    }
+
+    // Advance every instance and drop the ones that finished, keeping the rest in order
+    void update(float deltaTime) {
+        size_t kept = 0;
+        for (size_t i = 0; i < instances.size(); ++i) {
+            AnimationInstance instance = instances[i];
+            const AnimationClip& clip = clips[instance.clip];
+            instance.elapsed += deltaTime;
+            if (instance.elapsed >= clip.frameTime) {
+                instance.frame = static_cast<std::uint16_t>((instance.frame + 1) % clip.frames.size());
+                instance.elapsed = 0.f;
+            }
+            if (clip.loop == AnimationLoop::Once && instance.frame == clip.frames.size() - 1) {
+                continue;
+            }
+            instances[kept++] = instance;
+        }
+        instances.resize(kept);
+    }
+
+    sf::FloatRect getBounds(size_t index) const {
+        const AnimationInstance& instance = instances[index];
+        return clips[instance.clip].bounds(instance.frame, instance.position);
+    }
+
+    const AnimationInstance& operator[](size_t index) const {
+        return instances[index];
+    }
+
+    size_t size() const {
+        return instances.size();
+    }
+
+    void erase(size_t index) {
+        instances.erase(instances.begin() + index);
+    }
+
+    void clear() {
+        instances.clear();
+    }
+
+    // Capture only the instances whose bounds overlap the view
+    void capture(const sf::FloatRect& viewBounds, std::vector<SpriteState>& sprites) const {
+        for (size_t i = 0; i < instances.size(); ++i) {
+            if (viewBounds.intersects(getBounds(i))) {
+                sprites.push_back(clips[instances[i].clip].capture(instances[i].frame, instances[i].position));
+            }
+        }
+    }
+
+    void saveState(StateWriter& writer) const {
+        writer.write(static_cast<std::uint32_t>(instances.size()));
+        for (const AnimationInstance& instance : instances) {
+            writer.write(instance);
+        }
+    }
+
+    void loadState(StateReader& reader) {
+        std::uint32_t count = 0;
+        reader.read(count);
+        instances.resize(count);
+        for (AnimationInstance& instance : instances) {
+            reader.read(instance);
+        }
+    }
+
+private:
+    const std::vector<AnimationClip>& clips;
+    std::vector<AnimationInstance> instances;
+};
+
+class Player {
+public:
+    // `wrap` is off in worlds bigger than the screen, where the ship stops at the edge instead
+    Player(const sf::Texture& idleTexture, const sf::Texture& thrustingTexture, const sf::Vector2f& position, const sf::Vector2u& windowSize, bool wrap = true)
+        : textureIdle(idleTexture), textureThrusting(thrustingTexture), velocity(0.f, 0.f), thrust(20.f), // Increase thrust // Decrease thrust duration
+        windowSize(windowSize), wrap(wrap), isThrusting(false) {
+        sprite.setTexture(textureIdle);
+        sprite.setOrigin(textureIdle.getSize().x / 2, textureIdle.getSize().y / 2);
+        sprite.setPosition(position);
+    }
+
+    void update(float deltaTime, bool thrustPressed) {
+        // Change the sprite based on whether the player is thrusting
+        if (thrustPressed) {
+            isThrusting = true;
+            sprite.setTexture(textureThrusting);
+            //thrustTimer += deltaTime;
+            //if (thrustTimer >= thrustDuration) {
+            //    isThrusting = false;
+            //    thrustsound.stop();
+            //    sprite.setTexture(textureIdle);
+            //}
+        }
+        else {
+            isThrusting = false;
+            //thrustTimer = 0.f;
+            sprite.setTexture(textureIdle);
+        }
+
+        // Apply thrust
+        if (isThrusting) {
+            float rotation = sprite.getRotation() - 90;
+            float radian = rotation * 3.14159265 / 180;
+            velocity.x += std::cos(radian) * thrust * deltaTime;
+            velocity.y += std::sin(radian) * thrust * deltaTime;
+        }
+        else {
+            // Slow down the ship when not thrusting (optional)
+            velocity *= 0.95f; // Adjust the factor as needed
+        }
+
+        const float maxSpeed = 500.f;
+        float speed = std::sqrt(velocity.x * velocity.x + velocity.y * velocity.y);
+        if (speed > maxSpeed) {
+            velocity /= speed; // Normalize the vector
+			velocity *= maxSpeed;
+		}
+
+        // Apply inertia
+        //sprite.move(velocity * deltaTime);
+        sprite.move(velocity);
+
+        // Screen wrapping
+        sf::Vector2f position = sprite.getPosition();
+        if (wrap) {
+            if (position.x < 0) position.x = windowSize.x;
+            if (position.x > windowSize.x) position.x = 0;
+            if (position.y < 0) position.y = windowSize.y;
+            if (position.y > windowSize.y) position.y = 0;
+        }
+        else {
+            // Hitting the edge of the world kills the speed into it
+            sf::Vector2f clamped(std::min(std::max(position.x, 0.f), static_cast<float>(windowSize.x)), std::min(std::max(position.y, 0.f), static_cast<float>(windowSize.y)));
+            if (clamped.x != position.x) velocity.x = 0.f;
+            if (clamped.y != position.y) velocity.y = 0.f;
+            position = clamped;
+        }
+        sprite.setPosition(position);
+    }
+
+    void draw(sf::RenderWindow& window) {
+        window.draw(sprite);
+    }
+
+    sf::Vector2f getPosition() const {
+        return sprite.getPosition();
+    }
+
+    float getRotation() const {
+        return sprite.getRotation();
+    }
+
+    bool getThrusting() const {
+        return isThrusting;
+    }
+
+    sf::FloatRect getBounds() const {
+        return sprite.getGlobalBounds();
+    }
+
+    const sf::Sprite& getSprite() const {
+        return sprite;
+    }
+
+    void setPosition(const sf::Vector2f& position) {
+		sprite.setPosition(position);
+	}
+
+    sf::Vector2f getVelocity() const {
+        return velocity;
+    }
+
+    void setVelocity(const sf::Vector2f& newVelocity) {
+        velocity = newVelocity;
+    }
+
+    void updateRotation(const sf::Vector2f& mousePosition) {
+        sf::Vector2f direction = mousePosition - sprite.getPosition();
+        float angle = std::atan2(direction.y, direction.x) * 180 / 3.14159265 + 90; // Convert to degrees and adjust
+        sprite.setRotation(angle);
+    }
+
+    void saveState(StateWriter& writer) const {
+        writeSprite(writer, sprite);
+        writer.write(velocity);
+        writer.write(thrustTimer);
+        writer.write(isThrusting);
+    }
+
+    void loadState(StateReader& reader) {
+        readSprite(reader, sprite);
+        reader.read(velocity);
+        reader.read(thrustTimer);
+        reader.read(isThrusting);
+    }
+
+private:
+    sf::Sprite sprite;
+    const sf::Texture& textureIdle;
+    const sf::Texture& textureThrusting;
+    sf::Vector2f velocity;
+    float thrust;
+    float thrustTimer = 0;
+    sf::Vector2u windowSize;
+    bool wrap;
+    bool isThrusting;
+};
+
+class Projectile {
+public:
+    Projectile(const sf::Texture& texture, const sf::Vector2f& position, float rotation) {
+        sprite.setTexture(texture);
+        sprite.setOrigin(texture.getSize().x / 2, texture.getSize().y / 2);
+        sprite.setPosition(position);
+        sprite.setRotation(rotation);
+        previousPosition = position;
+    }
+
+    void update(float deltaTime) {
+        float rotation = sprite.getRotation() - 90; // Adjust as needed
+        float radian = rotation * 3.14159265 / 180;
+        previousPosition = sprite.getPosition();
+        sprite.move(std::cos(radian) * 600.f * deltaTime, std::sin(radian) * 600.f * deltaTime); // Adjust the speed here
+        age += deltaTime;
+    }
+
+    void draw(sf::RenderWindow& window) const {
+        window.draw(sprite);
+    }
+
+    const sf::Sprite& getSprite() const {
+        return sprite;
+    }
+
+    sf::FloatRect getBounds() const {
+        return sprite.getGlobalBounds();
+    }
+
+    sf::Vector2f getPosition() const {
+        return sprite.getPosition();
+    }
+
+    // Where the last update moved the projectile from, for swept hits
+    sf::Vector2f getPreviousPosition() const {
+        return previousPosition;
+    }
+
+    float getAge() const {
+        return age;
+    }
+
+    LODState lod;
+
+    void saveState(StateWriter& writer) const {
+        writeSprite(writer, sprite);
+        writer.write(previousPosition);
+        writer.write(age);
+        writer.write(lod);
+    }
+
+    void loadState(StateReader& reader) {
+        readSprite(reader, sprite);
+        reader.read(previousPosition);
+        reader.read(age);
+        reader.read(lod);
+    }
+
+private:
+    sf::Sprite sprite;
+    sf::Vector2u windowSize;
+    sf::Vector2f previousPosition;
+    float age = 0.f; // Seconds since the projectile was fired
+};
+
+enum class EnemyType {
+    Normal,
+    Fast,
+    Direct
+};
+
+class Enemy {
+public:
+    Enemy(const sf::Texture& texture, const sf::Texture& texture2, const sf::Vector2f& position, const sf::Vector2f& initialDirection, EnemyType type)
+        : type(type), direction(initialDirection) {
+
+        if (type == EnemyType::Direct) {
+            sprite.setTexture(texture2);
+        }
+        else {
+            sprite.setTexture(texture);
+        }
+        sprite.setOrigin(texture.getSize().x / 2, texture.getSize().y / 2);
+        sprite.setPosition(position);
+    }
+
+    void update(const FlowField& flowField, float deltaTime) {
+        float speed = 0.f;
+        switch (type) {
+        case EnemyType::Normal:
+            speed = 100.f;
+            break;
+        case EnemyType::Fast:
+            speed = 600.f;
+            break;
+        case EnemyType::Direct:
+            speed = 600.f;
+            break;
+        }
+
+        if (type != EnemyType::Direct) { // Check if enemy type is not Direct
+            // Move in the initial direction only
+            sprite.move(direction * speed * deltaTime);
+        }
+        else {
+            // Move directly towards the player
+            sprite.move(flowField.sample(sprite.getPosition()) * speed * deltaTime);
+        }
+        age += deltaTime;
+    }
+
+
+    void draw(sf::RenderWindow& window) const {
+        window.draw(sprite);
+    }
+
+    const sf::Sprite& getSprite() const {
+        return sprite;
+    }
+
+    sf::FloatRect getBounds() const {
+        return sprite.getGlobalBounds();
+    }
+
+    sf::Vector2f getPosition() const {
+        return sprite.getPosition();
+    }
+    EnemyType getType() const {
+        return type;
+    }
+    float getAge() const {
+        return age;
+    }
+
+    LODState lod;
+
+    void saveState(StateWriter& writer) const {
+        writeSprite(writer, sprite);
+        writer.write(type);
+        writer.write(direction);
+        writer.write(age);
+        writer.write(lod);
+    }
+
+    void loadState(StateReader& reader) {
+        readSprite(reader, sprite);
+        reader.read(type);
+        reader.read(direction);
+        reader.read(age);
+        reader.read(lod);
+    }
+
+private:
+    sf::Sprite sprite;
+    EnemyType type;
+    sf::Vector2f direction; // Store the initial direction
+    float age = 0.f; // Seconds since the enemy was spawned
+};
+
+class Powerup {
+public:
+    Powerup(const sf::Texture& texture, const sf::Vector2f& position) {
+		sprite.setTexture(texture);
+		sprite.setOrigin(texture.getSize().x / 2, texture.getSize().y / 2);
+		sprite.setPosition(position);
+	}
+
+    void update(float deltaTime) {
+		age += deltaTime;
+	}
+
+    void draw(sf::RenderWindow& window) const {
+		window.draw(sprite);
+	}
+
+    const sf::Sprite& getSprite() const {
+		return sprite;
+	}
+
+    sf::FloatRect getBounds() const {
+		return sprite.getGlobalBounds();
+	}
+
+    sf::Vector2f getPosition() const {
+        return sprite.getPosition();
+    }
+
+    float getAge() const {
+        return age;
+    }
+
+    void saveState(StateWriter& writer) const {
+        writeSprite(writer, sprite);
+        writer.write(age);
+    }
+
+    void loadState(StateReader& reader) {
+        readSprite(reader, sprite);
+        reader.read(age);
+    }
+
+private:
+    sf::Sprite sprite;
+    float age = 0.f; // Seconds since the powerup was dropped
+};
+
+// Cosmetic particle effects, see ParticleSystem
+enum class ParticlePreset : std::uint8_t {
+    ExplosionBurst,
+    Debris,
+    ThrustTrail,
+    ShockwaveRing
+};
+
+// A preset fired at a point, heading in `direction` degrees
+struct EffectEvent {
+    ParticlePreset preset;
+    sf::Vector2f position;
+    float direction;
+};
+
+// Immutable view of one simulation tick, handed from the game thread to the render thread
+struct RenderSnapshot {
+    sf::FloatRect view;               // World area the camera shows
+    std::vector<SpriteState> sprites; // In draw order
+    std::vector<sf::Vertex> bulletQuads; // Every visible UFO bullet, drawn in one call under the sprites
+    const sf::Texture* bulletTexture = nullptr;
+    std::vector<EffectEvent> effects; // One-shot particle effects to start this frame; Game queues its own instead
+    std::vector<EffectEvent> thrusters; // Trails emitted continuously while these ships thrust
+    int score = 0;
+    int shockwaveCount = 0;
+    int medkitsUsed = 0;
+    int hearts = 0;                   // In halves
+    int maxHearts = 0;
+    const sf::Texture* fullHeart = nullptr;
+    const sf::Texture* halfHeart = nullptr;
+    bool paused = false;
+    bool ownShipFirst = false; // sprites[0] is this cabinet's ship
+    bool lateAim = false;      // Turn that ship toward the mouse as it is when the frame is drawn
+    sf::Int64 inputTime = -1;  // When the oldest press this tick acted on was read, -1 if none
+    sf::Int64 publishTime = 0; // When the tick was handed over, on the same clock as inputTime
+    // Pixels per tick that ship and the view move by, for drawing between ticks
+    sf::Vector2f shipVelocity;
+    sf::Vector2f viewVelocity;
+};
+
+// What drawing a scene submitted, counted at the SFML level since SFML hides the
+// GL calls: a draw call per sprite or particle batch, and a texture bind whenever
+// a draw uses a different texture from the one before it
+struct RenderStats {
+    size_t drawCalls = 0;
+    size_t textureBinds = 0;
+    size_t vertices = 0;
+};
+
+// Despawn rules for one kind of entity. Anything further than `margin` pixels
+// outside the playfield, or older than `maxLifetime` seconds, is removed.
+struct DespawnRule {
+    float margin;
+    float maxLifetime;
+};
+
+
+// PCG32 (XSH RR). Small, fast and seedable, with no hidden global state, so
+// every subsystem can own its own stream and replays stay reproducible.
+class Pcg32 {
+public:
+    void seed(std::uint64_t seed, std::uint64_t stream) {
+        state = 0;
+        increment = (stream << 1) | 1;
+        (*this)();
+        state += seed;
+        (*this)();
+    }
+
+    std::uint32_t operator()() {
+        std::uint64_t old = state;
+        state = old * 6364136223846793005ULL + increment;
+        std::uint32_t xorshifted = static_cast<std::uint32_t>(((old >> 18) ^ old) >> 27);
+        std::uint32_t rotation = static_cast<std::uint32_t>(old >> 59);
+        return (xorshifted >> rotation) | (xorshifted << ((32 - rotation) & 31));
+    }
+
+private:
+    std::uint64_t state = 0;
+    std::uint64_t increment = 1;
+};
+
+// Fixed-budget pool of cosmetic particles stored as parallel arrays. It lives
+// on the render thread, is fed by the effect events in each snapshot and never
+// touches the simulation. Integration is a handful of straight loops over the
+// arrays that the compiler vectorizes, and each blend material is one draw call.
+class ParticleSystem {
+public:
+    // Trail particles a thrusting ship leaves each second
+    static constexpr float thrustParticlesPerSecond = 90.f;
+
+    explicit ParticleSystem(size_t budget) : budget(budget) {
+        for (std::vector<float>* field : { &x, &y, &vx, &vy, &age, &life, &drag }) {
+            field->resize(budget);
+        }
+        preset.resize(budget);
+        rng.seed(std::random_device{}(), 5);
+        for (auto& batch : batches) {
+            batch.setPrimitiveType(sf::Quads);
+        }
+    }
+
+    // Emit `amount` times a preset's particle count, scaled by the density.
+    // Emission thins out once the pool is half full and stops at the budget, so
+    // heavy scenes lose density rather than effects.
+    void emit(const EffectEvent& event, float amount = 1.f) {
+        const Emitter& emitter = emitterFor(event.preset);
+        float fill = static_cast<float>(count) / budget;
+        float thinning = fill < 0.5f ? 1.f : (1.f - fill) * 2.f;
+        // Round randomly so fractional amounts, like a per-frame trail, still average out
+        size_t wanted = static_cast<size_t>(emitter.count * amount * density * thinning + random01());
+        size_t spawned = std::min(wanted, budget - count);
+        for (size_t i = 0; i < spawned; ++i, ++count) {
+            float angle = (event.direction + (random01() - 0.5f) * emitter.spread) * 3.14159265f / 180.f;
+            float speed = emitter.speedMin + (emitter.speedMax - emitter.speedMin) * random01();
+            x[count] = event.position.x;
+            y[count] = event.position.y;
+            vx[count] = std::cos(angle) * speed;
+            vy[count] = std::sin(angle) * speed;
+            age[count] = 0.f;
+            life[count] = emitter.lifeMin + (emitter.lifeMax - emitter.lifeMin) * random01();
+            drag[count] = emitter.drag;
+            preset[count] = event.preset;
+        }
+    }
+
+    void update(float deltaTime) {
+        float* px = x.data();
+        float* py = y.data();
+        float* pvx = vx.data();
+        float* pvy = vy.data();
+        float* page = age.data();
+        const float* pdrag = drag.data();
+        for (size_t i = 0; i < count; ++i) {
+            px[i] += pvx[i] * deltaTime;
+            py[i] += pvy[i] * deltaTime;
+        }
+        for (size_t i = 0; i < count; ++i) {
+            float damping = std::max(1.f - pdrag[i] * deltaTime, 0.f);
+            pvx[i] *= damping;
+            pvy[i] *= damping;
+        }
+        for (size_t i = 0; i < count; ++i) {
+            page[i] += deltaTime;
+        }
+
+        // Expired particles are replaced by the last live one
+        for (size_t i = 0; i < count;) {
+            if (age[i] < life[i]) {
+                ++i;
+                continue;
+            }
+            --count;
+            x[i] = x[count];
+            y[i] = y[count];
+            vx[i] = vx[count];
+            vy[i] = vy[count];
+            age[i] = age[count];
+            life[i] = life[count];
+            drag[i] = drag[count];
+            preset[i] = preset[count];
+        }
+    }
+
+    void draw(sf::RenderTarget& target, RenderStats& stats) {
+        for (auto& batch : batches) {
+            batch.clear();
+        }
+        for (size_t i = 0; i < count; ++i) {
+            const Emitter& emitter = emitterFor(preset[i]);
+            float t = age[i] / life[i];
+            sf::Color color(lerp(emitter.startColor.r, emitter.endColor.r, t), lerp(emitter.startColor.g, emitter.endColor.g, t),
+                lerp(emitter.startColor.b, emitter.endColor.b, t), lerp(emitter.startColor.a, emitter.endColor.a, t));
+            float half = emitter.size * (1.f - 0.5f * t) / 2.f;
+            sf::VertexArray& batch = batches[emitter.material];
+            batch.append(sf::Vertex(sf::Vector2f(x[i] - half, y[i] - half), color));
+            batch.append(sf::Vertex(sf::Vector2f(x[i] + half, y[i] - half), color));
+            batch.append(sf::Vertex(sf::Vector2f(x[i] + half, y[i] + half), color));
+            batch.append(sf::Vertex(sf::Vector2f(x[i] - half, y[i] + half), color));
+        }
+        for (int material : { Additive, Blended }) {
+            if (batches[material].getVertexCount() > 0) {
+                target.draw(batches[material], sf::RenderStates(material == Additive ? sf::BlendAdd : sf::BlendAlpha));
+                ++stats.drawCalls;
+                stats.vertices += batches[material].getVertexCount();
+            }
+        }
+    }
+
+    size_t size() const {
+        return count;
+    }
+
+    // Fraction of every effect's particles that are emitted
+    void setDensity(float fraction) {
+        density = fraction;
+    }
+
+private:
+    enum Material {
+        Additive, // Glowing sparks, trails and rings
+        Blended,  // Solid debris
+        MaterialCount
+    };
+
+    struct Emitter {
+        int count;
+        float spread; // Degrees either side of the event's direction, in total
+        float speedMin, speedMax;
+        float lifeMin, lifeMax;
+        float size;
+        float drag; // Fraction of velocity lost per second
+        sf::Color startColor, endColor;
+        Material material;
+    };
+
+    static const Emitter& emitterFor(ParticlePreset preset) {
+        static const Emitter emitters[] = {
+            { 48, 360.f, 60.f, 260.f, 0.25f, 0.6f, 6.f, 3.f, sf::Color(255, 220, 120, 255), sf::Color(255, 60, 20, 0), Additive },   // ExplosionBurst
+            { 14, 360.f, 40.f, 160.f, 0.6f, 1.4f, 4.f, 1.f, sf::Color(170, 160, 150, 255), sf::Color(90, 80, 70, 0), Blended },      // Debris
+            { 1, 25.f, 120.f, 220.f, 0.15f, 0.35f, 5.f, 2.f, sf::Color(140, 200, 255, 255), sf::Color(40, 60, 255, 0), Additive },    // ThrustTrail
+            { 96, 360.f, 850.f, 950.f, 0.45f, 0.55f, 8.f, 0.5f, sf::Color(120, 240, 255, 220), sf::Color(40, 120, 255, 0), Additive } // ShockwaveRing
+        };
+        return emitters[static_cast<int>(preset)];
+    }
+
+    static sf::Uint8 lerp(sf::Uint8 from, sf::Uint8 to, float t) {
+        return static_cast<sf::Uint8>(from + (to - from) * t);
+    }
+
+    float random01() {
+        return (rng() >> 8) * (1.f / 16777216.f);
+    }
+
+    size_t budget;
+    size_t count = 0;
+    float density = 1.f;
+    std::vector<float> x, y, vx, vy, age, life, drag;
+    std::vector<ParticlePreset> preset;
+    Pcg32 rng;
+    sf::VertexArray batches[MaterialCount];
+};
+
+// Draws a snapshot's world scene into `target`: the UFO bullet batch, sprites in
+// snapshot order, then particles. Game::render and the render benchmark both go through here, so the
+// benchmark measures what the game submits. `ship`, when given, is drawn in place
+// of sprite 0 (the late-latched, extrapolated ship).
+inline void drawScene(sf::RenderTarget& target, const RenderSnapshot& snapshot, ParticleSystem& particles, float particleTime,
+    RenderStats& stats, const SpriteState* ship = nullptr) {
+    sf::Sprite sprite;
+    const sf::Texture* bound = nullptr;
+    if (!snapshot.bulletQuads.empty()) {
+        target.draw(snapshot.bulletQuads.data(), snapshot.bulletQuads.size(), sf::Quads, sf::RenderStates(snapshot.bulletTexture));
+        bound = snapshot.bulletTexture;
+        ++stats.textureBinds;
+        ++stats.drawCalls;
+        stats.vertices += snapshot.bulletQuads.size();
+    }
+    for (size_t i = 0; i < snapshot.sprites.size(); ++i) {
+        const SpriteState& state = i == 0 && ship ? *ship : snapshot.sprites[i];
+        state.apply(sprite);
+        target.draw(sprite);
+        // SFML only rebinds when the texture changes from the previous draw
+        if (state.texture != bound) {
+            bound = state.texture;
+            ++stats.textureBinds;
+        }
+        ++stats.drawCalls;
+        stats.vertices += 4;
+    }
+
+    for (const EffectEvent& effect : snapshot.effects) {
+        particles.emit(effect);
+    }
+    for (const EffectEvent& thruster : snapshot.thrusters) {
+        particles.emit(thruster, ParticleSystem::thrustParticlesPerSecond * particleTime);
+    }
+    // A zero step is a paused or skipped frame, so there is nothing to integrate
+    if (particleTime > 0.f) {
+        particles.update(particleTime);
+    }
+    particles.draw(target, stats);
+}
+
+// Draws the health bar from a snapshot, so the render thread never touches the world
+inline void drawHearts(sf::RenderTarget& target, const RenderSnapshot& snapshot) {
+    if (!snapshot.fullHeart || !snapshot.halfHeart) {
+        return;
+    }
+    float spacing = snapshot.fullHeart->getSize().x + 30.f;
+    sf::Sprite heartSprite;
+    for (int i = 0; i < snapshot.maxHearts; ++i) {
+        if (i * 2 + 1 < snapshot.hearts) {
+            heartSprite.setTexture(*snapshot.fullHeart, true);
+        }
+        else if (i * 2 + 1 == snapshot.hearts) {
+            heartSprite.setTexture(*snapshot.halfHeart, true);
+        }
+        else {
+            break; // No more hearts to draw
+        }
+        heartSprite.setPosition(10.f + i * spacing, 10.f); // Position hearts with some spacing
+        target.draw(heartSprite);
+    }
+}
+
+// Rolling input-to-photon latencies in milliseconds, for the end-of-session report
+class LatencyStats {
+public:
+    void clear() {
+        samples.clear();
+        next = 0;
+    }
+
+    void add(float milliseconds) {
+        if (samples.size() < capacity) {
+            samples.push_back(milliseconds);
+        }
+        else {
+            samples[next] = milliseconds;
+            next = (next + 1) % capacity;
+        }
+    }
+
+    void report(std::ostream& out, const char* label) const {
+        if (samples.empty()) {
+            return;
+        }
+        std::vector<float> sorted(samples);
+        std::sort(sorted.begin(), sorted.end());
+        float mean = 0.f;
+        for (float sample : sorted) {
+            mean += sample / sorted.size();
+        }
+        out << label << ": mean " << mean << " ms, p50 " << sorted[sorted.size() / 2] << " ms, p99 "
+            << sorted[std::min(sorted.size() - 1, sorted.size() * 99 / 100)] << " ms over the last " << sorted.size() << " frames" << std::endl;
+    }
+
+private:
+    static const size_t capacity = 4096;
+    std::vector<float> samples;
+    size_t next = 0;
+};
+
+// Entity kinds in the co-op state stream
+enum NetKind : std::uint8_t {
+    NetKindShip,
+    NetKindAsteroid,
+    NetKindUFO,
+    NetKindUFOBullet,
+    NetKindProjectile,
+    NetKindPowerup,
+    NetKindMedkit,
+    NetKindExplosion,
+    NetKindShockwave,
+    NetKindCount
+};
+
+// One entity as the co-op host sends it: what to draw and where
+struct NetEntity {
+    std::uint8_t kind;    // NetKind
+    std::uint8_t variant; // EnemyType for asteroids, the frame for animations, thrusting for ships
+    sf::Vector2f position;
+    float rotation;
+};
+
+// Trail from the back of a thrusting ship, pointing away from where it faces
+inline EffectEvent thrusterFor(const Player& ship) {
+    float backward = ship.getRotation() + 90.f;
+    float radian = backward * 3.14159265f / 180.f;
+    sf::Vector2f offset(std::cos(radian) * 30.f, std::sin(radian) * 30.f);
+    return EffectEvent{ ParticlePreset::ThrustTrail, ship.getPosition() + offset, backward };
+}
+
+// Sounds the last World::update asked for. The game plays them, headless runs ignore them.
+struct WorldEvents {
+    bool shot = false;
+    bool explosion = false;
+    bool shockwave = false;
+    std::vector<EffectEvent> effects; // Where particle effects should play
+
+    // Keeps the effect buffer's capacity for the next tick
+    void clear() {
+        shot = explosion = shockwave = false;
+        effects.clear();
+    }
+};
+
+// Live entity counts the director budgets against
+struct SpawnCounts {
+    int asteroids = 0;
+    int UFOs = 0;
+    int total = 0;
+};
+
+// What the director wants added this tick
+struct SpawnPlan {
+    std::vector<EnemyType> asteroids; // One entry per spawn; Normal ones are a whole group
+    int UFOs = 0;
+    int medkits = 0;
+
+    void clear() {
+        asteroids.clear();
+        UFOs = medkits = 0;
+    }
+};
+
+// Decides what spawns each tick from the wave schedule and what is already alive.
+// Spawns that do not fit the budget wait for a later tick instead of piling up in
+// one frame. `budgetScale` stretches the caps and the spawn rate: the game raises
+// it on machines with headroom and lowers it on ones that are falling behind.
+// Everything it depends on is simulation state, so it stays deterministic.
+class SpawnDirector {
+public:
+    explicit SpawnDirector(const SpawnConfig& config) : config(config) {}
+
+    void reset() {
+        state = State();
+    }
+
+    // A Direct asteroid dropped a powerup; a medkit and the wave's UFOs follow
+    void requestDrop() {
+        ++state.pendingDrops;
+    }
+
+    void update(float deltaTime, const SpawnCounts& live, float budgetScale, Pcg32& rng, SpawnPlan& plan) {
+        plan.clear();
+        state.waveTime += deltaTime;
+        while (state.wave + 1 < config.waves.size() && state.waveTime >= config.waves[state.wave].duration) {
+            state.waveTime -= config.waves[state.wave].duration;
+            ++state.wave;
+        }
+        const SpawnWave& wave = config.waves[state.wave];
+
+        state.spawnTimer += deltaTime;
+        if (state.spawnTimer >= wave.interval / budgetScale) {
+            state.spawnTimer = 0.f;
+            state.deferred = std::min(state.deferred + 1, config.budget.maxDeferred);
+        }
+
+        int room = static_cast<int>(config.budget.maxEntities * budgetScale) - live.total;
+        int asteroidRoom = std::min(room, static_cast<int>(wave.maxAsteroids * budgetScale) - live.asteroids);
+        int groupSize = std::max(wave.group, 1);
+        while (state.deferred > 0 && static_cast<int>(plan.asteroids.size()) < config.budget.maxSpawnsPerTick && asteroidRoom >= groupSize) {
+            EnemyType type = pickType(wave, rng);
+            int size = type == EnemyType::Normal ? groupSize : 1;
+            plan.asteroids.push_back(type);
+            asteroidRoom -= size;
+            room -= size;
+            --state.deferred;
+        }
+
+        // One drop per tick, and a drop that finds no room loses its UFOs rather than waiting
+        if (state.pendingDrops > 0) {
+            --state.pendingDrops;
+            plan.medkits = room > 0 ? 1 : 0;
+            int UFORoom = std::min(room - plan.medkits, static_cast<int>(wave.maxUFOs * budgetScale) - live.UFOs);
+            plan.UFOs = std::max(std::min(wave.UFOsPerDrop, UFORoom), 0);
+        }
+    }
+
+    int getInitialAsteroids() const {
+        return config.initialAsteroids;
+    }
+
+    const SpawnWave& currentWave() const {
+        return config.waves[state.wave];
+    }
+
+    void saveState(StateWriter& writer) const {
+        writer.write(state);
+    }
+
+    void loadState(StateReader& reader) {
+        reader.read(state);
+        state.wave = std::min<size_t>(state.wave, config.waves.size() - 1);
+    }
+
+private:
+    struct State {
+        size_t wave = 0;
+        float waveTime = 0.f;
+        float spawnTimer = 0.f;
+        int deferred = 0;     // Spawns that are due but did not fit yet
+        int pendingDrops = 0;
+    };
+
+    static EnemyType pickType(const SpawnWave& wave, Pcg32& rng) {
+        int total = wave.weights[0] + wave.weights[1] + wave.weights[2];
+        int roll = static_cast<int>(rng() % static_cast<std::uint32_t>(total));
+        if (roll < wave.weights[0]) {
+            return EnemyType::Normal;
+        }
+        return roll < wave.weights[0] + wave.weights[1] ? EnemyType::Fast : EnemyType::Direct;
+    }
+
+    const SpawnConfig& config;
+    State state;
+};
+
+// Half and quarter size copies of the largest textures, written by the
+// --build-asset-tiers build step. The loader picks a tier from the size the
+// texture will be drawn at before anything is decoded, so a small display
+// never loads full-size pixels. Missing tiers fall back to the next larger one.
+namespace AssetTiers {
+    const int count = 3;
+    const char* const directories[count] = { "Materials/", "Materials/half/", "Materials/quarter/" };
+    const char* const files[] = { "mainbackground.png", "rules.png", "credits.png", "shockwave.png" };
+
+    // Width of a PNG read from its header, or 0 if the file is not a readable PNG
+    inline unsigned pngWidth(const std::string& path) {
+        std::ifstream file(path, std::ios::binary);
+        unsigned char header[24];
+        if (!file.read(reinterpret_cast<char*>(header), sizeof(header)) || std::memcmp(header + 12, "IHDR", 4) != 0) {
+            return 0;
+        }
+        return static_cast<unsigned>(header[16]) << 24 | header[17] << 16 | header[18] << 8 | header[19];
+    }
+
+    // Path to `file` in the smallest tier that keeps at least 90% of a texel per
+    // screen pixel, given how many screen pixels one full-size texel covers.
+    // `scale` is set to how many times smaller than full size that tier is.
+    inline std::string resolve(const std::string& file, float screenPixelsPerTexel, float& scale) {
+        int tier = 0;
+        while (tier + 1 < count && 1.f / (1 << (tier + 1)) >= screenPixelsPerTexel * 0.9f) {
+            ++tier;
+        }
+        for (; tier > 0; --tier) {
+            if (std::ifstream(directories[tier] + file)) {
+                break;
+            }
+        }
+        scale = static_cast<float>(1 << tier);
+        return directories[tier] + file;
+    }
+
+    // Path to `file` when it is drawn `displayedWidth` screen pixels wide
+    inline std::string resolveForWidth(const std::string& file, float displayedWidth) {
+        unsigned fullWidth = pngWidth(directories[0] + file);
+        float scale = 1.f;
+        return resolve(file, fullWidth ? displayedWidth / fullWidth : 1.f, scale);
+    }
+
+    // Halve an image with a 2x2 box filter
+    inline void downscale(const sf::Image& source, sf::Image& target) {
+        sf::Vector2u size = source.getSize();
+        unsigned width = std::max(size.x / 2, 1u);
+        unsigned height = std::max(size.y / 2, 1u);
+        const sf::Uint8* in = source.getPixelsPtr();
+        std::vector<sf::Uint8> out(width * height * 4);
+        for (unsigned y = 0; y < height; ++y) {
+            for (unsigned x = 0; x < width; ++x) {
+                unsigned x1 = std::min(x * 2 + 1, size.x - 1);
+                unsigned y1 = std::min(y * 2 + 1, size.y - 1);
+                for (unsigned channel = 0; channel < 4; ++channel) {
+                    unsigned sum = in[(y * 2 * size.x + x * 2) * 4 + channel] + in[(y * 2 * size.x + x1) * 4 + channel] +
+                        in[(y1 * size.x + x * 2) * 4 + channel] + in[(y1 * size.x + x1) * 4 + channel];
+                    out[(y * width + x) * 4 + channel] = static_cast<sf::Uint8>((sum + 2) / 4);
+                }
+            }
+        }
+        target.create(width, height, out.data());
+    }
+
+    // Build step: write every tier below full size for each tiered texture
+    inline bool build() {
+        for (const char* file : files) {
+            sf::Image image;
+            if (!image.loadFromFile(directories[0] + std::string(file))) {
+                return false;
+            }
+            for (int tier = 1; tier < count; ++tier) {
+                sf::Image smaller;
+                downscale(image, smaller);
+                std::filesystem::create_directories(directories[tier]);
+                if (!smaller.saveToFile(directories[tier] + std::string(file))) {
+                    return false;
+                }
+                std::cout << directories[tier] << file << ": " << smaller.getSize().x << "x" << smaller.getSize().y << std::endl;
+                image = smaller;
+            }
+        }
+        return true;
+    }
+}
+
+// Every asset the simulation needs. Loaded once and shared by all World instances.
+struct WorldTextures {
+    sf::Texture playerIdle;
+    sf::Texture playerThrusting;
+    sf::Texture projectile;
+    sf::Texture UFOBullet;
+    sf::Texture enemy;
+    sf::Texture enemy2;
+    sf::Texture powerUp;
+    sf::Texture explosion;
+    sf::Texture shockwave;
+    sf::Texture medkit;
+    sf::Texture UFO;
+    sf::Texture fullHeart;
+    sf::Texture halfHeart;
+    float shockwaveScale = 1.f; // How many times smaller than full size the loaded shockwave sheet is
+    std::vector<AnimationClip> animationClips; // Indexed by AnimationClipId
+    SpawnConfig spawns; // Wave schedule and spawn budget
+    TextureTable table; // What saved sprites name their texture by
+
+    // `pixelsPerUnit` is how many screen pixels one world unit covers, which picks
+    // the shockwave tier. Headless callers pass 0 to load the smallest one.
+    bool loadFromFiles(float pixelsPerUnit = 1.f) {
+        bool loaded = playerIdle.loadFromFile("Materials/spaceship-nofire.png") &&
+            playerThrusting.loadFromFile("Materials/spaceship.png") &&
+            projectile.loadFromFile("Materials/bullet.png") &&
+            UFOBullet.loadFromFile("Materials/UFOBullet.png") &&
+            enemy.loadFromFile("Materials/asteroid.png") &&
+            enemy2.loadFromFile("Materials/BOMB.png") &&
+            powerUp.loadFromFile("Materials/powerup.png") &&
+            explosion.loadFromFile("Materials/explosion.png") &&
+            shockwave.loadFromFile(AssetTiers::resolve("shockwave.png", pixelsPerUnit, shockwaveScale)) &&
+            medkit.loadFromFile("Materials/MedKit.png") &&
+            UFO.loadFromFile("Materials/UFO.png") &&
+            fullHeart.loadFromFile("Materials/full_heart.png") &&
+            halfHeart.loadFromFile("Materials/half_heart.png") &&
+            spawns.loadFromFile("Materials/waves.txt");
+        if (loaded) {
+            animationClips.clear();
+            animationClips.push_back(AnimationClip::fromSheet(explosion, 126, 138, 8, 0.05f, AnimationLoop::Once));
+            animationClips.push_back(AnimationClip::fromSheet(shockwave, 864, 864, 7, 0.075f, AnimationLoop::Once, shockwaveScale));
+            // Ids follow this order, so appending keeps old states loadable
+            table = TextureTable();
+            for (const sf::Texture* texture : { &playerIdle, &playerThrusting, &projectile, &UFOBullet, &enemy, &enemy2, &powerUp,
+                &explosion, &shockwave, &medkit, &UFO, &fullHeart, &halfHeart }) {
+                table.add(*texture);
+            }
+        }
+        return loaded;
+    }
+};
+
+// The whole simulation: entities, timers, score and health. It owns no window or
+// audio, so any number of instances can run headless (see the batch runner below).
+//
+// A world can be bigger than the screen. The camera then follows the player, and
+// the world is cut into chunks: entities in the chunks around the camera are
+// simulated, while the rest are parked in their chunk as saved state and only
+// resumed when the camera comes back. A world one screen in size never parks
+// anything and wraps at its edges as before.
+class World {
+public:
+    // `viewSize` is how much of the world the camera shows; the whole world by default
+    World(const WorldTextures& textures, const sf::Vector2u& worldSize, JobSystem& jobs, std::uint64_t seed, const sf::Vector2u& viewSize = sf::Vector2u())
+        : playerTextureIdle(textures.playerIdle), playerTextureThrusting(textures.playerThrusting), projectileTexture(textures.projectile),
+        UFOBulletTexture(textures.UFOBullet), enemyTexture(textures.enemy), enemy2Texture(textures.enemy2), powerUpTexture(textures.powerUp),
+        medkitTexture(textures.medkit), UFOtexture(textures.UFO), textureTable(textures.table),
+        worldSize(worldSize), viewSize(viewSize.x > 0 && viewSize.y > 0 ? sf::Vector2u(std::min(viewSize.x, worldSize.x), std::min(viewSize.y, worldSize.y)) : worldSize),
+        scrolling(this->viewSize != worldSize), jobs(jobs), health(textures.fullHeart, textures.halfHeart, maxHearts),
+        UFO_Bullets(textures.UFOBullet, UFOBulletCapacity), animations(textures.animationClips), poweranimations(textures.animationClips), spawnDirector(textures.spawns),
+        UFOFlowField(32.f, !scrolling) {
+        reset(seed);
+    }
+
+    // Advance the simulation by one tick. `partnerInput` drives the second ship in co-op.
+    void update(float deltaTime, const PlayerInput& input, const PlayerInput& partnerInput = PlayerInput()) {
+        events.clear();
+        worldTime += deltaTime;
+
+        if (health.getCurrentHearts() <= 0) {
+            isGameOver = true;
+        }
+
+        if (isGameOver) {
+            // Clear all game elements
+            projectiles.clear();
+            enemies.clear();
+            animations.clear();
+            return; // Skip updating the rest of the game elements
+        }
+
+        player->updateRotation(input.aim);
+        player->update(deltaTime, input.thrust);
+        if (partner) {
+            partner->updateRotation(partnerInput.aim);
+            partner->update(deltaTime, partnerInput.thrust);
+        }
+        updateCamera();
+
+        triggerShockwave(*player, input);
+        if (partner) {
+            triggerShockwave(*partner, partnerInput);
+        }
+
+        // Near entities step every tick, far ones every Nth tick with the time they skipped
+        lodScheduler.beginTick(player->getPosition(), camera);
+        buildFlowFields();
+
+        stepWithLOD(UFO_Bosses, deltaTime, [&](UFO_Boss& UFO_Boss, float step) {
+            UFO_Boss.update(UFOFlowField, step);
+        });
+
+        stepWithLOD(projectiles, deltaTime, [](Projectile& projectile, float step) {
+            projectile.update(step);
+        });
+
+        stepWithLOD(enemies, deltaTime, [&](Enemy& enemy, float step) {
+            enemy.update(directFlowField, step);
+        });
+
+        // Check for collisions and create animations
+        checkCollisions();
+
+        // Update animations
+        animations.update(deltaTime);
+        poweranimations.update(deltaTime);
+
+        // The director decides what the current wave adds this tick, within the spawn budget
+        SpawnCounts live;
+        live.asteroids = static_cast<int>(enemies.size());
+        live.UFOs = static_cast<int>(UFO_Bosses.size());
+        live.total = live.asteroids + live.UFOs + static_cast<int>(projectiles.size() + UFO_Bullets.size() + powerupvector.size() + medkitvector.size());
+        spawnDirector.update(deltaTime, live, spawnBudgetScale, spawnRng, spawnPlan);
+
+        // Spawn medkit 
+        for (int i = 0; i < spawnPlan.medkits; i++) {
+            //position at a random location on screen
+            sf::Vector2f position(camera.left + pickupRng() % viewSize.x, camera.top + pickupRng() % viewSize.y);
+			medkitvector.emplace_back(medkitTexture, position);
+		}
+
+        //Spawn UFOs
+        for (int i = 0; i < spawnPlan.UFOs; i++) {
+            spawnUFO();
+        }
+
+        // Asteroids head for the player from the screen edges
+        for (EnemyType type : spawnPlan.asteroids) {
+            sf::Vector2f position = randomViewEdgePoint();
+            sf::Vector2f playerPosition = player->getPosition();
+            sf::Vector2f directionToPlayer = playerPosition - position;
+            float length = std::sqrt(directionToPlayer.x * directionToPlayer.x + directionToPlayer.y * directionToPlayer.y);
+            directionToPlayer /= length; // Normalize the vector
+            const float offset = 50.0f; // Adjust this offset value as needed
+
+            // Normal asteroids come in a row of the wave's group size, side by side
+            int count = type == EnemyType::Normal ? std::max(spawnDirector.currentWave().group, 1) : 1;
+            for (int i = 0; i < count; i++) {
+                sf::Vector2f adjacentPosition = position;
+                adjacentPosition.x += offset * i; // Adjust this line for horizontal placement
+                enemies.emplace_back(enemyTexture, enemy2Texture, adjacentPosition, directionToPlayer, type);
+            }
+        }
+
+        // Shooting logic
+        fireFrom(*player, input, deltaTime, shootTimer, wasShooting);
+        if (partner) {
+            fireFrom(*partner, partnerInput, deltaTime, partnerShootTimer, partnerWasShooting);
+        }
+
+
+        // Every UFO runs its own behaviour script, which decides when it shoots
+        syncUFOScripts();
+        scripts.run(worldTime);
+
+        // UFO bullets are cheap enough to move every tick, near or far
+        UFO_Bullets.update(deltaTime);
+
+        for (auto& medkit : medkitvector) {
+            medkit.update(deltaTime);
+        }
+
+        for (auto& powerup : powerupvector) {
+            powerup.update(deltaTime);
+        }
+
+        // Remove everything that left the playfield or outlived its lifetime
+        despawn(projectiles, projectileDespawn);
+        UFO_Bullets.cull(sf::FloatRect(-UFOBulletDespawn.margin, -UFOBulletDespawn.margin, worldSize.x + 2.f * UFOBulletDespawn.margin,
+            worldSize.y + 2.f * UFOBulletDespawn.margin), UFOBulletDespawn.maxLifetime);
+        despawn(enemies, enemyDespawn);
+        despawn(medkitvector, pickupDespawn);
+        despawn(powerupvector, pickupDespawn);
+
+        if (scrolling) {
+            streamChunks();
+        }
+
+        // Nothing allocated from the arena this tick is used after it
+        frameArena.reset();
+    }
+
+    // Add or remove the second ship. Takes effect from the next reset.
+    void setCoop(bool enabled) {
+        coop = enabled;
+    }
+
+    // Start a new session. Timers, the player and the random sequence all start over.
+    void reset(std::uint64_t seed) {
+        spawnRng.seed(seed, 1);
+        pickupRng.seed(seed, 2);
+        score = 0;
+        isGameOver = false;
+        spawnDirector.reset();
+        shockwavecount = 1;
+        medkituse = 0;
+        wasShooting = false;
+        shootTimer = shootCooldown;
+        partnerShootTimer = shootCooldown;
+        partnerWasShooting = false;
+        events.clear();
+        worldTime = 0.f;
+        nextSweepTime = dormantSweepInterval;
+        dormantChunks.clear();
+        scripts.clear();
+        nextEntityId = 1;
+        //reset the posiiton of the player
+        player = std::make_unique<Player>(playerTextureIdle, playerTextureThrusting, sf::Vector2f(worldSize.x / 2, worldSize.y / 2), worldSize, !scrolling);
+        partner.reset();
+        if (coop) {
+            partner = std::make_unique<Player>(playerTextureIdle, playerTextureThrusting, sf::Vector2f(worldSize.x / 2 + 150.f, worldSize.y / 2), worldSize, !scrolling);
+        }
+        updateCamera();
+        health.resetHealth();
+        projectiles.clear();
+        enemies.clear();
+        animations.clear();
+        poweranimations.clear();
+        powerupvector.clear();
+        medkitvector.clear();
+        UFO_Bosses.clear();
+        UFO_Bullets.clear();
+        lodScheduler.reset();
+        spawnInitialEnemies(spawnDirector.getInitialAsteroids());
+    }
+
+    // Copy the drawable state of everything overlapping `viewBounds` into the snapshot
+    void captureSnapshot(RenderSnapshot& snapshot, const sf::FloatRect& viewBounds) const {
+        snapshot.view = viewBounds;
+        snapshot.sprites.clear();
+        snapshot.sprites.push_back(SpriteState::capture(player->getSprite()));
+        snapshot.ownShipFirst = true;
+        // The camera follows the ship, so it moves with it until it meets the edge of the world
+        snapshot.shipVelocity = player->getVelocity();
+        sf::FloatRect ahead = cameraAround(player->getPosition() + snapshot.shipVelocity);
+        snapshot.viewVelocity = sf::Vector2f(ahead.left - camera.left, ahead.top - camera.top);
+        if (partner) {
+            snapshot.sprites.push_back(SpriteState::capture(partner->getSprite()));
+        }
+        snapshot.thrusters.clear();
+        for (const Player* ship : { player.get(), partner.get() }) {
+            if (ship && ship->getThrusting()) {
+                snapshot.thrusters.push_back(thrusterFor(*ship));
+            }
+        }
+
+        // Skip anything outside the view so off-screen objects are never submitted
+        snapshot.bulletQuads.clear();
+        UFO_Bullets.capture(viewBounds, snapshot.bulletQuads);
+        snapshot.bulletTexture = &UFO_Bullets.getTexture();
+        captureVisible(projectiles, viewBounds, snapshot.sprites);
+        captureVisible(UFO_Bosses, viewBounds, snapshot.sprites);
+        captureVisible(enemies, viewBounds, snapshot.sprites);
+        captureVisible(powerupvector, viewBounds, snapshot.sprites);
+        poweranimations.capture(viewBounds, snapshot.sprites);
+        captureVisible(medkitvector, viewBounds, snapshot.sprites);
+        animations.capture(viewBounds, snapshot.sprites);
+
+        snapshot.score = score;
+        snapshot.shockwaveCount = shockwavecount;
+        snapshot.medkitsUsed = medkituse;
+        snapshot.hearts = health.getCurrentHearts();
+        snapshot.maxHearts = health.getMaxHearts();
+        snapshot.fullHeart = &health.getFullHeartTexture();
+        snapshot.halfHeart = &health.getHalfHeartTexture();
+    }
+
+    // Write the observation layout described in BhaataPhodBatch.h into `buffer`.
+    // Entities are listed nearest to the player first. Returns how many were written.
+    int observe(float* buffer) {
+        sf::Vector2f playerPosition = player->getPosition();
+        observed.clear();
+        auto collect = [&](const auto& entities, auto kindOf) {
+            for (const auto& entity : entities) {
+                sf::Vector2f position = entity.getPosition();
+                sf::Vector2f delta = position - playerPosition;
+                observed.push_back(ObservedEntity{ delta.x * delta.x + delta.y * delta.y, static_cast<float>(kindOf(entity)), position, entity.getBounds().width });
+            }
+        };
+        collect(enemies, [](const Enemy& enemy) { return BP_KIND_ASTEROID + static_cast<int>(enemy.getType()); });
+        collect(UFO_Bosses, [](const UFO_Boss&) { return BP_KIND_UFO; });
+        for (size_t i = 0; i < UFO_Bullets.size(); ++i) {
+            sf::Vector2f position = UFO_Bullets.getPosition(i);
+            sf::Vector2f delta = position - playerPosition;
+            observed.push_back(ObservedEntity{ delta.x * delta.x + delta.y * delta.y, static_cast<float>(BP_KIND_UFO_BULLET), position, UFO_Bullets.getWidth() });
+        }
+        collect(projectiles, [](const Projectile&) { return BP_KIND_PROJECTILE; });
+        collect(powerupvector, [](const Powerup&) { return BP_KIND_POWERUP; });
+        collect(medkitvector, [](const Medkit&) { return BP_KIND_MEDKIT; });
+
+        size_t count = std::min(observed.size(), static_cast<size_t>(BP_MAX_OBSERVED_ENTITIES));
+        std::partial_sort(observed.begin(), observed.begin() + count, observed.end(), [](const ObservedEntity& a, const ObservedEntity& b) {
+            return a.distanceSquared < b.distanceSquared;
+        });
+
+        buffer[0] = static_cast<float>(score);
+        buffer[1] = static_cast<float>(health.getCurrentHearts());
+        buffer[2] = static_cast<float>(shockwavecount);
+        buffer[3] = isGameOver ? 1.f : 0.f;
+        buffer[4] = playerPosition.x;
+        buffer[5] = playerPosition.y;
+        buffer[6] = player->getRotation();
+        buffer[7] = static_cast<float>(count);
+        float* slot = buffer + BP_OBSERVATION_HEADER_FLOATS;
+        for (size_t i = 0; i < BP_MAX_OBSERVED_ENTITIES; ++i, slot += BP_OBSERVATION_ENTITY_FLOATS) {
+            if (i < count) {
+                slot[0] = observed[i].kind;
+                slot[1] = observed[i].position.x;
+                slot[2] = observed[i].position.y;
+                slot[3] = observed[i].size;
+            }
+            else {
+                slot[0] = slot[1] = slot[2] = slot[3] = 0.f;
+            }
+        }
+        return static_cast<int>(count);
+    }
+
+    // Everything the co-op client draws except its own ship, which it predicts locally
+    void captureEntities(std::vector<NetEntity>& out) const {
+        out.clear();
+        auto collect = [&](const auto& entities, auto kindOf, auto variantOf) {
+            for (const auto& entity : entities) {
+                const sf::Sprite& sprite = entity.getSprite();
+                out.push_back(NetEntity{ static_cast<std::uint8_t>(kindOf(entity)), static_cast<std::uint8_t>(variantOf(entity)), sprite.getPosition(), sprite.getRotation() });
+            }
+        };
+        auto none = [](const auto&) { return 0; };
+        out.push_back(NetEntity{ NetKindShip, static_cast<std::uint8_t>(player->getThrusting()), player->getPosition(), player->getRotation() });
+        collect(enemies, [](const Enemy&) { return NetKindAsteroid; }, [](const Enemy& enemy) { return static_cast<int>(enemy.getType()); });
+        collect(UFO_Bosses, [](const UFO_Boss&) { return NetKindUFO; }, none);
+        for (size_t i = 0; i < UFO_Bullets.size(); ++i) {
+            out.push_back(NetEntity{ NetKindUFOBullet, 0, UFO_Bullets.getPosition(i), UFO_Bullets.getRotation(i) });
+        }
+        collect(projectiles, [](const Projectile&) { return NetKindProjectile; }, none);
+        collect(powerupvector, [](const Powerup&) { return NetKindPowerup; }, none);
+        collect(medkitvector, [](const Medkit&) { return NetKindMedkit; }, none);
+        for (const AnimationPool* pool : { &animations, &poweranimations }) {
+            for (size_t i = 0; i < pool->size(); ++i) {
+                const AnimationInstance& instance = (*pool)[i];
+                out.push_back(NetEntity{ static_cast<std::uint8_t>(instance.clip == ExplosionClip ? NetKindExplosion : NetKindShockwave), static_cast<std::uint8_t>(instance.frame), instance.position, 0.f });
+            }
+        }
+    }
+
+    const Player& getPlayer() const {
+        return *player;
+    }
+
+    sf::Vector2u getSize() const {
+        return worldSize;
+    }
+
+    sf::Vector2u getViewSize() const {
+        return viewSize;
+    }
+
+    // Area of the world on screen, following the player
+    const sf::FloatRect& getCamera() const {
+        return camera;
+    }
+
+    // Every container that grows with play, by name, for soak runs
+    template <typename Visit>
+    void forEachContainer(Visit&& visit) const {
+        visit("enemies", enemies.size());
+        visit("ufos", UFO_Bosses.size());
+        visit("ufo_bullets", UFO_Bullets.size());
+        visit("ufo_bullets_dropped", UFO_Bullets.droppedCount());
+        visit("projectiles", projectiles.size());
+        visit("powerups", powerupvector.size());
+        visit("medkits", medkitvector.size());
+        visit("animations", animations.size() + poweranimations.size());
+        visit("dormant", getDormantCount());
+        visit("dormant_chunks", dormantChunks.size());
+        visit("scripts", scripts.size());
+        visit("script_slabs", scriptFrames.slabCount());
+        visit("ufo_index", UFOIndex.size());
+        visit("arena_fallbacks", frameArena.heapFallbacks());
+    }
+
+    // Entities parked in chunks away from the camera
+    size_t getDormantCount() const {
+        size_t count = 0;
+        for (const auto& chunk : dormantChunks) {
+            for (std::uint32_t kindCount : chunk.second.counts) {
+                count += kindCount;
+            }
+        }
+        return count;
+    }
+
+    // Null unless co-op is on
+    const Player* getPartner() const {
+        return partner.get();
+    }
+
+    int getShockwaveCount() const {
+        return shockwavecount;
+    }
+
+    int getMedkitsUsed() const {
+        return medkituse;
+    }
+
+    int getScore() const {
+        return score;
+    }
+
+    bool isOver() const {
+        return isGameOver;
+    }
+
+    size_t getUFOBossCount() const {
+        return UFO_Bosses.size();
+    }
+
+    size_t getEnemyCount() const {
+        return enemies.size();
+    }
+
+    // Scales the spawn caps and rate, 1 being what the wave file asks for
+    void setSpawnBudgetScale(float scale) {
+        spawnBudgetScale = scale;
+    }
+
+    // Ticks between updates of far, off-screen entities
+    void setFarUpdateInterval(int interval) {
+        lodScheduler.setFarInterval(interval);
+    }
+
+    // Extra asteroids from the screen edges, for load tests
+    void spawnAsteroids(int count) {
+        spawnInitialEnemies(count);
+    }
+
+    // Extra UFOs and shockwaves, for scripted runs that need a fight on demand
+    void spawnUFOs(int count) {
+        for (int i = 0; i < count; ++i) {
+            spawnUFO();
+        }
+    }
+
+    void addShockwaves(int count) {
+        shockwavecount += count;
+    }
+
+    bool isPlayerThrusting() const {
+        return player->getThrusting();
+    }
+
+    static constexpr int maxHearts = 5;
+
+    const Health& getHealth() const {
+        return health;
+    }
+
+    const WorldEvents& getEvents() const {
+        return events;
+    }
+
+    // Serialize the whole simulation into `buffer`: entities, timers, score,
+    // health and generator state. Textures are stored by TextureTable id, so a
+    // state loads into any process that loaded the same assets.
+    void saveState(std::vector<unsigned char>& buffer) const {
+        StateWriter writer(buffer, &textureTable);
+        writer.write(spawnRng);
+        writer.write(pickupRng);
+        writer.write(lodScheduler);
+        writer.write(score);
+        writer.write(isGameOver);
+        spawnDirector.saveState(writer);
+        writer.write(shockwavecount);
+        writer.write(medkituse);
+        writer.write(wasShooting);
+        writer.write(shootTimer);
+        writer.write(nextEntityId);
+        writer.write(health.getCurrentHearts());
+        player->saveState(writer);
+        writer.write(partner != nullptr);
+        if (partner) {
+            partner->saveState(writer);
+            writer.write(partnerShootTimer);
+            writer.write(partnerWasShooting);
+        }
+        saveEntities(writer, projectiles);
+        UFO_Bullets.saveState(writer);
+        saveEntities(writer, enemies);
+        animations.saveState(writer);
+        poweranimations.saveState(writer);
+        saveEntities(writer, powerupvector);
+        saveEntities(writer, medkitvector);
+        saveEntities(writer, UFO_Bosses);
+        writer.write(worldTime);
+        writer.write(nextSweepTime);
+        writer.write(static_cast<std::uint32_t>(dormantChunks.size()));
+        for (const auto& chunk : dormantChunks) {
+            writer.write(chunk.first);
+            for (int kind = 0; kind < DormantKindCount; ++kind) {
+                writer.write(chunk.second.counts[kind]);
+                writer.write(static_cast<std::uint32_t>(chunk.second.data[kind].size()));
+                writer.writeBytes(chunk.second.data[kind].data(), chunk.second.data[kind].size());
+            }
+        }
+    }
+
+    void loadState(const std::vector<unsigned char>& buffer) {
+        StateReader reader(buffer.data(), buffer.size(), &textureTable);
+        reader.read(spawnRng);
+        reader.read(pickupRng);
+        reader.read(lodScheduler);
+        reader.read(score);
+        reader.read(isGameOver);
+        spawnDirector.loadState(reader);
+        reader.read(shockwavecount);
+        reader.read(medkituse);
+        reader.read(wasShooting);
+        reader.read(shootTimer);
+        reader.read(nextEntityId);
+        int hearts = 0;
+        reader.read(hearts);
+        health.setCurrentHearts(hearts);
+        player->loadState(reader);
+        bool hasPartner = false;
+        reader.read(hasPartner);
+        if (!hasPartner) {
+            partner.reset();
+        }
+        else {
+            if (!partner) {
+                partner = std::make_unique<Player>(playerTextureIdle, playerTextureThrusting, sf::Vector2f(), worldSize, !scrolling);
+            }
+            partner->loadState(reader);
+            reader.read(partnerShootTimer);
+            reader.read(partnerWasShooting);
+        }
+        loadEntities(reader, projectiles, [&] { return Projectile(projectileTexture, sf::Vector2f(), 0.f); });
+        UFO_Bullets.loadState(reader);
+        loadEntities(reader, enemies, [&] { return Enemy(enemyTexture, enemy2Texture, sf::Vector2f(), sf::Vector2f(), EnemyType::Normal); });
+        animations.loadState(reader);
+        poweranimations.loadState(reader);
+        loadEntities(reader, powerupvector, [&] { return Powerup(powerUpTexture, sf::Vector2f()); });
+        loadEntities(reader, medkitvector, [&] { return Medkit(medkitTexture, sf::Vector2f()); });
+        loadEntities(reader, UFO_Bosses, [&] { return UFO_Boss(sf::Vector2f(), worldSize, UFOtexture, !scrolling); });
+        reader.read(worldTime);
+        reader.read(nextSweepTime);
+        std::uint32_t chunkCount = 0;
+        reader.read(chunkCount);
+        dormantChunks.clear();
+        for (std::uint32_t i = 0; i < chunkCount && reader.isValid(); ++i) {
+            std::uint64_t key = 0;
+            reader.read(key);
+            DormantChunk& chunk = dormantChunks[key];
+            for (int kind = 0; kind < DormantKindCount; ++kind) {
+                std::uint32_t size = 0;
+                reader.read(chunk.counts[kind]);
+                reader.read(size);
+                chunk.data[kind].resize(std::min<size_t>(size, reader.remaining()));
+                reader.readBytes(chunk.data[kind].data(), size);
+            }
+        }
+        updateCamera();
+        // Scripts are rebuilt from each UFO's ScriptState on the next update
+        scripts.clear();
+        events.clear();
+    }
+
+    // FNV-1a over the gameplay state, used to check that a replay matches its recording
+    std::uint64_t checksum() const {
+        std::uint64_t hash = 14695981039346656037ULL;
+        auto mix = [&hash](const void* data, size_t size) {
+            const unsigned char* bytes = static_cast<const unsigned char*>(data);
+            for (size_t i = 0; i < size; ++i) {
+                hash = (hash ^ bytes[i]) * 1099511628211ULL;
+            }
+        };
+        auto mixPositions = [&mix](const auto& entities) {
+            size_t count = entities.size();
+            mix(&count, sizeof(count));
+            for (const auto& entity : entities) {
+                sf::Vector2f position = entity.getPosition();
+                mix(&position.x, sizeof(position.x));
+                mix(&position.y, sizeof(position.y));
+            }
+        };
+        int hearts = health.getCurrentHearts();
+        sf::Vector2f playerPosition = player->getPosition();
+        mix(&score, sizeof(score));
+        mix(&hearts, sizeof(hearts));
+        mix(&shockwavecount, sizeof(shockwavecount));
+        mix(&playerPosition.x, sizeof(playerPosition.x));
+        mix(&playerPosition.y, sizeof(playerPosition.y));
+        mixPositions(enemies);
+        mixPositions(projectiles);
+        mixPositions(UFO_Bosses);
+        size_t bulletCount = UFO_Bullets.size();
+        mix(&bulletCount, sizeof(bulletCount));
+        for (size_t i = 0; i < bulletCount; ++i) {
+            sf::Vector2f position = UFO_Bullets.getPosition(i);
+            mix(&position.x, sizeof(position.x));
+            mix(&position.y, sizeof(position.y));
+        }
+        mixPositions(powerupvector);
+        mixPositions(medkitvector);
+        // Nothing is ever parked in a one-screen world, which keeps older recordings valid
+        if (scrolling) {
+            size_t dormant = getDormantCount();
+            mix(&dormant, sizeof(dormant));
+        }
+        return hash;
+    }
+
+private:
+    // Kinds of entity a chunk can hold while dormant
+    enum DormantKind {
+        DormantEnemy,
+        DormantUFO,
+        DormantPowerup,
+        DormantMedkit,
+        DormantKindCount
+    };
+
+    struct DormantChunk {
+        std::uint32_t counts[DormantKindCount] = {};
+        std::vector<unsigned char> data[DormantKindCount]; // Packed entries, see park()
+    };
+
+    template <typename T>
+    static void saveEntities(StateWriter& writer, const std::vector<T>& entities) {
+        writer.write(static_cast<std::uint32_t>(entities.size()));
+        for (const auto& entity : entities) {
+            entity.saveState(writer);
+        }
+    }
+
+    // Resizes `entities` to the saved count, keeping existing capacity, then loads each one
+    template <typename T, typename MakeFn>
+    static void loadEntities(StateReader& reader, std::vector<T>& entities, MakeFn make) {
+        std::uint32_t count = 0;
+        reader.read(count);
+        if (entities.size() > count) {
+            entities.erase(entities.begin() + count, entities.end());
+        }
+        while (entities.size() < count) {
+            entities.push_back(make());
+        }
+        for (auto& entity : entities) {
+            entity.loadState(reader);
+        }
+    }
+
+    void spawnExplosion(const sf::Vector2f& position) {
+        animations.play(ExplosionClip, position);
+        events.effects.push_back(EffectEvent{ ParticlePreset::ExplosionBurst, position, 0.f });
+        events.effects.push_back(EffectEvent{ ParticlePreset::Debris, position, 0.f });
+    }
+
+    void triggerShockwave(const Player& ship, const PlayerInput& input) {
+        if (input.shockwave && shockwavecount > 0) {
+            poweranimations.play(ShockwaveClip, ship.getPosition());
+            events.effects.push_back(EffectEvent{ ParticlePreset::ShockwaveRing, ship.getPosition(), 0.f });
+            events.shockwave = true;
+            shockwavecount--;
+        }
+    }
+
+    // Fire one projectile from `ship` toward its aim point when the trigger is freshly pressed
+    void fireFrom(const Player& ship, const PlayerInput& input, float deltaTime, float& timer, bool& triggerHeld) {
+        bool isShooting = input.fire;
+
+        timer += deltaTime;
+
+        if (timer < shootCooldown) {
+            // Shooting on cooldown, do nothing
+            triggerHeld = true;
+        }
+        else if (isShooting && !triggerHeld) {
+            sf::Vector2f playerPosition = ship.getPosition();
+            sf::Vector2f direction = input.aim - playerPosition;
+            float angle = std::atan2(direction.y, direction.x) * 180 / 3.14159265 + 90; // Convert to degrees and adjust
+            projectiles.emplace_back(projectileTexture, playerPosition, angle);
+            timer = 0.f;
+            events.shot = true;
+        }
+
+        if (!isShooting) {
+            triggerHeld = false;
+        }
+    }
+
+    friend struct Script::promise_type;
+
+    ScriptFramePool& getScriptFrames() {
+        return scriptFrames;
+    }
+
+    enum UFOStep : std::uint8_t {
+        UFOApproach, // Waiting for a ship to come in range
+        UFOFire,     // A volley of shots, counted in ScriptState::counter
+        UFORest      // Cooling down after a volley
+    };
+
+    // Start a script for every UFO that has none: new ones, ones back from a
+    // dormant chunk and all of them after a load. Also indexes the UFOs by id for
+    // the scripts to find them this tick.
+    void syncUFOScripts() {
+        UFOIndex.clear();
+        UFOIndex.reserve(UFO_Bosses.capacity()); // Only grows when UFO_Bosses itself has
+        for (size_t i = 0; i < UFO_Bosses.size(); ++i) {
+            UFOIndex.emplace_back(UFO_Bosses[i].id, static_cast<std::uint32_t>(i));
+        }
+        // Already in id order unless UFOs came back from a chunk or a load
+        if (!std::is_sorted(UFOIndex.begin(), UFOIndex.end())) {
+            std::sort(UFOIndex.begin(), UFOIndex.end());
+        }
+        for (const auto& UFO_Boss : UFO_Bosses) {
+            if (!scripts.has(UFO_Boss.id)) {
+                scripts.start(UFO_Boss.id, UFOBehaviour(UFO_Boss.id));
+            }
+        }
+    }
+
+    // Null once the UFO has been destroyed or parked, which ends its script
+    UFO_Boss* findUFO(std::uint32_t id) {
+        auto found = std::lower_bound(UFOIndex.begin(), UFOIndex.end(), std::make_pair(id, std::uint32_t(0)));
+        return found != UFOIndex.end() && found->first == id ? &UFO_Bosses[found->second] : nullptr;
+    }
+
+    bool playerInRange(const UFO_Boss& UFO_Boss) const {
+        sf::Vector2f delta = player->getPosition() - UFO_Boss.getPosition();
+        return delta.x * delta.x + delta.y * delta.y < UFOFireRange * UFOFireRange;
+    }
+
+    // Each UFO keeps one pattern for its life, picked by its id
+    static const BulletPattern& patternFor(std::uint32_t id) {
+        static const BulletPattern patterns[] = {
+            { BulletPatternKind::AimedBurst, 3, 0.f, 700.f, 0.f, 0.f, 0.f, 3, 0.8f },
+            { BulletPatternKind::Spread, 5, 50.f, 480.f, 60.f, 0.f, 0.f, 3, 0.6f },
+            { BulletPatternKind::Ring, 16, 0.f, 220.f, 260.f, 0.f, 11.25f, 2, 0.7f },
+            { BulletPatternKind::Spiral, 3, 0.f, 300.f, 80.f, 25.f, 14.f, 14, 0.1f }
+        };
+        return patterns[id % (sizeof(patterns) / sizeof(patterns[0]))];
+    }
+
+    void fireAtPlayer(const UFO_Boss& UFO_Boss, int shot) {
+        UFO_Bullets.emit(patternFor(UFO_Boss.id), UFO_Boss.getPosition(), getAngle(UFO_Boss.getPosition(), player->getPosition()), shot);
+    }
+
+    // UFO behaviour: once the player is in range, fire a volley of the UFO's
+    // bullet pattern, rest, and start over. Every suspension ends a step
+    // and the UFO is looked up again after each one, since the vector may have moved it.
+    Script UFOBehaviour(std::uint32_t id) {
+        UFO_Boss* self = findUFO(id);
+        // A rebuilt script first finishes the wait it was saved in
+        if (self && self->script.wakeTime > worldTime) {
+            co_await scripts.sleepUntil(self->script.wakeTime);
+        }
+        while ((self = findUFO(id))) {
+            ScriptState& state = self->script;
+            switch (state.step) {
+            case UFOApproach:
+                co_await scripts.until([this, id] {
+                    UFO_Boss* UFO = findUFO(id);
+                    return !UFO || playerInRange(*UFO);
+                });
+                if ((self = findUFO(id))) {
+                    self->script.step = UFOFire;
+                    self->script.counter = 0;
+                }
+                break;
+            case UFOFire: {
+                const BulletPattern& pattern = patternFor(id);
+                fireAtPlayer(*self, state.counter);
+                if (++state.counter >= pattern.shots) {
+                    state.step = UFORest;
+                }
+                co_await scripts.wait(state, pattern.interval);
+                break;
+            }
+            default:
+                state.step = UFOApproach;
+                co_await scripts.wait(state, UFORestTime);
+                break;
+            }
+        }
+    }
+
+    // A random point on the edge of the camera view, which in a one-screen world is the world edge
+    sf::Vector2f randomViewEdgePoint() {
+        switch (spawnRng() % 4) {
+        case 0: // Left edge
+            return sf::Vector2f(camera.left, camera.top + spawnRng() % viewSize.y);
+        case 1: // Right edge
+            return sf::Vector2f(camera.left + camera.width, camera.top + spawnRng() % viewSize.y);
+        case 2: // Top edge
+            return sf::Vector2f(camera.left + spawnRng() % viewSize.x, camera.top);
+        default: // Bottom edge
+            return sf::Vector2f(camera.left + spawnRng() % viewSize.x, camera.top + camera.height);
+        }
+    }
+
+    // Centre the view on the player, stopping at the edges of the world
+    void updateCamera() {
+        camera = cameraAround(player->getPosition());
+    }
+
+    sf::FloatRect cameraAround(const sf::Vector2f& center) const {
+        return sf::FloatRect(std::min(std::max(center.x - viewSize.x / 2.f, 0.f), static_cast<float>(worldSize.x - viewSize.x)),
+            std::min(std::max(center.y - viewSize.y / 2.f, 0.f), static_cast<float>(worldSize.y - viewSize.y)),
+            static_cast<float>(viewSize.x), static_cast<float>(viewSize.y));
+    }
+
+    // The camera plus a margin, clipped to the world. Homing fields and the
+    // collision grid cover this much and no more.
+    sf::FloatRect activeArea() const {
+        float left = std::max(camera.left - streamMargin, 0.f);
+        float top = std::max(camera.top - streamMargin, 0.f);
+        float right = std::min(camera.left + camera.width + streamMargin, static_cast<float>(worldSize.x));
+        float bottom = std::min(camera.top + camera.height + streamMargin, static_cast<float>(worldSize.y));
+        return sf::FloatRect(left, top, right - left, bottom - top);
+    }
+
+    // Chunk a point falls in. Points off the world count as being in the nearest chunk.
+    sf::Vector2i chunkOf(const sf::Vector2f& position) const {
+        int cols = static_cast<int>(std::ceil(worldSize.x / chunkSize));
+        int rows = static_cast<int>(std::ceil(worldSize.y / chunkSize));
+        return sf::Vector2i(std::min(std::max(static_cast<int>(std::floor(position.x / chunkSize)), 0), cols - 1),
+            std::min(std::max(static_cast<int>(std::floor(position.y / chunkSize)), 0), rows - 1));
+    }
+
+    // Chunks the active area touches, grown by `border` chunks on every side
+    sf::IntRect chunkRange(int border) const {
+        sf::FloatRect area = activeArea();
+        sf::Vector2i first = chunkOf(sf::Vector2f(area.left, area.top));
+        sf::Vector2i last = chunkOf(sf::Vector2f(area.left + area.width, area.top + area.height));
+        return sf::IntRect(first.x - border, first.y - border, last.x - first.x + 1 + 2 * border, last.y - first.y + 1 + 2 * border);
+    }
+
+    static std::uint64_t chunkKey(const sf::Vector2i& chunk) {
+        return static_cast<std::uint64_t>(static_cast<std::uint32_t>(chunk.y)) << 32 | static_cast<std::uint32_t>(chunk.x);
+    }
+
+    // Resume every dormant chunk the active area reaches, then park whatever has
+    // drifted more than a chunk beyond it. Only the chunks around the camera are
+    // looked up, so the cost follows the view rather than the size of the world.
+    void streamChunks() {
+        sf::IntRect active = chunkRange(0);
+        for (int y = active.top; y < active.top + active.height; ++y) {
+            for (int x = active.left; x < active.left + active.width; ++x) {
+                auto found = dormantChunks.find(chunkKey(sf::Vector2i(x, y)));
+                if (found == dormantChunks.end()) {
+                    continue;
+                }
+                DormantChunk& chunk = found->second;
+                resume(chunk, DormantEnemy, enemies, [&] { return Enemy(enemyTexture, enemy2Texture, sf::Vector2f(), sf::Vector2f(), EnemyType::Normal); });
+                resume(chunk, DormantUFO, UFO_Bosses, [&] { return UFO_Boss(sf::Vector2f(), worldSize, UFOtexture, false); });
+                resume(chunk, DormantPowerup, powerupvector, [&] { return Powerup(powerUpTexture, sf::Vector2f()); });
+                resume(chunk, DormantMedkit, medkitvector, [&] { return Medkit(medkitTexture, sf::Vector2f()); });
+                dormantChunks.erase(found);
+            }
+        }
+
+        // The one chunk of slack stops entities on a chunk border from flipping every tick
+        sf::IntRect keep = chunkRange(1);
+        const float forever = std::numeric_limits<float>::infinity();
+        park(enemies, DormantEnemy, keep, [&](const Enemy& enemy) { return enemyDespawn.maxLifetime - enemy.getAge(); });
+        park(UFO_Bosses, DormantUFO, keep, [&](const UFO_Boss&) { return forever; });
+        park(powerupvector, DormantPowerup, keep, [&](const Powerup& powerup) { return pickupDespawn.maxLifetime - powerup.getAge(); });
+        park(medkitvector, DormantMedkit, keep, [&](const Medkit& medkit) { return pickupDespawn.maxLifetime - medkit.getAge(); });
+
+        // Shots are short-lived, so the ones that leave are dropped rather than parked
+        auto outOfRange = [&](const auto& shot) {
+            return !keep.contains(chunkOf(shot.getPosition()));
+        };
+        projectiles.erase(std::remove_if(projectiles.begin(), projectiles.end(), outOfRange), projectiles.end());
+        UFO_Bullets.removeIf([&](const sf::Vector2f& position) { return !keep.contains(chunkOf(position)); });
+
+        if (worldTime >= nextSweepTime) {
+            sweepDormantChunks();
+            nextSweepTime = worldTime + dormantSweepInterval;
+        }
+    }
+
+    // Move every entity outside `keep` into its chunk. Each is stored as the world
+    // time it would have despawned at, its size, then its saveState bytes.
+    template <typename T, typename LifetimeFn>
+    void park(std::vector<T>& entities, DormantKind kind, const sf::IntRect& keep, LifetimeFn lifetimeLeft) {
+        size_t write = 0;
+        for (size_t read = 0; read < entities.size(); ++read) {
+            sf::Vector2i chunkPosition = chunkOf(entities[read].getPosition());
+            if (keep.contains(chunkPosition)) {
+                if (write != read) {
+                    entities[write] = std::move(entities[read]);
+                }
+                ++write;
+                continue;
+            }
+            StateWriter writer(parkBuffer, &textureTable);
+            entities[read].saveState(writer);
+            DormantChunk& chunk = dormantChunks[chunkKey(chunkPosition)];
+            StateWriter header(headerBuffer);
+            header.write(worldTime + lifetimeLeft(entities[read]));
+            header.write(static_cast<std::uint32_t>(parkBuffer.size()));
+            chunk.data[kind].insert(chunk.data[kind].end(), headerBuffer.begin(), headerBuffer.end());
+            chunk.data[kind].insert(chunk.data[kind].end(), parkBuffer.begin(), parkBuffer.end());
+            ++chunk.counts[kind];
+        }
+        entities.erase(entities.begin() + write, entities.end());
+    }
+
+    // Bring a chunk's entities of one kind back into the simulation, minus any that
+    // expired while parked. They pick up where they were left.
+    template <typename T, typename MakeFn>
+    void resume(DormantChunk& chunk, DormantKind kind, std::vector<T>& entities, MakeFn make) {
+        const std::vector<unsigned char>& data = chunk.data[kind];
+        StateReader reader(data.data(), data.size());
+        for (std::uint32_t i = 0; i < chunk.counts[kind] && reader.isValid(); ++i) {
+            float expiresAt = 0.f;
+            std::uint32_t size = 0;
+            reader.read(expiresAt);
+            reader.read(size);
+            if (expiresAt > worldTime && size <= reader.remaining()) {
+                StateReader entityReader(reader.cursor(), size, &textureTable);
+                entities.push_back(make());
+                entities.back().loadState(entityReader);
+            }
+            reader.skip(size);
+        }
+    }
+
+    // Now and then, drop the parked entities that have expired so chunks the camera
+    // never returns to do not keep growing
+    void sweepDormantChunks() {
+        for (auto found = dormantChunks.begin(); found != dormantChunks.end();) {
+            DormantChunk& chunk = found->second;
+            bool empty = true;
+            for (int kind = 0; kind < DormantKindCount; ++kind) {
+                std::vector<unsigned char>& data = chunk.data[kind];
+                size_t write = 0;
+                size_t read = 0;
+                std::uint32_t kept = 0;
+                for (std::uint32_t i = 0; i < chunk.counts[kind]; ++i) {
+                    float expiresAt = 0.f;
+                    std::uint32_t size = 0;
+                    if (read + sizeof(expiresAt) + sizeof(size) > data.size()) {
+                        break;
+                    }
+                    std::memcpy(&expiresAt, data.data() + read, sizeof(expiresAt));
+                    std::memcpy(&size, data.data() + read + sizeof(expiresAt), sizeof(size));
+                    size_t entrySize = sizeof(expiresAt) + sizeof(size) + size;
+                    if (read + entrySize > data.size()) {
+                        break;
+                    }
+                    if (expiresAt > worldTime) {
+                        std::memmove(data.data() + write, data.data() + read, entrySize);
+                        write += entrySize;
+                        ++kept;
+                    }
+                    read += entrySize;
+                }
+                data.resize(write);
+                chunk.counts[kind] = kept;
+                empty = empty && kept == 0;
+            }
+            found = empty ? dormantChunks.erase(found) : std::next(found);
+        }
+    }
+
+    void spawnUFO() {
+        //random possibility of spawning at the frame boundaries
+        sf::Vector2f position = randomViewEdgePoint();
+
+        UFO_Boss& newUFO = UFO_Bosses.emplace_back(position, worldSize, UFOtexture, !scrolling);
+        newUFO.id = nextEntityId++;
+    }
+
+    void spawnInitialEnemies(int count) {
+        for (int i = 0; i < count; ++i) {
+            sf::Vector2f position = randomViewEdgePoint();
+
+            float angle = static_cast<float>(spawnRng() % 360);
+            sf::Vector2f directionToPlayer(std::cos(angle * 3.14159265 / 180), std::sin(angle * 3.14159265 / 180));
+
+            enemies.emplace_back(enemyTexture, enemy2Texture, position, directionToPlayer, EnemyType::Normal);
+        }
+    }
+
+    // Rebuild the homing fields, skipping any that nothing will sample this tick
+    void buildFlowFields() {
+        bool hasDirectEnemies = std::any_of(enemies.begin(), enemies.end(), [](const Enemy& enemy) {
+            return enemy.getType() == EnemyType::Direct;
+        });
+        if (hasDirectEnemies) {
+            directFlowField.build(player->getPosition(), activeArea());
+        }
+
+        if (!UFO_Bosses.empty()) {
+            std::pmr::vector<sf::Vector2f> bossPositions(&frameArena);
+            bossPositions.reserve(UFO_Bosses.size());
+            for (const auto& UFO_Boss : UFO_Bosses) {
+                bossPositions.push_back(UFO_Boss.getPosition());
+            }
+            UFOFlowField.build(player->getPosition(), activeArea(), bossPositions);
+        }
+    }
+
+    // Entity updates only touch their own entity, so the range is split across the job system
+    template <typename T, typename StepFn>
+    void stepWithLOD(std::vector<T>& entities, float deltaTime, StepFn step) {
+        for (auto& entity : entities) {
+            lodScheduler.assignPhase(entity.lod);
+        }
+        jobs.parallelFor(entities.size(), 256, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                float entityDeltaTime = lodScheduler.schedule(entities[i].lod, entities[i].getBounds(), deltaTime);
+                if (entityDeltaTime > 0.f) {
+                    step(entities[i], entityDeltaTime);
+                }
+            }
+        });
+    }
+
+    // Stable removal of every element whose flag is set
+    template <typename T>
+    static void eraseFlagged(std::vector<T>& items, const std::vector<char>& flagged) {
+        size_t write = 0;
+        for (size_t read = 0; read < items.size(); ++read) {
+            if (!flagged[read]) {
+                if (write != read) {
+                    items[write] = std::move(items[read]);
+                }
+                ++write;
+            }
+        }
+        items.erase(items.begin() + write, items.end());
+    }
+
+    // Projectile vs enemy hits. Candidate pairs are found in parallel through the
+    // grid, then resolved serially in projectile order taking the lowest-index
+    // surviving enemy, which gives the same result as the plain nested loop.
+    void checkProjectileEnemyCollisions() {
+        enemyBounds.resize(enemies.size());
+        jobs.parallelFor(enemies.size(), 512, [&](size_t begin, size_t end) {
+            for (size_t j = begin; j < end; ++j) {
+                enemyBounds[j] = enemies[j].getBounds();
+            }
+        });
+        enemyGrid.build(enemyBounds, activeArea());
+
+        projectileHits.resize(projectiles.size());
+        jobs.parallelFor(projectiles.size(), 64, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                std::vector<std::uint32_t>& hits = projectileHits[i];
+                hits.clear();
+                const Projectile& projectile = projectiles[i];
+                sf::FloatRect projectileBounds = projectile.getBounds();
+                sf::Vector2f halfSize(projectileBounds.width / 2.f, projectileBounds.height / 2.f);
+                enemyGrid.query(sweptBounds(projectileBounds, projectile.getPreviousPosition(), projectile.getPosition()), hits);
+                std::sort(hits.begin(), hits.end());
+                hits.erase(std::unique(hits.begin(), hits.end()), hits.end());
+                // Far enemies did not move this tick, so they are only tested when stepped
+                auto impact = [&](std::uint32_t j) {
+                    return sweepBox(projectile.getPreviousPosition(), projectile.getPosition(), halfSize, enemyBounds[j]);
+                };
+                hits.erase(std::remove_if(hits.begin(), hits.end(), [&](std::uint32_t j) {
+                    return !enemies[j].lod.active || impact(j) < 0.f;
+                }), hits.end());
+                // The first asteroid along the path takes the hit. Ties go to the
+                // lower index, as a stable sort would, without its heap buffer.
+                std::sort(hits.begin(), hits.end(), [&](std::uint32_t a, std::uint32_t b) {
+                    float impactA = impact(a);
+                    float impactB = impact(b);
+                    return impactA != impactB ? impactA < impactB : a < b;
+                });
+            }
+        });
+
+        projectileRemoved.assign(projectiles.size(), 0);
+        enemyRemoved.assign(enemies.size(), 0);
+        for (size_t i = 0; i < projectiles.size(); ++i) {
+            for (std::uint32_t j : projectileHits[i]) {
+                if (enemyRemoved[j]) continue;
+                // Create explosion animation
+                //score according to enemy type
+                if (enemies[j].getType() == EnemyType::Normal) {
+                    score += 20;
+                }
+                else if (enemies[j].getType() == EnemyType::Fast) {
+                    score += 40;
+                }
+                else if (enemies[j].getType() == EnemyType::Direct) {
+                    score += 80;
+                    if (pickupRng() % 100 < 10) {
+                        //spawn a powerup
+                        spawnDirector.requestDrop();
+                        sf::Vector2f position = enemies[j].getPosition();
+                        powerupvector.emplace_back(powerUpTexture, position);
+                    }
+                }
+                events.explosion = true;
+                spawnExplosion(enemies[j].getPosition());
+
+                // Remove projectile and enemy
+                projectileRemoved[i] = 1;
+                enemyRemoved[j] = 1;
+                break;
+            }
+        }
+        eraseFlagged(projectiles, projectileRemoved);
+        eraseFlagged(enemies, enemyRemoved);
+    }
+
+    bool isOutsidePlayfield(const sf::Vector2f& position, float margin) const {
+        sf::Vector2u size = worldSize;
+        return position.x < -margin || position.x > size.x + margin || position.y < -margin || position.y > size.y + margin;
+    }
+
+    template <typename T>
+    void despawn(std::vector<T>& entities, const DespawnRule& rule) {
+        entities.erase(std::remove_if(entities.begin(), entities.end(), [&](const T& entity) {
+            return entity.getAge() > rule.maxLifetime || isOutsidePlayfield(entity.getPosition(), rule.margin);
+        }), entities.end());
+    }
+
+    // Capture only the entities whose bounds overlap the view
+    template <typename T>
+    static void captureVisible(const std::vector<T>& entities, const sf::FloatRect& viewBounds, std::vector<SpriteState>& sprites) {
+        for (const auto& entity : entities) {
+            if (viewBounds.intersects(entity.getBounds())) {
+                sprites.push_back(SpriteState::capture(entity.getSprite()));
+            }
+        }
+    }
+
+    // Whether a bullet's path since the last update crossed `target`
+    template <typename T>
+    static bool sweptHit(const T& bullet, const sf::FloatRect& target) {
+        sf::FloatRect bounds = bullet.getBounds();
+        return sweepBox(bullet.getPreviousPosition(), bullet.getPosition(), sf::Vector2f(bounds.width / 2.f, bounds.height / 2.f), target) >= 0.f;
+    }
+
+    void checkCollisions() {
+        // Check for collisions between projectiles and enemies
+        checkProjectileEnemyCollisions();
+
+        // Check for collision between shockwave and UFO_Bosses
+        for (size_t i = 0; i < poweranimations.size(); ++i) {
+            for (size_t j = 0; j < UFO_Bosses.size(); ++j) {
+                if (poweranimations.getBounds(i).intersects(UFO_Bosses[j].getBounds())) {
+					// Create explosion animation
+					score += 100;
+					events.explosion = true;
+					spawnExplosion(UFO_Bosses[j].getPosition());
+
+					// Remove projectile and UFO_Boss
+					poweranimations.erase(i);
+					UFO_Bosses.erase(UFO_Bosses.begin() + j);
+					--i;
+					break;
+				}
+			}
+		}
+
+
+        // Check for collisions between projectiles and UFO_Bosses
+        for (size_t i = 0; i < projectiles.size(); ++i) {
+            for (size_t j = 0; j < UFO_Bosses.size(); ++j) {
+                if (sweptHit(projectiles[i], UFO_Bosses[j].getBounds())) {
+					// Create explosion animation
+					score += 100;
+					events.explosion = true;
+					spawnExplosion(UFO_Bosses[j].getPosition());
+
+					// Remove projectile and UFO_Boss
+					projectiles.erase(projectiles.begin() + i);
+					UFO_Bosses.erase(UFO_Bosses.begin() + j);
+
+					--i;
+					break;
+				}
+			}
+		}
+
+
+        // Both ships share one health bar and the pickups either of them collects
+        for (Player* ship : { player.get(), partner.get() }) {
+            if (!ship) {
+                continue;
+            }
+
+            // Check for collisions between player and enemies
+            for (size_t i = 0; i < enemies.size(); ++i) {
+                if (enemies[i].lod.tier == LODTier::Far) continue; // Too far away to reach the player
+                if (ship->getBounds().intersects(enemies[i].getBounds())) {
+                    // Create collision animation
+                    events.explosion = true;
+                    spawnExplosion(ship->getPosition());
+                
+
+                    // Handle player damage
+                    health.takeDamage(1); // Each collision takes half a heart (1 unit)
+
+                    // Remove enemy
+                    enemies.erase(enemies.begin() + i);
+
+                    --i;
+                    break;
+                }
+            }
+
+            //check for collision between player and UFO_Boss
+            for (size_t i = 0; i < UFO_Bosses.size(); ++i) {
+                if (ship->getBounds().intersects(UFO_Bosses[i].getBounds())) {
+    				// Create collision animation
+    				events.explosion = true;
+    				spawnExplosion(ship->getPosition());
+
+    				// Handle player damage
+    				health.takeDamage(4); // Each collision takes half a heart (1 unit)
+
+    				// Remove UFO_Boss
+    				UFO_Bosses.erase(UFO_Bosses.begin() + i);
+    				--i;
+    				break;
+    			}
+    		}
+
+            //check for collision between player and UFO_Bullet
+            int bulletHit = UFO_Bullets.findSweptHit(ship->getBounds());
+            if (bulletHit >= 0) {
+    			// Create collision animation
+    			events.explosion = true;
+    			spawnExplosion(ship->getPosition());
+
+    			// Handle player damage
+    			health.takeDamage(1); // Each collision takes half a heart (1 unit)
+
+    			// Remove UFO_Bullet
+    			UFO_Bullets.erase(bulletHit);
+    		}
+
+            //check for collision between player and powerupsprite
+            for (size_t i = 0; i < powerupvector.size(); ++i) {
+                if (ship->getBounds().intersects(powerupvector[i].getBounds())) {
+                    shockwavecount++;
+    				// Remove powerup
+    				powerupvector.erase(powerupvector.begin() + i);
+    				--i;
+    				break;
+    			}
+    		}
+
+            //check for collision between player and medkit
+            for (size_t i = 0; i < medkitvector.size(); ++i) {
+                if (ship->getBounds().intersects(medkitvector[i].getBounds())) {
+    				health.takeDamage(-2); // Each medkit heals 1 unit
+    				medkituse++;
+    				// Remove medkit
+    				medkitvector.erase(medkitvector.begin() + i);
+    				--i;
+    				break;
+    			}
+    		}
+        }
+
+        //check for collision between powerup global bounds and enemy global bounds
+        for (size_t i = 0; i < poweranimations.size(); ++i) {
+            for (size_t j = 0; j < enemies.size(); ++j) {
+                //intersection of enemies and powerup
+                if (poweranimations.getBounds(i).intersects(enemies[j].getBounds())) {
+					// Create explosion animation
+					//score according to enemy type
+                    if (enemies[j].getType() == EnemyType::Normal) {
+						score += 20;
+					}
+                    else if (enemies[j].getType() == EnemyType::Fast) {
+						score += 40;
+					}
+                    else if (enemies[j].getType() == EnemyType::Direct) {
+						score += 80;
+					}
+					events.explosion = true;
+					spawnExplosion(enemies[j].getPosition());
+
+					// Remove projectile and enemy
+					enemies.erase(enemies.begin() + j);
+					--i;
+					break;
+				
+                }
+            }
+        }
+
+    }
+
+    struct ObservedEntity {
+        float distanceSquared;
+        float kind;
+        sf::Vector2f position;
+        float size;
+    };
+
+    const sf::Texture& playerTextureIdle;
+    const sf::Texture& playerTextureThrusting;
+    const sf::Texture& projectileTexture;
+    const sf::Texture& UFOBulletTexture;
+    const sf::Texture& enemyTexture;
+    const sf::Texture& enemy2Texture;
+    const sf::Texture& powerUpTexture;
+    const sf::Texture& medkitTexture;
+    const sf::Texture& UFOtexture;
+    const TextureTable& textureTable;
+    sf::Vector2u worldSize;
+    sf::Vector2u viewSize;
+    bool scrolling; // Bigger than the view, so the camera moves and chunks stream
+    JobSystem& jobs;
+    Pcg32 spawnRng;  // Spawn edges, enemy types and headings
+    Pcg32 pickupRng; // Medkit placement and powerup drops
+    WorldEvents events;
+
+    std::unique_ptr<Player> player;
+    std::unique_ptr<Player> partner; // Second ship in co-op, null otherwise
+    bool coop = false;
+    Health health;
+    std::vector<Projectile> projectiles;
+    static constexpr size_t UFOBulletCapacity = 20000;
+    BulletPool UFO_Bullets;
+    std::vector<Enemy> enemies;
+    AnimationPool animations, poweranimations;
+    std::vector<Powerup> powerupvector;
+    std::vector<Medkit> medkitvector;
+    std::vector<UFO_Boss> UFO_Bosses;
+    int score = 0;
+    bool isGameOver = false;
+    int shockwavecount = 1;
+    int medkituse = 0;
+    bool wasShooting = false;
+
+    // Asteroid waves, UFO drops and the budget they spawn within
+    SpawnDirector spawnDirector;
+    SpawnPlan spawnPlan;
+    float spawnBudgetScale = 1.f;
+
+    // Gameplay timers
+    const float shootCooldown = 0.2f; // Adjust as needed for your game
+    float shootTimer = shootCooldown;
+    float partnerShootTimer = shootCooldown;
+    bool partnerWasShooting = false;
+
+    // Despawn margins (pixels outside the screen) and lifetimes (seconds)
+    DespawnRule projectileDespawn{ 0.f, 5.f };
+    DespawnRule UFOBulletDespawn{ 0.f, 5.f };
+    DespawnRule enemyDespawn{ 150.f, 60.f };
+    DespawnRule pickupDespawn{ 0.f, 30.f };
+
+    // Entities beyond this radius and off screen update every 4th tick
+    LODScheduler lodScheduler{ 1200.f, 4 };
+
+    // Camera and chunk streaming. Everything within streamMargin pixels of the
+    // camera is simulated; dormant chunks are kept only where something is parked.
+    sf::FloatRect camera;
+    float worldTime = 0.f; // Seconds since the reset, which parked entities expire against
+    const float chunkSize = 1024.f;
+    const float streamMargin = 512.f;
+    const float dormantSweepInterval = 10.f;
+    float nextSweepTime = dormantSweepInterval;
+    std::map<std::uint64_t, DormantChunk> dormantChunks;
+
+    // Behaviour scripts. The pool is declared first so it outlives the frames the scheduler frees.
+    ScriptFramePool scriptFrames;
+    ScriptScheduler scripts;
+    std::vector<std::pair<std::uint32_t, std::uint32_t>> UFOIndex; // (UFO id, index) sorted by id, rebuilt every tick
+    std::uint32_t nextEntityId = 1;
+    const float UFORestTime = 1.6f;
+    const float UFOFireRange = 1000.f;
+
+    // Direct asteroids fly straight at the player; UFOs wrap, unless the world scrolls, and keep apart from each other
+    FlowField directFlowField{ 32.f, false };
+    FlowField UFOFlowField;
+
+    // Scratch buffers reused across ticks, and the arena for scratch that lasts one tick
+    FrameArena frameArena{ 16 * 1024 };
+    SpatialGrid enemyGrid{ 128.f };
+    std::vector<sf::FloatRect> enemyBounds;
+    std::vector<std::vector<std::uint32_t>> projectileHits;
+    std::vector<char> projectileRemoved, enemyRemoved;
+    std::vector<ObservedEntity> observed;
+    std::vector<unsigned char> parkBuffer, headerBuffer;
+};
+
+// Co-op wire format. Values go out in host byte order, as StateWriter copies them,
+// so both ends have to share an endianness, like the input log:
+//   input  u32 magic, u8 1, u32 newest state tick received, u32 newest input sequence,
+//          u8 count, then count x (i16 aim x, i16 aim y, u8 InputLog flags), oldest first
+//   state  u32 magic, u8 2, u32 tick, u32 baseline tick (noBaseline for a full state),
+//          u32 last partner input applied, u32 raw size, u8 fragment, u8 fragment count,
+//          then this fragment's share of the raw state or of a DeltaCodec delta against
+//          the baseline. Every fragment but the last carries maxDatagram - stateHeaderSize bytes.
+// A raw state is
+//   i32 score, i8 hearts, u8 shockwaves, u8 medkits used, u8 flags, u16 world width, u16 world height,
+//   f32 partner x, y, velocity x, velocity y, u8 partner thrusting, u16 slot count,
+// then one array per field across all slots: kind (emptySlot if unused), variant, angle,
+// then per slot u16 anchor x, u16 anchor y, i16 velocity x, i16 velocity y.
+// An entity keeps its slot while it lives, and its position is predicted from the
+// anchor and velocity (see predictPosition), so a steady mover sends nothing new
+// until the prediction drifts, and then one run of 8 bytes. Fields that rarely change
+// sit next to each other, so a delta skips them in long runs.
+namespace NetProtocol {
+    const std::uint32_t magic = 0x32504242; // "BBP2"
+    const std::uint8_t inputMessage = 1;
+    const std::uint8_t stateMessage = 2;
+    const std::uint32_t noBaseline = 0xffffffff;
+    const size_t inputRedundancy = 8; // Inputs repeated per message, so a lost packet costs nothing
+    const std::uint32_t stateInterval = 3; // Ticks between state messages, 20 per second at 60 Hz
+    const size_t stateHistory = 32; // States kept on both ends as delta baselines
+    const std::uint32_t partnerTimeout = 180; // Ticks of silence before another address may take the partner ship
+    const float tickSeconds = 1.f / 60.f;
+    const float positionMargin = 256.f; // Entities this far outside the world still quantize
+    const size_t maxEntities = 8192; // Slots a state can carry
+    const std::uint8_t emptySlot = 0xff;
+    const size_t maxDatagram = 1200; // Below a typical MTU, so IP never fragments a state
+    const size_t stateHeaderSize = 4 + 1 + 4 + 4 + 4 + 4 + 1 + 1;
+    const size_t maxFragments = 255;
+    const float predictionTolerance = 0.25f; // Pixels a predicted position may drift before it is resent
+
+    const std::uint8_t gameOverFlag = 1;
+    const std::uint8_t shotFlag = 2;
+    const std::uint8_t explosionFlag = 4;
+    const std::uint8_t shockwaveFlag = 8;
+
+    inline std::uint16_t quantizePosition(float value, float extent) {
+        float t = (value + positionMargin) / (extent + 2.f * positionMargin);
+        return static_cast<std::uint16_t>(std::min(std::max(t, 0.f), 1.f) * 65535.f + 0.5f);
+    }
+
+    inline float dequantizePosition(std::uint16_t value, float extent) {
+        return value / 65535.f * (extent + 2.f * positionMargin) - positionMargin;
+    }
+
+    // Quantized position at `tick` of an entity sent as `anchor` and `velocity`, the
+    // latter in 1/64ths of a quantum per tick. Wraps like the anchor does.
+    inline std::uint16_t predictPosition(std::uint16_t anchor, std::int16_t velocity, std::uint32_t tick) {
+        std::int64_t fixed = (static_cast<std::int64_t>(anchor) << 6) + static_cast<std::int64_t>(velocity) * tick;
+        return static_cast<std::uint16_t>((fixed + 32) >> 6);
+    }
+
+    // The anchor that predicts exactly `position` at `tick`
+    inline std::uint16_t anchorFor(std::uint16_t position, std::int16_t velocity, std::uint32_t tick) {
+        std::int64_t fixed = (static_cast<std::int64_t>(position) << 6) - static_cast<std::int64_t>(velocity) * tick;
+        return static_cast<std::uint16_t>((fixed + 31) >> 6);
+    }
+
+    inline std::uint8_t quantizeAngle(float degrees) {
+        float turns = degrees / 360.f;
+        turns -= std::floor(turns);
+        return static_cast<std::uint8_t>(static_cast<int>(turns * 256.f + 0.5f) & 0xff);
+    }
+
+    inline float dequantizeAngle(std::uint8_t value) {
+        return value * (360.f / 256.f);
+    }
+
+    inline std::uint8_t inputFlags(const PlayerInput& input) {
+        return (input.thrust ? InputLog::thrustFlag : 0) | (input.fire ? InputLog::fireFlag : 0) | (input.shockwave ? InputLog::shockwaveFlag : 0);
+    }
+}
+
+// Simulated network conditions for testing co-op on one machine
+struct LinkConditions {
+    float latency = 0.f; // Seconds every outgoing packet is held back
+    float jitter = 0.f;  // Up to this many extra seconds per packet
+    float loss = 0.f;    // Fraction of outgoing packets dropped
+};
+
+// Traffic counters for one end of a link
+struct NetStats {
+    std::uint64_t bytesSent = 0;
+    std::uint64_t bytesReceived = 0;
+    std::uint64_t packetsSent = 0;
+    std::uint64_t packetsReceived = 0;
+    std::uint64_t packetsDropped = 0; // By the simulated link
+};
+
+// Non-blocking UDP socket that can delay and drop outgoing packets to simulate
+// a bad link. Bytes are counted before the simulated loss, as they would be on the wire.
+class NetLink {
+public:
+    bool bind(unsigned short port, const LinkConditions& linkConditions, std::uint64_t seed) {
+        conditions = linkConditions;
+        lossRng.seed(seed, 4);
+        socket.setBlocking(false);
+        return socket.bind(port) == sf::Socket::Done;
+    }
+
+    unsigned short getLocalPort() const {
+        return socket.getLocalPort();
+    }
+
+    void send(const std::vector<unsigned char>& packet, const sf::IpAddress& address, unsigned short port) {
+        stats.bytesSent += packet.size();
+        ++stats.packetsSent;
+        if (conditions.loss > 0.f && lossRng() < conditions.loss * 4294967295.f) {
+            ++stats.packetsDropped;
+            return;
+        }
+        if (conditions.latency <= 0.f && conditions.jitter <= 0.f) {
+            socket.send(packet.data(), packet.size(), address, port);
+            return;
+        }
+        float delay = conditions.latency + conditions.jitter * (lossRng() / 4294967295.f);
+        delayed.push_back(DelayedPacket{ clock.getElapsedTime() + sf::seconds(delay), packet, address, port });
+    }
+
+    // Send delayed packets that are due. Jitter can reorder them, as a real link would.
+    void flush() {
+        sf::Time now = clock.getElapsedTime();
+        for (size_t i = 0; i < delayed.size(); ++i) {
+            if (delayed[i].due <= now) {
+                socket.send(delayed[i].data.data(), delayed[i].data.size(), delayed[i].address, delayed[i].port);
+                delayed.erase(delayed.begin() + i);
+                --i;
+            }
+        }
+    }
+
+    bool receive(std::vector<unsigned char>& packet, sf::IpAddress& address, unsigned short& port) {
+        packet.resize(sf::UdpSocket::MaxDatagramSize);
+        size_t received = 0;
+        if (socket.receive(packet.data(), packet.size(), received, address, port) != sf::Socket::Done) {
+            return false;
+        }
+        packet.resize(received);
+        stats.bytesReceived += received;
+        ++stats.packetsReceived;
+        return true;
+    }
+
+    const NetStats& getStats() const {
+        return stats;
+    }
+
+private:
+    struct DelayedPacket {
+        sf::Time due;
+        std::vector<unsigned char> data;
+        sf::IpAddress address;
+        unsigned short port;
+    };
+
+    sf::UdpSocket socket;
+    LinkConditions conditions;
+    Pcg32 lossRng;
+    sf::Clock clock;
+    std::vector<DelayedPacket> delayed;
+    NetStats stats;
+};
+
+// Authoritative end of a co-op session. Runs the World, applies the client's
+// inputs to the partner ship one per tick and streams quantized state back.
+class NetHost {
+public:
+    bool start(unsigned short port, const LinkConditions& conditions) {
+        if (!link.bind(port, conditions, std::random_device{}())) {
+            std::cerr << "Error binding co-op host to port " << port << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    unsigned short getPort() const {
+        return link.getLocalPort();
+    }
+
+    // Drain client messages. Call once per tick before World::update.
+    void poll() {
+        link.flush();
+        sf::IpAddress address;
+        unsigned short port = 0;
+        while (link.receive(incoming, address, port)) {
+            StateReader reader(incoming.data(), incoming.size());
+            std::uint32_t messageMagic = 0;
+            std::uint8_t type = 0;
+            std::uint32_t ack = 0;
+            std::uint32_t newest = 0;
+            std::uint8_t count = 0;
+            reader.read(messageMagic);
+            reader.read(type);
+            reader.read(ack);
+            reader.read(newest);
+            reader.read(count);
+            if (!reader.isValid() || messageMagic != NetProtocol::magic || type != NetProtocol::inputMessage) {
+                continue;
+            }
+            if (!hasClient || address != clientAddress || port != clientPort) {
+                // Strangers are ignored while the partner is still talking
+                if (hasClient && tick - lastHeard <= NetProtocol::partnerTimeout) {
+                    continue;
+                }
+                // A new client takes the partner ship over from scratch
+                hasClient = true;
+                clientAddress = address;
+                clientPort = port;
+                pendingInputs.clear();
+                newestQueued = newest - std::min<std::uint32_t>(count, newest);
+                lastApplied = newestQueued;
+                clientAck = NetProtocol::noBaseline;
+            }
+            lastHeard = tick;
+            if (ack != NetProtocol::noBaseline && (clientAck == NetProtocol::noBaseline || ack > clientAck)) {
+                clientAck = ack;
+            }
+            for (std::uint32_t i = 0; i < count; ++i) {
+                std::int16_t aimX = 0, aimY = 0;
+                std::uint8_t flags = 0;
+                reader.read(aimX);
+                reader.read(aimY);
+                reader.read(flags);
+                std::uint32_t sequence = newest - (count - 1 - i);
+                if (!reader.isValid() || sequence <= newestQueued) {
+                    continue;
+                }
+                PlayerInput input;
+                input.aim = sf::Vector2f(aimX, aimY);
+                input.thrust = flags & InputLog::thrustFlag;
+                input.fire = flags & InputLog::fireFlag;
+                input.shockwave = flags & InputLog::shockwaveFlag;
+                pendingInputs.push_back(QueuedInput{ sequence, input });
+                newestQueued = sequence;
+            }
+            // Never let a burst of late inputs build up into permanent lag
+            while (pendingInputs.size() > NetProtocol::inputRedundancy) {
+                pendingInputs.pop_front();
+            }
+        }
+    }
+
+    // Input for the partner ship this tick. When the client's inputs are late the
+    // last one is held, and the client's reconciliation absorbs the difference.
+    PlayerInput nextInput() {
+        if (!pendingInputs.empty()) {
+            lastInput = pendingInputs.front().input;
+            lastApplied = pendingInputs.front().sequence;
+            pendingInputs.pop_front();
+            return lastInput;
+        }
+        PlayerInput held = lastInput;
+        held.shockwave = false;
+        return held;
+    }
+
+    // Call after World::update. Sends every NetProtocol::stateInterval ticks,
+    // delta-compressed against the newest state the client has confirmed and split
+    // into datagrams of at most NetProtocol::maxDatagram bytes.
+    void sendState(const World& world) {
+        const WorldEvents& events = world.getEvents();
+        pendingEvents |= (events.shot ? NetProtocol::shotFlag : 0) | (events.explosion ? NetProtocol::explosionFlag : 0) | (events.shockwave ? NetProtocol::shockwaveFlag : 0);
+        ++tick;
+        if (!hasClient || tick % NetProtocol::stateInterval != 0) {
+            return;
+        }
+
+        encodeState(world);
+        SentState& slot = sent[(tick / NetProtocol::stateInterval) % sent.size()];
+        slot.tick = tick;
+        slot.data.assign(current.begin(), current.end());
+
+        const SentState* baseline = nullptr;
+        if (clientAck != NetProtocol::noBaseline) {
+            const SentState& candidate = sent[(clientAck / NetProtocol::stateInterval) % sent.size()];
+            if (candidate.tick == clientAck && clientAck != tick) {
+                baseline = &candidate;
+            }
+        }
+
+        const std::vector<unsigned char>* body = &current;
+        if (baseline) {
+            DeltaCodec::encodeDelta(baseline->data, current, delta);
+            body = &delta;
+        }
+        const size_t chunk = NetProtocol::maxDatagram - NetProtocol::stateHeaderSize;
+        size_t fragments = std::max<size_t>((body->size() + chunk - 1) / chunk, 1);
+        if (fragments > NetProtocol::maxFragments) {
+            return; // Cannot happen below maxEntities slots; the client keeps the last state
+        }
+        for (size_t fragment = 0; fragment < fragments; ++fragment) {
+            size_t begin = fragment * chunk;
+            size_t end = std::min(begin + chunk, body->size());
+            packet.clear();
+            StateWriter writer(packet);
+            writer.write(NetProtocol::magic);
+            writer.write(NetProtocol::stateMessage);
+            writer.write(tick);
+            writer.write(baseline ? baseline->tick : NetProtocol::noBaseline);
+            writer.write(lastApplied);
+            writer.write(static_cast<std::uint32_t>(current.size()));
+            writer.write(static_cast<std::uint8_t>(fragment));
+            writer.write(static_cast<std::uint8_t>(fragments));
+            writer.writeBytes(body->data() + begin, end - begin);
+            link.send(packet, clientAddress, clientPort);
+        }
+        if (baseline) {
+            ++deltaStates;
         }
         else {
-            sprite.setTexture(texture);
+            ++fullStates;
+        }
+        entitiesSent += entities.size();
+        pendingEvents = 0;
+    }
+
+    bool isConnected() const {
+        return hasClient;
+    }
+
+    const NetStats& getStats() const {
+        return link.getStats();
+    }
+
+    // States sent so far and how many entities they carried in total
+    std::uint64_t getStatesSent() const {
+        return fullStates + deltaStates;
+    }
+
+    std::uint64_t getDeltaStatesSent() const {
+        return deltaStates;
+    }
+
+    std::uint64_t getEntitiesSent() const {
+        return entitiesSent;
+    }
+
+private:
+    struct QueuedInput {
+        std::uint32_t sequence;
+        PlayerInput input;
+    };
+
+    struct SentState {
+        std::uint32_t tick = NetProtocol::noBaseline;
+        std::vector<unsigned char> data;
+    };
+
+    // What the client was last told about one slot
+    struct Slot {
+        std::uint8_t kind = NetProtocol::emptySlot;
+        std::uint8_t variant = 0;
+        std::uint8_t angle = 0;
+        sf::Vector2f position;      // Unquantized, so the velocity sent is exact
+        std::uint16_t x = 0, y = 0; // Quantized position
+        std::uint16_t anchorX = 0, anchorY = 0;
+        std::int16_t velocityX = 0, velocityY = 0;
+    };
+
+    // Give each captured entity a slot. The world keeps each kind in order and
+    // survivors keep theirs, so an entity is usually in the next slot of its kind,
+    // and otherwise a little further on, past ones that died. The next slot only
+    // has to be within reach; one further on has to be where its prediction said,
+    // so a stranger nearby does not make matching skip entities still to come.
+    // Entities that are not found (new ones, and UFO bullets, which the pool
+    // reorders) take a free slot, and slots whose entity is gone are freed, so one
+    // death does not shift every later entity.
+    void assignSlots(float extentX, float extentY) {
+        slotKept.assign(slots.size(), 0);
+        float maxStep = maxMatchSpeed * NetProtocol::stateInterval * NetProtocol::tickSeconds;
+        for (std::vector<std::uint32_t>& order : nextOrder) {
+            order.clear();
+        }
+        size_t cursors[NetKindCount] = {};
+        for (size_t i = 0; i < entities.size(); ++i) {
+            const NetEntity& entity = entities[i];
+            if (entity.kind >= NetKindCount) {
+                continue;
+            }
+            const std::vector<std::uint32_t>& order = slotOrder[entity.kind];
+            size_t& cursor = cursors[entity.kind];
+            size_t found = order.size();
+            const size_t end = std::min(cursor + matchWindow, order.size());
+            for (size_t j = cursor; j < end; ++j) {
+                const Slot& candidate = slots[order[j]];
+                sf::Vector2f miss = entity.position - candidate.position;
+                float reach = maxStep;
+                if (j > cursor) {
+                    miss = entity.position - sf::Vector2f(NetProtocol::dequantizePosition(NetProtocol::predictPosition(candidate.anchorX, candidate.velocityX, tick), extentX),
+                        NetProtocol::dequantizePosition(NetProtocol::predictPosition(candidate.anchorY, candidate.velocityY, tick), extentY));
+                    reach = 1.f;
+                }
+                if (miss.x * miss.x + miss.y * miss.y <= reach * reach) {
+                    found = j;
+                    break;
+                }
+            }
+            bool matched = found < order.size();
+            std::uint32_t slot = noSlot;
+            if (matched) {
+                slot = order[found];
+                cursor = found + 1;
+            }
+            if (!matched) {
+                slot = allocateSlot();
+                if (slot == noSlot) {
+                    continue; // Full; dropped from this state
+                }
+                slotKept.resize(slots.size(), 0);
+            }
+            slotKept[slot] = 1;
+            nextOrder[entity.kind].push_back(slot);
+            updateSlot(slots[slot], entity, matched, extentX, extentY);
+        }
+        for (size_t slot = 0; slot < slots.size(); ++slot) {
+            if (!slotKept[slot] && slots[slot].kind != NetProtocol::emptySlot) {
+                slots[slot] = Slot();
+                freeSlots.push_back(static_cast<std::uint32_t>(slot));
+            }
+        }
+        while (!slots.empty() && slots.back().kind == NetProtocol::emptySlot) {
+            slots.pop_back();
+        }
+        std::swap(slotOrder, nextOrder);
+    }
+
+    // Oldest freed slot first, so the client rarely sees a slot change hands between two states
+    std::uint32_t allocateSlot() {
+        while (!freeSlots.empty()) {
+            std::uint32_t slot = freeSlots.front();
+            freeSlots.pop_front();
+            if (slot < slots.size() && slots[slot].kind == NetProtocol::emptySlot) {
+                return slot;
+            }
+        }
+        if (slots.size() >= NetProtocol::maxEntities) {
+            return noSlot;
+        }
+        slots.emplace_back();
+        return static_cast<std::uint32_t>(slots.size() - 1);
+    }
+
+    // Keeps the anchor and velocity while they still predict the entity, so its
+    // bytes do not change; otherwise sends the motion since the last state
+    void updateSlot(Slot& slot, const NetEntity& entity, bool matched, float extentX, float extentY) {
+        std::uint16_t x = NetProtocol::quantizePosition(entity.position.x, extentX);
+        std::uint16_t y = NetProtocol::quantizePosition(entity.position.y, extentY);
+        auto refresh = [&](std::uint16_t position, float moved, std::uint16_t& anchor, std::int16_t& velocity, float extent) {
+            float quantaPerPixel = 65535.f / (extent + 2.f * NetProtocol::positionMargin);
+            float tolerance = std::max(NetProtocol::predictionTolerance * quantaPerPixel, 1.f);
+            std::int16_t error = static_cast<std::int16_t>(position - NetProtocol::predictPosition(anchor, velocity, tick));
+            if (matched && std::abs(error) <= tolerance) {
+                return;
+            }
+            float perTick = matched ? moved * quantaPerPixel * 64.f / NetProtocol::stateInterval : 0.f;
+            velocity = static_cast<std::int16_t>(std::min(std::max(std::round(perTick), -32767.f), 32767.f));
+            anchor = NetProtocol::anchorFor(position, velocity, tick);
+        };
+        refresh(x, entity.position.x - slot.position.x, slot.anchorX, slot.velocityX, extentX);
+        refresh(y, entity.position.y - slot.position.y, slot.anchorY, slot.velocityY, extentY);
+        slot.kind = entity.kind;
+        slot.variant = entity.variant;
+        slot.angle = NetProtocol::quantizeAngle(entity.rotation);
+        slot.position = entity.position;
+        slot.x = x;
+        slot.y = y;
+    }
+
+    void encodeState(const World& world) {
+        world.captureEntities(entities);
+        std::uint8_t flags = pendingEvents | (world.isOver() ? NetProtocol::gameOverFlag : 0);
+        sf::Vector2u worldSize = world.getSize();
+        const Player* partner = world.getPartner();
+        sf::Vector2f partnerPosition = partner ? partner->getPosition() : sf::Vector2f();
+        sf::Vector2f partnerVelocity = partner ? partner->getVelocity() : sf::Vector2f();
+
+        StateWriter writer(current);
+        writer.write(static_cast<std::int32_t>(world.getScore()));
+        writer.write(static_cast<std::int8_t>(world.getHealth().getCurrentHearts()));
+        writer.write(static_cast<std::uint8_t>(std::min(world.getShockwaveCount(), 255)));
+        writer.write(static_cast<std::uint8_t>(std::min(world.getMedkitsUsed(), 255)));
+        writer.write(flags);
+        writer.write(static_cast<std::uint16_t>(worldSize.x));
+        writer.write(static_cast<std::uint16_t>(worldSize.y));
+        writer.write(partnerPosition.x);
+        writer.write(partnerPosition.y);
+        writer.write(partnerVelocity.x);
+        writer.write(partnerVelocity.y);
+        writer.write(static_cast<std::uint8_t>(partner && partner->getThrusting()));
+
+        assignSlots(static_cast<float>(worldSize.x), static_cast<float>(worldSize.y));
+        writer.write(static_cast<std::uint16_t>(slots.size()));
+        for (const Slot& slot : slots) {
+            writer.write(slot.kind);
+        }
+        for (const Slot& slot : slots) {
+            writer.write(slot.variant);
+        }
+        for (const Slot& slot : slots) {
+            writer.write(slot.angle);
+        }
+        for (const Slot& slot : slots) {
+            writer.write(slot.anchorX);
+            writer.write(slot.anchorY);
+            writer.write(slot.velocityX);
+            writer.write(slot.velocityY);
+        }
+    }
+
+    NetLink link;
+    bool hasClient = false;
+    sf::IpAddress clientAddress;
+    unsigned short clientPort = 0;
+    std::uint32_t lastHeard = 0; // Tick of the partner's newest message
+    std::uint32_t clientAck = NetProtocol::noBaseline;
+
+    std::deque<QueuedInput> pendingInputs;
+    std::uint32_t newestQueued = 0;
+    std::uint32_t lastApplied = 0;
+    PlayerInput lastInput;
+
+    std::uint32_t tick = 0;
+    std::uint8_t pendingEvents = 0;
+    std::vector<SentState> sent = std::vector<SentState>(NetProtocol::stateHistory);
+    std::uint64_t fullStates = 0;
+    std::uint64_t deltaStates = 0;
+    std::uint64_t entitiesSent = 0;
+
+    static constexpr std::uint32_t noSlot = 0xffffffff;
+    static constexpr size_t matchWindow = 32;     // Deaths of one kind between two states that still match
+    static constexpr float maxMatchSpeed = 800.f; // Pixels per second; faster than anything moves
+    std::vector<Slot> slots;
+    std::deque<std::uint32_t> freeSlots;
+    std::vector<std::uint32_t> slotOrder[NetKindCount]; // Each kind's slots in world order, last state
+    std::vector<std::uint32_t> nextOrder[NetKindCount];
+
+    // Scratch buffers reused across ticks
+    std::vector<NetEntity> entities;
+    std::vector<char> slotKept;
+    std::vector<unsigned char> current, delta, packet, incoming;
+};
+
+// Client end of a co-op session. Predicts its own ship from local input, sends
+// that input to the host and rewinds to the host's answer when it arrives,
+// replaying the inputs the host has not applied yet. Everything else is drawn
+// one state interval behind, moving from the previous state to the newest.
+class NetClient {
+public:
+    explicit NetClient(const WorldTextures& textures)
+        : textures(textures) {
+        // Every kind draws as its entity class would
+        prototypes[NetKindShip] = Player(textures.playerIdle, textures.playerThrusting, sf::Vector2f(), sf::Vector2u()).getSprite();
+        thrustingShip = prototypes[NetKindShip];
+        thrustingShip.setTexture(textures.playerThrusting);
+        prototypes[NetKindUFO] = UFO_Boss(sf::Vector2f(), sf::Vector2u(), textures.UFO).getSprite();
+        prototypes[NetKindUFOBullet].setTexture(textures.UFOBullet, true);
+        prototypes[NetKindUFOBullet].setOrigin(textures.UFOBullet.getSize().x / 2, textures.UFOBullet.getSize().y / 2);
+        prototypes[NetKindProjectile] = Projectile(textures.projectile, sf::Vector2f(), 0.f).getSprite();
+        prototypes[NetKindPowerup] = Powerup(textures.powerUp, sf::Vector2f()).getSprite();
+        prototypes[NetKindMedkit] = Medkit(textures.medkit, sf::Vector2f()).getSprite();
+        for (int type = 0; type < 3; ++type) {
+            asteroids[type] = Enemy(textures.enemy, textures.enemy2, sf::Vector2f(), sf::Vector2f(), static_cast<EnemyType>(type)).getSprite();
+        }
+    }
+
+    bool connect(const sf::IpAddress& address, unsigned short port, const LinkConditions& conditions) {
+        hostAddress = address;
+        hostPort = port;
+        if (!link.bind(sf::Socket::AnyPort, conditions, std::random_device{}())) {
+            std::cerr << "Error opening co-op client socket" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // Apply one tick of local input to the predicted ship and send it to the host
+    // along with the most recent ones, in case earlier packets were lost
+    void sendInput(const PlayerInput& input) {
+        ++inputSequence;
+        ++ticksSinceState;
+        pendingInputs.push_back(QueuedInput{ inputSequence, input });
+        while (pendingInputs.size() > maxPendingInputs) {
+            pendingInputs.pop_front();
+        }
+        if (ship) {
+            ship->updateRotation(input.aim);
+            ship->update(NetProtocol::tickSeconds, input.thrust);
+        }
+
+        packet.clear();
+        StateWriter writer(packet);
+        size_t count = std::min(pendingInputs.size(), NetProtocol::inputRedundancy);
+        writer.write(NetProtocol::magic);
+        writer.write(NetProtocol::inputMessage);
+        writer.write(latestTick);
+        writer.write(inputSequence);
+        writer.write(static_cast<std::uint8_t>(count));
+        for (size_t i = pendingInputs.size() - count; i < pendingInputs.size(); ++i) {
+            const PlayerInput& queued = pendingInputs[i].input;
+            writer.write(static_cast<std::int16_t>(queued.aim.x));
+            writer.write(static_cast<std::int16_t>(queued.aim.y));
+            writer.write(NetProtocol::inputFlags(queued));
+        }
+        link.send(packet, hostAddress, hostPort);
+        link.flush();
+    }
+
+    // Drain state messages and reconcile the predicted ship with the newest one
+    void poll() {
+        link.flush();
+        sf::IpAddress address;
+        unsigned short port = 0;
+        bool updated = false;
+        while (link.receive(incoming, address, port)) {
+            if (address != hostAddress || port != hostPort) {
+                continue;
+            }
+            updated |= decodeMessage();
+        }
+        if (updated) {
+            reconcile();
+        }
+    }
+
+    // Drawable state for the render thread: the predicted ship first, then the host's entities
+    void captureSnapshot(RenderSnapshot& snapshot) {
+        snapshot.view = sf::FloatRect(0.f, 0.f, static_cast<float>(worldSize.x), static_cast<float>(worldSize.y));
+        snapshot.sprites.clear();
+        snapshot.bulletQuads.clear(); // The host's bullets arrive one by one and draw as sprites
+        snapshot.thrusters.clear();
+        snapshot.effects.clear();
+        snapshot.ownShipFirst = ship != nullptr;
+        snapshot.shipVelocity = ship ? ship->getVelocity() : sf::Vector2f();
+        snapshot.viewVelocity = sf::Vector2f(); // The client's view is the whole world
+        if (ship) {
+            snapshot.sprites.push_back(SpriteState::capture(ship->getSprite()));
+            if (ship->getThrusting()) {
+                snapshot.thrusters.push_back(thrusterFor(*ship));
+            }
+        }
+        // Reaches the newest state as the next one is due
+        float alpha = 1.f;
+        if (previousTick != NetProtocol::noBaseline) {
+            alpha = std::min(static_cast<float>(ticksSinceState) / (latestTick - previousTick), 1.f);
+        }
+        // A slot holds the same entity from state to state, unless it changed hands
+        float maxStep = previousTick != NetProtocol::noBaseline ? maxMatchSpeed * (latestTick - previousTick) * NetProtocol::tickSeconds : 0.f;
+        sf::Sprite sprite;
+        for (size_t i = 0; i < entities.size(); ++i) {
+            NetEntity entity = entities[i];
+            const NetEntity* previous = i < previousEntities.size() ? &previousEntities[i] : nullptr;
+            sf::Vector2f step = previous ? entity.position - previous->position : sf::Vector2f();
+            if (previous && previous->kind == entity.kind && step.x * step.x + step.y * step.y <= maxStep * maxStep) {
+                const NetEntity& before = *previous;
+                entity.position = before.position + (entity.position - before.position) * alpha;
+                float turn = entity.rotation - before.rotation;
+                turn -= 360.f * std::round(turn / 360.f);
+                entity.rotation = before.rotation + turn * alpha;
+            }
+            switch (entity.kind) {
+            case NetKindShip:
+                sprite = entity.variant ? thrustingShip : prototypes[NetKindShip];
+                break;
+            case NetKindAsteroid:
+                sprite = asteroids[std::min<int>(entity.variant, 2)];
+                break;
+            case NetKindExplosion:
+            case NetKindShockwave: {
+                const AnimationClip& clip = textures.animationClips[entity.kind == NetKindExplosion ? ExplosionClip : ShockwaveClip];
+                snapshot.sprites.push_back(clip.capture(std::min<size_t>(entity.variant, clip.frames.size() - 1), entity.position));
+                continue;
+            }
+            default:
+                if (entity.kind >= NetKindCount) {
+                    continue;
+                }
+                sprite = prototypes[entity.kind];
+                break;
+            }
+            sprite.setPosition(entity.position);
+            sprite.setRotation(entity.rotation);
+            snapshot.sprites.push_back(SpriteState::capture(sprite));
+        }
+        snapshot.score = score;
+        snapshot.hearts = hearts;
+        snapshot.maxHearts = World::maxHearts;
+        snapshot.fullHeart = &textures.fullHeart;
+        snapshot.halfHeart = &textures.halfHeart;
+        snapshot.shockwaveCount = shockwaveCount;
+        snapshot.medkitsUsed = medkitsUsed;
+    }
+
+    // Sound events the host reported since the last call
+    WorldEvents takeEvents() {
+        WorldEvents events;
+        events.shot = pendingEvents & NetProtocol::shotFlag;
+        events.explosion = pendingEvents & NetProtocol::explosionFlag;
+        events.shockwave = pendingEvents & NetProtocol::shockwaveFlag;
+        pendingEvents = 0;
+        return events;
+    }
+
+    bool isOver() const {
+        return gameOver;
+    }
+
+    int getScore() const {
+        return score;
+    }
+
+    bool isThrusting() const {
+        return ship && ship->getThrusting();
+    }
+
+    const NetStats& getStats() const {
+        return link.getStats();
+    }
+
+    // Mean distance, in pixels, the predicted ship was moved by reconciliation
+    float getMeanCorrection() const {
+        return corrections ? static_cast<float>(correctionTotal / corrections) : 0.f;
+    }
+
+private:
+    struct QueuedInput {
+        std::uint32_t sequence;
+        PlayerInput input;
+    };
+
+    struct ReceivedState {
+        std::uint32_t tick = NetProtocol::noBaseline;
+        std::vector<unsigned char> data;
+    };
+
+    // Returns true if the message was a newer state than any seen so far
+    bool decodeMessage() {
+        StateReader reader(incoming.data(), incoming.size());
+        std::uint32_t messageMagic = 0;
+        std::uint8_t type = 0;
+        std::uint32_t tick = 0;
+        std::uint32_t baseline = 0;
+        std::uint32_t applied = 0;
+        std::uint32_t rawSize = 0;
+        std::uint8_t fragment = 0;
+        std::uint8_t fragments = 0;
+        reader.read(messageMagic);
+        reader.read(type);
+        reader.read(tick);
+        reader.read(baseline);
+        reader.read(applied);
+        reader.read(rawSize);
+        reader.read(fragment);
+        reader.read(fragments);
+        if (!reader.isValid() || messageMagic != NetProtocol::magic || type != NetProtocol::stateMessage || fragment >= fragments ||
+            (latestTick != NetProtocol::noBaseline && tick <= latestTick) || rawSize > NetProtocol::maxDatagram * NetProtocol::maxFragments) {
+            return false;
+        }
+        const unsigned char* body = reader.cursor();
+        size_t bodySize = reader.remaining();
+        if (fragments > 1) {
+            // Only the newest split state is assembled; a fragment of a newer one abandons it
+            if (assemblyTick != tick) {
+                if (assemblyTick != NetProtocol::noBaseline && tick < assemblyTick) {
+                    return false;
+                }
+                assemblyTick = tick;
+                assemblyParts.assign(fragments, 0);
+                assemblyMissing = fragments;
+                assembly.clear();
+            }
+            const size_t chunk = NetProtocol::maxDatagram - NetProtocol::stateHeaderSize;
+            if (assemblyParts.size() != fragments || assemblyParts[fragment] || (fragment + 1 < fragments && bodySize != chunk)) {
+                return false;
+            }
+            size_t offset = fragment * chunk;
+            assembly.resize(std::max(assembly.size(), offset + bodySize));
+            std::memcpy(assembly.data() + offset, body, bodySize);
+            assemblyParts[fragment] = 1;
+            if (--assemblyMissing > 0) {
+                return false;
+            }
+            assemblyTick = NetProtocol::noBaseline;
+            body = assembly.data();
+            bodySize = assembly.size();
+        }
+
+        ReceivedState& slot = received[(tick / NetProtocol::stateInterval) % received.size()];
+        if (baseline == NetProtocol::noBaseline) {
+            if (bodySize != rawSize) {
+                return false;
+            }
+            slot.data.assign(body, body + rawSize);
+        }
+        else {
+            const ReceivedState& base = received[(baseline / NetProtocol::stateInterval) % received.size()];
+            if (base.tick != baseline || &base == &slot) {
+                return false; // Baseline already overwritten; the host falls back to a full state
+            }
+            decoded.assign(base.data.begin(), base.data.end());
+            if (!DeltaCodec::applyDelta(body, bodySize, rawSize, decoded)) {
+                return false;
+            }
+            slot.data.swap(decoded);
+        }
+        if (!parseState(slot.data, tick)) {
+            slot.tick = NetProtocol::noBaseline;
+            return false;
+        }
+        slot.tick = tick;
+        latestTick = tick;
+        lastApplied = applied;
+        ticksSinceState = 0;
+        return true;
+    }
+
+    bool parseState(const std::vector<unsigned char>& state, std::uint32_t tick) {
+        StateReader reader(state.data(), state.size());
+        std::int32_t newScore = 0;
+        std::int8_t newHearts = 0;
+        std::uint8_t shockwaves = 0, medkits = 0, flags = 0, thrusting = 0;
+        std::uint16_t width = 0, height = 0, count = 0;
+        reader.read(newScore);
+        reader.read(newHearts);
+        reader.read(shockwaves);
+        reader.read(medkits);
+        reader.read(flags);
+        reader.read(width);
+        reader.read(height);
+        reader.read(partnerPosition.x);
+        reader.read(partnerPosition.y);
+        reader.read(partnerVelocity.x);
+        reader.read(partnerVelocity.y);
+        reader.read(thrusting);
+        reader.read(count);
+        if (!reader.isValid() || reader.remaining() != count * 11u) {
+            return false;
+        }
+
+        score = newScore;
+        hearts = newHearts;
+        shockwaveCount = shockwaves;
+        medkitsUsed = medkits;
+        gameOver = flags & NetProtocol::gameOverFlag;
+        pendingEvents |= flags & ~NetProtocol::gameOverFlag;
+        // Keep the state before this one to draw from, unless the world changed under it
+        previousEntities.swap(entities);
+        previousTick = latestTick;
+        if (!ship || worldSize != sf::Vector2u(width, height)) {
+            worldSize = sf::Vector2u(width, height);
+            ship = std::make_unique<Player>(textures.playerIdle, textures.playerThrusting, partnerPosition, worldSize);
+            previousTick = NetProtocol::noBaseline;
+        }
+
+        const unsigned char* fields = reader.cursor();
+        reader.skip(3u * count);
+        entities.resize(count);
+        for (size_t i = 0; i < count; ++i) {
+            NetEntity& entity = entities[i];
+            entity.kind = fields[i];
+            entity.variant = fields[count + i];
+            entity.rotation = NetProtocol::dequantizeAngle(fields[2 * count + i]);
+            std::uint16_t anchorX = 0, anchorY = 0;
+            std::int16_t velocityX = 0, velocityY = 0;
+            reader.read(anchorX);
+            reader.read(anchorY);
+            reader.read(velocityX);
+            reader.read(velocityY);
+            std::uint16_t x = NetProtocol::predictPosition(anchorX, velocityX, tick);
+            std::uint16_t y = NetProtocol::predictPosition(anchorY, velocityY, tick);
+            entity.position = sf::Vector2f(NetProtocol::dequantizePosition(x, static_cast<float>(width)), NetProtocol::dequantizePosition(y, static_cast<float>(height)));
+        }
+        return true;
+    }
+
+    // Reset the predicted ship to the host's and replay what the host has not applied yet
+    void reconcile() {
+        while (!pendingInputs.empty() && pendingInputs.front().sequence <= lastApplied) {
+            pendingInputs.pop_front();
+        }
+        sf::Vector2f predicted = ship->getPosition();
+        ship->setPosition(partnerPosition);
+        ship->setVelocity(partnerVelocity);
+        for (const QueuedInput& queued : pendingInputs) {
+            ship->updateRotation(queued.input.aim);
+            ship->update(NetProtocol::tickSeconds, queued.input.thrust);
+        }
+        sf::Vector2f error = ship->getPosition() - predicted;
+        correctionTotal += std::sqrt(error.x * error.x + error.y * error.y);
+        ++corrections;
+    }
+
+    const WorldTextures& textures;
+    NetLink link;
+    sf::IpAddress hostAddress;
+    unsigned short hostPort = 0;
+
+    std::unique_ptr<Player> ship; // Created from the first state, which carries the world size
+    sf::Vector2u worldSize;
+    std::deque<QueuedInput> pendingInputs;
+    std::uint32_t inputSequence = 0;
+    std::uint32_t lastApplied = 0;
+    const size_t maxPendingInputs = 120;
+
+    std::vector<ReceivedState> received = std::vector<ReceivedState>(NetProtocol::stateHistory);
+    std::uint32_t latestTick = NetProtocol::noBaseline;
+    std::vector<NetEntity> entities;
+
+    // Interpolation from the state before the newest
+    static constexpr float maxMatchSpeed = 800.f; // Pixels per second; faster than anything moves
+    std::vector<NetEntity> previousEntities;
+    std::uint32_t previousTick = NetProtocol::noBaseline;
+    std::uint32_t ticksSinceState = 0;
+
+    // A state split over several datagrams, while its fragments arrive
+    std::uint32_t assemblyTick = NetProtocol::noBaseline;
+    std::vector<char> assemblyParts;
+    size_t assemblyMissing = 0;
+    std::vector<unsigned char> assembly;
+    sf::Vector2f partnerPosition, partnerVelocity;
+    int score = 0;
+    int hearts = 0;
+    int shockwaveCount = 0;
+    int medkitsUsed = 0;
+    bool gameOver = false;
+    std::uint8_t pendingEvents = 0;
+
+    double correctionTotal = 0.0;
+    std::uint64_t corrections = 0;
+
+    // What each kind draws as
+    sf::Sprite prototypes[NetKindCount];
+    sf::Sprite thrustingShip;
+    sf::Sprite asteroids[3];
+
+    // Scratch buffers reused across ticks
+    std::vector<unsigned char> packet, incoming, decoded;
+};
+
+// How this cabinet takes part in co-op
+struct NetOptions {
+    enum class Mode { Offline, Host, Client };
+    Mode mode = Mode::Offline;
+    std::string hostAddress;
+    unsigned short port = 47800;
+    LinkConditions conditions;
+};
+
+// Samples for soak runs, taken once a simulated minute: memory, container sizes,
+// stack depth, heap calls from ticks and 99th percentile tick and frame times.
+// The report fits a line through each series after the warm-up samples and fails
+// any that climbs by more than the allowed fraction of where it started, or that
+// has to stay at zero and does not.
+class SoakMonitor {
+public:
+    explicit SoakMonitor(double allowedGrowth) : allowedGrowth(allowedGrowth) {}
+
+    // Simulation thread
+    void addTickTime(float seconds) {
+        tickTimes.push_back(seconds);
+    }
+
+    // Render thread
+    void addFrameTime(float seconds) {
+        std::lock_guard<std::mutex> lock(frameTimesMutex);
+        frameTimes.push_back(seconds);
+    }
+
+    // `minChange` is the smallest rise that counts as growth, so a few entities
+    // or pages of memory never fail a run on their own
+    void record(const std::string& name, double value, double minChange) {
+        for (Series& entry : series) {
+            if (entry.name == name) {
+                entry.values.push_back(value);
+                return;
+            }
+        }
+        series.push_back(Series{ name, std::vector<double>(1, value), minChange });
+    }
+
+    // A series that has to be zero in every sample after warm-up, not just flat
+    void expectZero(const std::string& name, double value) {
+        record(name, value, 0.0);
+        for (Series& entry : series) {
+            entry.mustBeZero = entry.mustBeZero || entry.name == name;
+        }
+    }
+
+    // Adds the process-wide series, then prints the whole sample on one line
+    void finishSample(std::ostream& out) {
+        record("rss_kb", residentBytes() / 1024.0, 8192.0);
+        record("heap_kb", heapBytes() / 1024.0, 4096.0);
+        record("tick_p99_ms", percentile(tickTimes, 0.99f) * 1000.0, 1.0);
+        {
+            std::lock_guard<std::mutex> lock(frameTimesMutex);
+            record("frame_p99_ms", percentile(frameTimes, 0.99f) * 1000.0, 1.0);
+            frameTimes.clear();
+        }
+        tickTimes.clear();
+
+        out << "soak minute " << ++samples;
+        for (const Series& entry : series) {
+            out << " " << entry.name << "=" << entry.values.back();
+        }
+        out << std::endl;
+    }
+
+    // Prints every series' trend. Returns false if any kept growing.
+    bool report(std::ostream& out) const {
+        bool passed = true;
+        out << "soak report over " << samples << " minutes, trends from minute " << warmupSamples + 1 << ":" << std::endl;
+        for (const Series& entry : series) {
+            size_t count = entry.values.size() > warmupSamples ? entry.values.size() - warmupSamples : 0;
+            if (count < 3) {
+                out << "  " << entry.name << ": too few samples" << std::endl;
+                continue;
+            }
+            // Least-squares line through the samples after warm-up
+            const double* values = entry.values.data() + warmupSamples;
+            double meanX = (count - 1) / 2.0;
+            double meanY = 0.0;
+            for (size_t i = 0; i < count; ++i) {
+                meanY += values[i] / count;
+            }
+            double covariance = 0.0, variance = 0.0;
+            for (size_t i = 0; i < count; ++i) {
+                covariance += (i - meanX) * (values[i] - meanY);
+                variance += (i - meanX) * (i - meanX);
+            }
+            double slope = covariance / variance;
+            double start = meanY - slope * meanX;
+            double rise = slope * (count - 1);
+            bool growing = rise > entry.minChange && rise > allowedGrowth * std::max(std::abs(start), entry.minChange);
+            bool nonZero = entry.mustBeZero && std::any_of(values, values + count, [](double value) { return value != 0.0; });
+            passed = passed && !growing && !nonZero;
+            out << "  " << entry.name << ": " << start << " -> " << start + rise << (growing ? "  GROWING" : "") << (nonZero ? "  NOT ZERO" : "") << std::endl;
+        }
+        out << (passed ? "soak passed" : "soak failed") << std::endl;
+        return passed;
+    }
+
+    // Resident set size, 0 where the platform does not say
+    static size_t residentBytes() {
+#if defined(__linux__)
+        std::ifstream statm("/proc/self/statm");
+        size_t pages = 0, resident = 0;
+        statm >> pages >> resident;
+        return resident * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+#else
+        return 0;
+#endif
+    }
+
+    // Bytes the allocator has handed out and not had back, 0 where it does not say
+    static size_t heapBytes() {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+        struct mallinfo2 info = mallinfo2();
+        // Large blocks are mapped separately and not counted in uordblks
+        return info.uordblks + info.hblkhd;
+#else
+        return 0;
+#endif
+    }
+
+private:
+    struct Series {
+        std::string name;
+        std::vector<double> values;
+        double minChange;
+        bool mustBeZero = false;
+    };
+
+    static float percentile(std::vector<float>& times, float fraction) {
+        if (times.empty()) {
+            return 0.f;
+        }
+        size_t index = std::min(times.size() - 1, static_cast<size_t>(times.size() * fraction));
+        std::nth_element(times.begin(), times.begin() + index, times.end());
+        return times[index];
+    }
+
+    // Pools, caches and the rewind history fill up over the first minutes
+    static const size_t warmupSamples = 2;
+
+    double allowedGrowth;
+    size_t samples = 0;
+    std::vector<Series> series;
+    std::vector<float> tickTimes;
+    std::vector<float> frameTimes;
+    std::mutex frameTimesMutex;
+};
+
+// Where and how the telemetry publisher writes. A path starting with "unix:"
+// is a Unix domain socket the game connects to; anything else is a file.
+struct TelemetryOptions {
+    enum class Format { JsonLines, Prometheus };
+    std::string target;
+    Format format = Format::JsonLines;
+    size_t rotateBytes = 8 * 1024 * 1024; // JSON lines files roll over at this size
+    int keepFiles = 3;                    // Rolled-over files kept as target.1 ... target.N
+};
+
+// One render-thread frame
+struct FrameTelemetry {
+    float seconds;
+    std::uint32_t drawCalls;
+    std::uint8_t qualityLevel;
+};
+
+// Simulation-thread state, sent once a second. Container names are string literals.
+struct WorldTelemetry {
+    static constexpr size_t maxContainers = 16;
+    const char* containerNames[maxContainers];
+    std::uint64_t containerSizes[maxContainers];
+    size_t containerCount;
+    int score;
+    int audioVoices;
+    std::uint64_t sessions;
+    std::uint64_t sessionTicks;
+    std::uint64_t totalTicks;
+};
+
+// Live metrics for fleet monitoring, published once a second. The game threads
+// only push small records into lock-free queues; percentiles, formatting and I/O
+// all happen on the publisher's own thread. Records that find a queue full are
+// dropped and counted rather than waited on.
+class TelemetryPublisher {
+public:
+    explicit TelemetryPublisher(const TelemetryOptions& options) : options(options) {
+        frameTimes.reserve(frameQueueSize);
+        tickTimes.reserve(tickQueueSize);
+    }
+
+    ~TelemetryPublisher() {
+        stop();
+    }
+
+    // False if the target cannot be used on this platform
+    bool start() {
+        if (isSocket()) {
+#if !defined(__linux__)
+            std::cerr << "Telemetry sockets need Linux: " << options.target << std::endl;
+            return false;
+#endif
+        }
+        running = true;
+        thread = std::thread(&TelemetryPublisher::publishLoop, this);
+        return true;
+    }
+
+    void stop() {
+        if (!thread.joinable()) {
+            return;
+        }
+        running = false;
+        thread.join();
+        closeSocket();
+    }
+
+    // Render thread
+    void addFrame(const FrameTelemetry& frame) {
+        if (!frames.push(frame)) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    // Simulation thread
+    void addTick(float seconds) {
+        if (!ticks.push(seconds)) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    void addWorld(const WorldTelemetry& world) {
+        if (!worlds.push(world)) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+private:
+    static const size_t frameQueueSize = 1024;
+    static const size_t tickQueueSize = 1024;
+
+    bool isSocket() const {
+        return options.target.compare(0, 5, "unix:") == 0;
+    }
+
+    void publishLoop() {
+        sf::Clock sinceReport;
+        while (running) {
+            sf::sleep(sf::milliseconds(100));
+            drain();
+            if (sinceReport.getElapsedTime() >= sf::seconds(1.f)) {
+                sinceReport.restart();
+                write(format());
+                frameTimes.clear();
+                tickTimes.clear();
+                drawCalls = 0;
+            }
+        }
+    }
+
+    // Empty the queues often enough that a second of frames never fills them
+    void drain() {
+        FrameTelemetry frame;
+        while (frames.pop(frame)) {
+            frameTimes.push_back(frame.seconds * 1000.f);
+            drawCalls = frame.drawCalls;
+            qualityLevel = frame.qualityLevel;
+        }
+        float tick;
+        while (ticks.pop(tick)) {
+            tickTimes.push_back(tick * 1000.f);
+        }
+        WorldTelemetry newest;
+        while (worlds.pop(newest)) {
+            world = newest;
+            hasWorld = true;
         }
-        sprite.setOrigin(texture.getSize().x / 2, texture.getSize().y / 2);
-        sprite.setPosition(position);
     }
 
-    void update(const sf::Vector2f& playerPosition, float deltaTime) {
-        float speed = 0.f;
-        switch (type) {
-        case EnemyType::Normal:
-            speed = 100.f;
-            break;
-        case EnemyType::Fast:
-            speed = 600.f;
-            break;
-        case EnemyType::Direct:
-            speed = 600.f;
-            break;
+    static float percentile(std::vector<float>& times, float fraction) {
+        if (times.empty()) {
+            return 0.f;
         }
+        size_t index = std::min(times.size() - 1, static_cast<size_t>(times.size() * fraction));
+        std::nth_element(times.begin(), times.begin() + index, times.end());
+        return times[index];
+    }
 
-        if (type != EnemyType::Direct) { // Check if enemy type is not Direct
-            // Move in the initial direction only
-            sprite.move(direction * speed * deltaTime);
+    static float mean(const std::vector<float>& times) {
+        float sum = 0.f;
+        for (float time : times) {
+            sum += time;
+        }
+        return times.empty() ? 0.f : sum / times.size();
+    }
+
+    std::string format() {
+        float frameP50 = percentile(frameTimes, 0.5f);
+        float frameP95 = percentile(frameTimes, 0.95f);
+        float frameP99 = percentile(frameTimes, 0.99f);
+        float frameMax = frameTimes.empty() ? 0.f : *std::max_element(frameTimes.begin(), frameTimes.end());
+        float tickMean = mean(tickTimes);
+        float tickP99 = percentile(tickTimes, 0.99f);
+        size_t rss = SoakMonitor::residentBytes();
+        std::uint64_t droppedRecords = dropped.load(std::memory_order_relaxed);
+        auto seconds = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+
+        std::ostringstream out;
+        if (options.format == TelemetryOptions::Format::JsonLines) {
+            out << "{\"time\":" << seconds << ",\"frames\":" << frameTimes.size() << ",\"frame_ms\":{\"p50\":" << frameP50 << ",\"p95\":" << frameP95
+                << ",\"p99\":" << frameP99 << ",\"max\":" << frameMax << "},\"ticks\":" << tickTimes.size() << ",\"tick_ms\":{\"mean\":" << tickMean
+                << ",\"p99\":" << tickP99 << "},\"draw_calls\":" << drawCalls << ",\"quality_level\":" << static_cast<int>(qualityLevel)
+                << ",\"rss_bytes\":" << rss << ",\"dropped\":" << droppedRecords;
+            if (hasWorld) {
+                out << ",\"score\":" << world.score << ",\"audio_voices\":" << world.audioVoices << ",\"sessions\":" << world.sessions
+                    << ",\"session_ticks\":" << world.sessionTicks << ",\"total_ticks\":" << world.totalTicks << ",\"containers\":{";
+                for (size_t i = 0; i < world.containerCount; ++i) {
+                    out << (i > 0 ? "," : "") << "\"" << world.containerNames[i] << "\":" << world.containerSizes[i];
+                }
+                out << "}";
+            }
+            out << "}\n";
         }
         else {
-            // Move directly towards the player
-            sf::Vector2f directionToPlayer = playerPosition - sprite.getPosition();
-            float length = std::sqrt(directionToPlayer.x * directionToPlayer.x + directionToPlayer.y * directionToPlayer.y);
-            directionToPlayer /= length; // Normalize the vector
-            sprite.move(directionToPlayer * speed * deltaTime);
+            auto gauge = [&](const char* name, const char* help) {
+                out << "# HELP bhaataphod_" << name << " " << help << "\n# TYPE bhaataphod_" << name << " gauge\n";
+            };
+            gauge("frame_time_ms", "Frame time over the last second");
+            out << "bhaataphod_frame_time_ms{quantile=\"0.5\"} " << frameP50 << "\n";
+            out << "bhaataphod_frame_time_ms{quantile=\"0.95\"} " << frameP95 << "\n";
+            out << "bhaataphod_frame_time_ms{quantile=\"0.99\"} " << frameP99 << "\n";
+            out << "bhaataphod_frame_time_ms{quantile=\"1\"} " << frameMax << "\n";
+            gauge("frames", "Frames drawn in the last second");
+            out << "bhaataphod_frames " << frameTimes.size() << "\n";
+            gauge("tick_time_ms", "Simulation tick time over the last second");
+            out << "bhaataphod_tick_time_ms{stat=\"mean\"} " << tickMean << "\n";
+            out << "bhaataphod_tick_time_ms{stat=\"p99\"} " << tickP99 << "\n";
+            gauge("draw_calls", "Draw calls in the newest frame");
+            out << "bhaataphod_draw_calls " << drawCalls << "\n";
+            gauge("quality_level", "Quality governor level, 0 is full quality");
+            out << "bhaataphod_quality_level " << static_cast<int>(qualityLevel) << "\n";
+            gauge("resident_bytes", "Resident set size");
+            out << "bhaataphod_resident_bytes " << rss << "\n";
+            out << "# HELP bhaataphod_telemetry_dropped_total Records dropped on a full queue\n# TYPE bhaataphod_telemetry_dropped_total counter\n";
+            out << "bhaataphod_telemetry_dropped_total " << droppedRecords << "\n";
+            if (hasWorld) {
+                gauge("score", "Score of the current session");
+                out << "bhaataphod_score " << world.score << "\n";
+                gauge("audio_voices", "Sounds playing");
+                out << "bhaataphod_audio_voices " << world.audioVoices << "\n";
+                gauge("session_ticks", "Ticks played in the current session");
+                out << "bhaataphod_session_ticks " << world.sessionTicks << "\n";
+                out << "# HELP bhaataphod_sessions_total Sessions started\n# TYPE bhaataphod_sessions_total counter\n";
+                out << "bhaataphod_sessions_total " << world.sessions << "\n";
+                out << "# HELP bhaataphod_ticks_total Ticks played in all sessions\n# TYPE bhaataphod_ticks_total counter\n";
+                out << "bhaataphod_ticks_total " << world.totalTicks << "\n";
+                gauge("container_size", "Live entries per world container");
+                for (size_t i = 0; i < world.containerCount; ++i) {
+                    out << "bhaataphod_container_size{container=\"" << world.containerNames[i] << "\"} " << world.containerSizes[i] << "\n";
+                }
+            }
         }
+        return out.str();
     }
 
-
-    void draw(sf::RenderWindow& window) const {
-        window.draw(sprite);
+    void write(const std::string& text) {
+        if (isSocket()) {
+            // Prometheus blocks end like an OpenMetrics exposition so a reader can split them
+            sendToSocket(options.format == TelemetryOptions::Format::Prometheus ? text + "# EOF\n" : text);
+        }
+        else if (options.format == TelemetryOptions::Format::Prometheus) {
+            // Replaced whole, as a node exporter textfile collector expects, so it is never read half-written
+            std::string temporary = options.target + ".tmp";
+            {
+                std::ofstream file(temporary, std::ios::trunc);
+                file << text;
+            }
+            std::error_code error;
+            std::filesystem::rename(temporary, options.target, error);
+        }
+        else {
+            appendToFile(text);
+        }
     }
 
-    sf::FloatRect getBounds() const {
-        return sprite.getGlobalBounds();
+    void appendToFile(const std::string& line) {
+        if (!file.is_open()) {
+            file.open(options.target, std::ios::app);
+            std::error_code error;
+            fileBytes = std::filesystem::exists(options.target, error) ? static_cast<size_t>(std::filesystem::file_size(options.target, error)) : 0;
+        }
+        if (fileBytes + line.size() > options.rotateBytes) {
+            file.close();
+            std::error_code error;
+            for (int i = options.keepFiles - 1; i >= 1; --i) {
+                std::filesystem::rename(options.target + "." + std::to_string(i), options.target + "." + std::to_string(i + 1), error);
+            }
+            std::filesystem::rename(options.target, options.target + ".1", error);
+            file.open(options.target, std::ios::trunc);
+            fileBytes = 0;
+        }
+        file << line;
+        file.flush();
+        fileBytes += line.size();
     }
 
-    sf::Vector2f getPosition() const {
-        return sprite.getPosition();
-    }
-    sf::Sprite getSprite() const {
-        return sprite;
+    // Connects on demand and drops the connection on any error, so a collector
+    // that restarts is picked up again on the next report
+    void sendToSocket(const std::string& text) {
+#if defined(__linux__)
+        if (socketHandle < 0) {
+            sockaddr_un address{};
+            address.sun_family = AF_UNIX;
+            std::string path = options.target.substr(5);
+            if (path.size() >= sizeof(address.sun_path)) {
+                return;
+            }
+            std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+            socketHandle = socket(AF_UNIX, SOCK_STREAM, 0);
+            if (socketHandle < 0) {
+                return;
+            }
+            if (connect(socketHandle, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+                closeSocket();
+                return;
+            }
+        }
+        size_t sent = 0;
+        while (sent < text.size()) {
+            ssize_t result = send(socketHandle, text.data() + sent, text.size() - sent, MSG_NOSIGNAL | MSG_DONTWAIT);
+            if (result <= 0) {
+                // A collector that stopped reading loses this report rather than stalling the next
+                closeSocket();
+                return;
+            }
+            sent += static_cast<size_t>(result);
+        }
+#else
+        (void)text;
+#endif
     }
-    EnemyType getType() const {
-        return type;
+
+    void closeSocket() {
+#if defined(__linux__)
+        if (socketHandle >= 0) {
+            close(socketHandle);
+            socketHandle = -1;
+        }
+#endif
     }
 
-private:
-    sf::Sprite sprite;
-    EnemyType type;
-    sf::Vector2f direction; // Store the initial direction
+    TelemetryOptions options;
+    std::thread thread;
+    std::atomic<bool> running{ false };
+    std::atomic<std::uint64_t> dropped{ 0 };
+    SpscQueue<FrameTelemetry, frameQueueSize> frames;
+    SpscQueue<float, tickQueueSize> ticks;
+    SpscQueue<WorldTelemetry, 8> worlds;
+
+    // Publisher thread only
+    std::vector<float> frameTimes; // Milliseconds, since the last report
+    std::vector<float> tickTimes;
+    std::uint32_t drawCalls = 0;
+    std::uint8_t qualityLevel = 0;
+    WorldTelemetry world{};
+    bool hasWorld = false;
+    std::ofstream file;
+    size_t fileBytes = 0;
+    int socketHandle = -1;
 };
 
-class Powerup {
+// Scripted player for unattended runs such as the PGO training build. It cycles
+// through phases so one run covers ordinary play, dense asteroid waves, UFO fights
+// and shockwaves, topping the world up through its load-test hooks where the
+// waves alone would take too long to get there.
+class Autoplay {
 public:
-    Powerup(const sf::Texture& texture, const sf::Vector2f& position) {
-		sprite.setTexture(texture);
-		sprite.setOrigin(texture.getSize().x / 2, texture.getSize().y / 2);
-		sprite.setPosition(position);
-	}
-
-    void draw(sf::RenderWindow& window) const {
-		window.draw(sprite);
-	}
+    explicit Autoplay(std::uint64_t seed) : observation(BP_OBSERVATION_FLOATS) {
+        rng.seed(seed, 7);
+    }
 
-    sf::FloatRect getBounds() const {
-		return sprite.getGlobalBounds();
-	}
+    PlayerInput next(World& world) {
+        size_t phaseTick = tick++ % cycleTicks;
+        if (phaseTick >= stormStart && phaseTick < fightStart && world.getEnemyCount() < stormAsteroids) {
+            world.spawnAsteroids(static_cast<int>(stormAsteroids - world.getEnemyCount()));
+        }
+        if (phaseTick >= fightStart && phaseTick < shockwaveStart && world.getUFOBossCount() < fightUFOs) {
+            world.spawnUFOs(static_cast<int>(fightUFOs - world.getUFOBossCount()));
+        }
 
-    sf::Vector2f getPosition() const {
-        return sprite.getPosition();
+        PlayerInput input;
+        int count = world.observe(observation.data());
+        sf::Vector2f ship(observation[4], observation[5]);
+        input.aim = ship + sf::Vector2f(static_cast<float>(rng() % 200) - 100.f, static_cast<float>(rng() % 200) - 100.f);
+        // Aim at the nearest asteroid or UFO; the observation is sorted nearest first
+        for (int i = 0; i < count; ++i) {
+            const float* slot = &observation[BP_OBSERVATION_HEADER_FLOATS + i * BP_OBSERVATION_ENTITY_FLOATS];
+            if (slot[0] < static_cast<float>(BP_KIND_UFO_BULLET)) {
+                input.aim = sf::Vector2f(slot[1], slot[2]);
+                sf::Vector2f delta = input.aim - ship;
+                input.thrust = delta.x * delta.x + delta.y * delta.y > 400.f * 400.f;
+                break;
+            }
+        }
+        // The world only fires on a fresh press, so tap the trigger
+        input.fire = phaseTick % 12 < 6;
+        if (phaseTick >= shockwaveStart && phaseTick % shockwaveInterval == 0) {
+            world.addShockwaves(1);
+            input.shockwave = true;
+        }
+        return input;
     }
 
 private:
-    sf::Sprite sprite;
+    // One cycle is a minute of ticks: calm, storm, UFO fight, then shockwaves
+    static constexpr size_t cycleTicks = 3600;
+    static constexpr size_t stormStart = 600;
+    static constexpr size_t fightStart = 1800;
+    static constexpr size_t shockwaveStart = 3000;
+    static constexpr size_t shockwaveInterval = 90;
+    static constexpr size_t stormAsteroids = 300;
+    static constexpr size_t fightUFOs = 6;
+
+    Pcg32 rng;
+    size_t tick = 0;
+    std::vector<float> observation;
 };
 
-
 class Game {
 public:
-    Game() : window(sf::VideoMode::getDesktopMode(), "Bhaata Phod", sf::Style::Fullscreen), score(0), isPaused(false), isStarted(false), isGameOver(false),
-        health(fullHeartTexture, halfHeartTexture, 5) { // Initialize the Health instance
-        window.setFramerateLimit(60);
-
-        if (!playerTextureIdle.loadFromFile("Materials/spaceship-nofire.png") ||
-            !playerTextureThrusting.loadFromFile("Materials/spaceship.png") ||
-            !projectileTexture.loadFromFile("Materials/bullet.png") ||
-            !UFOBulletTexture.loadFromFile("Materials/UFOBullet.png") ||
-            !enemyTexture.loadFromFile("Materials/asteroid.png") ||
-            !powerUpTexture.loadFromFile("Materials/powerup.png") ||
+    // `worldSize` defaults to one screen; anything bigger scrolls with the player.
+    // `unattended` runs (autoplay, soak) never wait on a keypress: a missing asset exits with -1.
+    explicit Game(const std::string& recordPrefix = "", const NetOptions& net = NetOptions(), const sf::Vector2u& logicalSize = sf::Vector2u(1920, 1080),
+        const sf::Vector2u& worldSize = sf::Vector2u(), bool unattended = false)
+        : isStarted(false), window(sf::VideoMode::getDesktopMode(), "Bhaata Phod", sf::Style::Fullscreen), logicalSize(logicalSize),
+        isPaused(false), recordPrefix(recordPrefix), sessionSeed(std::random_device{}()) {
+        // Presentation follows the display; the simulation keeps its own 60 Hz tick
+        window.setVerticalSyncEnabled(true);
+
+        // Menus, HUD and mouse input all work in logical coordinates from here on
+        presentView = letterboxView(window.getSize());
+        window.setView(presentView);
+        // The window keeps this size for the whole session, so the mapping can be worked out once
+        sf::FloatRect viewport = presentView.getViewport();
+        sf::Vector2u windowSize = window.getSize();
+        presentPixels = sf::FloatRect(static_cast<float>(static_cast<int>(0.5f + windowSize.x * viewport.left)), static_cast<float>(static_cast<int>(0.5f + windowSize.y * viewport.top)),
+            static_cast<float>(static_cast<int>(0.5f + windowSize.x * viewport.width)), static_cast<float>(static_cast<int>(0.5f + windowSize.y * viewport.height)));
+        presentInverse = presentView.getInverseTransform();
+        windowOrigin.store(window.getPosition(), std::memory_order_relaxed);
+        if (!sceneTarget.create(logicalSize.x, logicalSize.y)) {
+            std::cerr << "Error creating the scene render target" << std::endl;
+            exit(-1);
+        }
+        sceneTarget.setSmooth(true);
+        // Only the render thread draws into the scene target
+        sceneTarget.setActive(false);
+
+        // Screen pixels across the letterboxed logical space, which picks the asset tiers
+        float presentWidth = presentView.getViewport().width * window.getSize().x;
+
+        if (!worldTextures.loadFromFiles(presentWidth / logicalSize.x) ||
             !powerUpTexture1.loadFromFile("Materials/powerup1.png") ||
-            !explosionTexture.loadFromFile("Materials/explosion.png") ||
-            !shockwaveTexture.loadFromFile("Materials/shockwave.png") ||
-            !fullHeartTexture.loadFromFile("Materials/full_heart.png") ||
-            !halfHeartTexture.loadFromFile("Materials/half_heart.png") ||
             !shootbuffer.loadFromFile("Materials/LASER.wav") ||
-            !mainmenubuffer.loadFromFile("Materials/TitleMenu.wav") ||
-            !gameloopbuffer.loadFromFile("Materials/GameLoop.wav") ||
+            !thrustbuffer.loadFromFile("Materials/thrust.wav") ||
             !explosionbuffer.loadFromFile("Materials/explosion.wav") ||
             !shockwavebuffer.loadFromFile("Materials/shockwave.wav") ||
-            !enemy2Texture.loadFromFile("Materials/BOMB.png") ||
-            !backgroundTexture.loadFromFile("Materials/mainbackground.png") ||
-            !creditsTexture.loadFromFile("Materials/credits.png") ||
+            !backgroundTexture.loadFromFile(AssetTiers::resolveForWidth("mainbackground.png", presentWidth)) ||
+            !creditsTexture.loadFromFile(AssetTiers::resolveForWidth("credits.png", presentWidth)) ||
             !CreditButtonTexture.loadFromFile("Materials/creditbutton.png") ||
             !startButtonTexture.loadFromFile("Materials/startbutton.png") ||
-            !ruleTexture.loadFromFile("Materials/rules.png") ||
-            !medkitTexture.loadFromFile("Materials/MedKit.png") ||
-            !UFOtexture.loadFromFile("Materials/UFO.png") ||
+            !ruleTexture.loadFromFile(AssetTiers::resolveForWidth("rules.png", presentWidth)) ||
             !exitButtonTexture.loadFromFile("Materials/exitbutton.png") ||
-            !credits.loadFromFile("Materials/Credits.wav") ||
             !UFOBattlebuffer.loadFromFile("Materials/UFO Battle.wav")) {
             std::cerr << "Error loading resources from file" << std::endl;
+            if (unattended) {
+                exit(-1);
+            }
             //open a error window
             sf::RenderWindow errorwindow(sf::VideoMode(800, 600), "Error", sf::Style::Default);
             if (!font.loadFromFile("Materials/NES.ttf")) {
@@ -510,108 +5262,106 @@ public:
         }
         shoot.setBuffer(shootbuffer);
         explosion.setBuffer(explosionbuffer);
-        mainmenu.setBuffer(mainmenubuffer);
-        gameloop.setBuffer(gameloopbuffer);
+        // Music is optional: the release does not ship every track, and the game plays fine without them
+        for (auto [buffer, sound, file] : { std::tuple(&mainmenubuffer, &mainmenu, "Materials/TitleMenu.wav"),
+                std::tuple(&gameloopbuffer, &gameloop, "Materials/GameLoop.wav"), std::tuple(&credits, &creditsmusic, "Materials/Credits.wav") }) {
+            if (buffer->loadFromFile(file)) {
+                sound->setBuffer(*buffer);
+            }
+            else {
+                std::cerr << "Music " << file << " not found, continuing without it" << std::endl;
+            }
+        }
         shockwavesound.setBuffer(shockwavebuffer);
-        creditsmusic.setBuffer(credits);
         UFOBattle.setBuffer(UFOBattlebuffer);
+        thrustsound.setBuffer(thrustbuffer);
 
         //loop the game loop sound
 
-        player = std::make_unique<Player>(playerTextureIdle, playerTextureThrusting, sf::Vector2f(window.getSize().x / 2, window.getSize().y / 2), window.getSize());
-        spawnInitialEnemies(10); // Adjust the number of initial enemies as needed
+        world = std::make_unique<World>(worldTextures, worldSize.x > 0 && worldSize.y > 0 ? worldSize : logicalSize, jobs, sessionSeed, logicalSize);
+
+        // Both cabinets need the same logical resolution: the client draws in the host's world coordinates
+        if (net.mode == NetOptions::Mode::Host) {
+            netHost = std::make_unique<NetHost>();
+            if (!netHost->start(net.port, net.conditions)) {
+                exit(-1);
+            }
+            world->setCoop(true);
+            world->reset(sessionSeed);
+        }
+        else if (net.mode == NetOptions::Mode::Client) {
+            netClient = std::make_unique<NetClient>(worldTextures);
+            if (!netClient->connect(sf::IpAddress(net.hostAddress), net.port, net.conditions)) {
+                exit(-1);
+            }
+        }
     }
 
+    // The menu is the outermost loop. Sessions run from here and return here when
+    // they end, so the stack is as deep after a week of play as after one game.
     void mainScreen() {
-        TextureSize = backgroundTexture.getSize(); //Get size of texture.
-
-        //Set WindowsSize to the size of the desktop screen.
-        WindowSize = sf::Vector2u(sf::VideoMode::getDesktopMode().width, sf::VideoMode::getDesktopMode().height);
-
-        float ScaleX = (float)WindowSize.x / TextureSize.x;
-        float ScaleY = (float)WindowSize.y / TextureSize.y;     //Calculate scale.
-
-        backgroundSprite.setTexture(backgroundTexture);
-        backgroundSprite.setScale(ScaleX, ScaleY);      //Set scale. 
-        backgroundSprite.setTexture(backgroundTexture);
-        startButtonSprite.setTexture(startButtonTexture);
-        exitButtonSprite.setTexture(exitButtonTexture);
-        creditbuttonSprite.setTexture(CreditButtonTexture);
-
-        // Set the position of buttons
-        startButtonSprite.setPosition(1200.f - (603.f / 2.f), 1100.f - (385.f / 2.f)); // Adjust position as needed
-        exitButtonSprite.setPosition(1200.f - (339.f / 2.f), 1400.f - (223.f / 2.f));  // Adjust position as needed
-        // Set the position of the credit button to the bottom right
-        creditbuttonSprite.setPosition(1800.f, 1200.f);  // Adjust position as needed
-        
+        layoutMenu();
 
-        window.clear();
-        window.draw(backgroundSprite);
-        window.draw(startButtonSprite);
-        window.draw(exitButtonSprite);
-        window.draw(creditbuttonSprite);
-        window.display();
-        mainmenu.setLoop(true);
-        mainmenu.play();
+        while (window.isOpen()) {
+            window.clear();
+            window.draw(backgroundSprite);
+            window.draw(startButtonSprite);
+            window.draw(exitButtonSprite);
+            window.draw(creditbuttonSprite);
+            window.display();
+            mainmenu.setLoop(true);
+            mainmenu.play();
 
-        while (window.isOpen() && !isStarted) {
-            sf::Event event;
+            bool leftMenu = false;
+            while (window.isOpen() && !leftMenu) {
+                sf::Event event;
 
-            while (window.pollEvent(event)) {
-                if (event.type == sf::Event::Closed) {
-                    window.close();
-                }
+                while (!leftMenu && window.pollEvent(event)) {
+                    if (event.type == sf::Event::Closed) {
+                        window.close();
+                    }
 
-                if (event.type == sf::Event::Resized) {
-                    window.setSize(sf::Vector2u(sf::VideoMode::getDesktopMode().width, sf::VideoMode::getDesktopMode().height));
-                }
+                    if (event.type == sf::Event::Resized) {
+                        window.setSize(sf::Vector2u(sf::VideoMode::getDesktopMode().width, sf::VideoMode::getDesktopMode().height));
+                    }
 
-                // Handle button clicks
-                if (event.type == sf::Event::MouseButtonPressed) {
-                    if (event.mouseButton.button == sf::Mouse::Left) {
-                        if (startButtonSprite.getGlobalBounds().contains(event.mouseButton.x, event.mouseButton.y)) {
-                            // Start the game
-                            mainmenu.stop();
-                            // show the rule and control screen
-                            window.clear();
-                            
-                            ruleSprite.setTexture(ruleTexture);
-                            ruleSprite.setScale(ScaleX, ScaleY);
-                            window.draw(ruleSprite);
-
-                            window.display();
-                            //wait here till a input
-                            while (true) {
-                                if (sf::Keyboard::isKeyPressed(sf::Keyboard::Space)) {
-                                    isStarted = true;
-                                    window.clear();
-                                    run();
-                                    break;
+                    // Handle button clicks
+                    if (event.type == sf::Event::MouseButtonPressed) {
+                        sf::Vector2f click = window.mapPixelToCoords(sf::Vector2i(event.mouseButton.x, event.mouseButton.y));
+                        if (event.mouseButton.button == sf::Mouse::Left) {
+                            if (startButtonSprite.getGlobalBounds().contains(click)) {
+                                // Start the game
+                                mainmenu.stop();
+                                // show the rule and control screen
+                                window.clear();
+                                window.draw(ruleSprite);
+                                window.display();
+                                //wait here till a input
+                                while (!sf::Keyboard::isKeyPressed(sf::Keyboard::Space)) {
                                 }
+                                isStarted = true;
+                                window.clear();
+                                run();
+                                endSession();
+                                leftMenu = true;
+                            }
+                            else if (exitButtonSprite.getGlobalBounds().contains(click)) {
+                                window.close();
+                            }
+                            else if (creditbuttonSprite.getGlobalBounds().contains(click)) {
+                                //show the credits
+                                mainmenu.stop();
+                                creditsmusic.setLoop(true);
+                                creditsmusic.play();
+                                window.clear();
+                                window.draw(creditsSprite);
+                                window.display();
+                                while (!sf::Keyboard::isKeyPressed(sf::Keyboard::Space)) {
+                                }
+                                creditsmusic.stop();
+                                window.clear();
+                                leftMenu = true;
                             }
-                        }
-                        else if (exitButtonSprite.getGlobalBounds().contains(event.mouseButton.x, event.mouseButton.y)) {
-                            window.close();
-                        }
-                        else if (creditbuttonSprite.getGlobalBounds().contains(event.mouseButton.x, event.mouseButton.y)) {
-                            //show the credits
-                            mainmenu.stop();
-                            creditsmusic.setLoop(true);
-							creditsmusic.play();
-							window.clear();
-							creditsSprite.setTexture(creditsTexture);
-							creditsSprite.setScale(ScaleX, ScaleY);
-							window.draw(creditsSprite);
-							window.display();
-                            while (true) {
-                                if (sf::Keyboard::isKeyPressed(sf::Keyboard::Space)) {
-                                    creditsmusic.stop();
-									window.clear();
-									mainScreen();
-									break;
-								}
-							}
-						
                         }
                     }
                 }
@@ -620,66 +5370,147 @@ public:
     }
 
 
+    // Scripted session for the PGO training run: shows each menu screen for a few
+    // frames, then plays `ticks` ticks of Autoplay input at full speed
+    void autoplay(size_t ticks) {
+        layoutMenu();
+        window.setFramerateLimit(0);
+        window.setVerticalSyncEnabled(false);
+        for (int frame = 0; frame < 90; ++frame) {
+            window.clear();
+            if (frame < 30) {
+                window.draw(backgroundSprite);
+                window.draw(startButtonSprite);
+                window.draw(exitButtonSprite);
+                window.draw(creditbuttonSprite);
+            }
+            else {
+                window.draw(frame < 60 ? ruleSprite : creditsSprite);
+            }
+            window.display();
+        }
+        playScripted(ticks, 0);
+        window.close();
+    }
+
+    // Unattended leak hunt: the bot plays session after session at full speed,
+    // taking a sample every simulated minute. Returns 1 if anything kept growing.
+    int soak(size_t minutes, double allowedGrowth) {
+        char stackTop;
+        soakStackTop = &stackTop;
+        SoakMonitor monitor(allowedGrowth);
+        soakMonitor = &monitor;
+        window.setFramerateLimit(0);
+        window.setVerticalSyncEnabled(false);
+        playScripted(minutes * ticksPerMinute, soakSessionTicks);
+        soakMonitor = nullptr;
+        window.close();
+        return monitor.report(std::cout) ? 0 : 1;
+    }
+
+    // Starts publishing live metrics. False if the target cannot be used here.
+    bool enableTelemetry(const TelemetryOptions& options) {
+        telemetry = std::make_unique<TelemetryPublisher>(options);
+        if (!telemetry->start()) {
+            telemetry.reset();
+            return false;
+        }
+        return true;
+    }
+
     void run() {
         sf::Clock clock;
+        sf::Clock tickClock;
         gameloop.setLoop(true);
         gameloop.play();
+        // Co-op sessions depend on the other cabinet's input, so they are never recorded
+        if (!recordPrefix.empty() && !netHost && !netClient) {
+            recorder.begin(recordPrefix + "-" + std::to_string(++sessionIndex) + ".bprl", sessionSeed, world->getSize(), logicalSize);
+        }
+        inputLayer.reset(sf::Mouse::getPosition(window));
+        pendingInputTime = -1;
+        pressLatency.clear();
+        aimLatency.clear();
+        startRenderThread();
+        size_t sessionTicks = 0;
+        ++sessionsStarted;
+        telemetrySessionTicks = 0;
         while (window.isOpen()) {
-            float deltaTime = clock.restart().asSeconds();
+            // Scripted runs step a fixed tick so every training run does the same work
+            float deltaTime = autoplayer ? tickDuration.asSeconds() : clock.restart().asSeconds();
+            if (autoplayer) {
+                if (autoplayTicksLeft == 0 || (autoplaySessionTicks > 0 && sessionTicks == autoplaySessionTicks)) {
+                    break;
+                }
+                --autoplayTicksLeft;
+                ++sessionTicks;
+            }
             processEvents();
             if (!isPaused) {
+                ++telemetrySessionTicks;
+                ++telemetryTotalTicks;
+                HeapCalls::counted = true;
                 update(deltaTime);
-                render();
+                bool over = isSessionOver();
+                if (!over) {
+                    publishSnapshot();
+                }
+                HeapCalls::counted = false;
+                if (over) {
+                    break;
+                }
             }
             else {
+                publishSnapshot();
+                // Back to the menu
                 if (sf::Keyboard::isKeyPressed(sf::Keyboard::Space)) {
-                    gameloop.stop();
-                    window.clear();
-                    reset();
-                    mainScreen();
+                    break;
                 }
             }
 
-            if (isGameOver) {
-                gameloop.stop();
-                break;
+            // The render thread paces presentation, so the simulation paces itself
+            sf::Time elapsed = tickClock.restart();
+            if (telemetry) {
+                telemetry->addTick(elapsed.asSeconds());
+                if (telemetryClock.getElapsedTime() >= sf::seconds(1.f)) {
+                    telemetryClock.restart();
+                    publishWorldTelemetry();
+                }
             }
-        }
-    }
-
-    void spawnInitialEnemies(int count) {
-        for (int i = 0; i < count; ++i) {
-            sf::Vector2f position;
-            switch (rand() % 4) {
-            case 0: // Left edge
-                position = sf::Vector2f(0, rand() % window.getSize().y);
-                break;
-            case 1: // Right edge
-                position = sf::Vector2f(window.getSize().x, rand() % window.getSize().y);
-                break;
-            case 2: // Top edge
-                position = sf::Vector2f(rand() % window.getSize().x, 0);
-                break;
-            case 3: // Bottom edge
-                position = sf::Vector2f(rand() % window.getSize().x, window.getSize().y);
-                break;
+            if (soakMonitor) {
+                soakMonitor->addTickTime(elapsed.asSeconds());
+                if (++soakTicks % ticksPerMinute == 0) {
+                    sampleSoak();
+                }
             }
-
-            float angle = static_cast<float>(rand() % 360);
-            sf::Vector2f directionToPlayer(std::cos(angle * 3.14159265 / 180), std::sin(angle * 3.14159265 / 180));
-
-            enemies.push_back(Enemy(enemyTexture, enemy2Texture, position, directionToPlayer, EnemyType::Normal));
+            if (elapsed < tickDuration && !autoplayer) {
+                sf::sleep(tickDuration - elapsed);
+                tickClock.restart();
+            }
+        }
+        recorder.end(world->checksum());
+        // Menus draw on this thread, so take the window back first
+        stopRenderThread();
+        if (!autoplayer) {
+            pressLatency.report(std::cout, "press-to-photon");
+            aimLatency.report(std::cout, "aim-to-photon");
+            quality.report(std::cout);
+        }
+        if (isSessionOver() && !autoplayer) {
+            showGameOver();
         }
     }
 
 
 private:
-    sf::SoundBuffer shootbuffer, explosionbuffer, mainmenubuffer, gameloopbuffer, shockwavebuffer, credits, UFOBattlebuffer;
-    sf::Sound shoot, explosion, mainmenu, gameloop, shockwavesound, creditsmusic, UFOBattle;
-    bool isGameOver;
+    bool isSessionOver() const {
+        return netClient ? netClient->isOver() : world->isOver();
+    }
+
+    sf::SoundBuffer shootbuffer, explosionbuffer, mainmenubuffer, gameloopbuffer, shockwavebuffer, credits, UFOBattlebuffer, thrustbuffer;
+    sf::Sound shoot, explosion, mainmenu, gameloop, shockwavesound, creditsmusic, UFOBattle, thrustsound;
     bool isStarted;
     bool MusicisPaused = false;
-    Health health;
     sf::Font font;
     sf::Text gameOverText;
     sf::Text scoreText;
@@ -700,68 +5531,86 @@ private:
     sf::Sprite ruleSprite;
     sf::Texture ruleTexture;
     sf::Vector2u TextureSize;  //Added to store texture size.
-    sf::Vector2u WindowSize;   //Added to store window size.
     
 
 
     bool textintialized = false;
 
     void reset() {
-        score = 0;
-        //reset the posiiton of the player
-        player->setPosition(sf::Vector2f(window.getSize().x / 2, window.getSize().y / 2));
         isPaused = false;
         isStarted = false;
-        isGameOver = false;
-        health.resetHealth();
-        projectiles.clear();
-        enemies.clear();
-        animations.clear();
-        poweranimations.clear();
-        powerupvector.clear();
-        medkitvector.clear();
-        UFO_Bosses.clear();
-        UFO_Bullets.clear();
-        spawnInitialEnemies(10);
+        shockwaveRequested = false;
+        rewindRequested = false;
+        history.clear();
+        sessionSeed = std::random_device{}();
+        world->reset(sessionSeed);
+    }
+
+
+    // Sizes and places the menu, rule and credit screens for the logical resolution
+    void layoutMenu() {
+        TextureSize = backgroundTexture.getSize(); //Get size of texture.
+
+        float ScaleX = (float)logicalSize.x / TextureSize.x;
+        float ScaleY = (float)logicalSize.y / TextureSize.y;     //Calculate scale.
+
+        backgroundSprite.setTexture(backgroundTexture);
+        backgroundSprite.setScale(ScaleX, ScaleY);      //Set scale. 
+        backgroundSprite.setTexture(backgroundTexture);
+        startButtonSprite.setTexture(startButtonTexture);
+        exitButtonSprite.setTexture(exitButtonTexture);
+        creditbuttonSprite.setTexture(CreditButtonTexture);
+
+        // The menu was laid out on a 2560x1600 screen, so map those positions into logical space
+        sf::Vector2f menuScale(logicalSize.x / 2560.f, logicalSize.y / 1600.f);
+        float buttonScale = std::min(menuScale.x, menuScale.y);
+        startButtonSprite.setScale(buttonScale, buttonScale);
+        exitButtonSprite.setScale(buttonScale, buttonScale);
+        creditbuttonSprite.setScale(buttonScale, buttonScale);
+
+        // Set the position of buttons
+        startButtonSprite.setPosition(1200.f * menuScale.x - (603.f / 2.f) * buttonScale, 1100.f * menuScale.y - (385.f / 2.f) * buttonScale);
+        exitButtonSprite.setPosition(1200.f * menuScale.x - (339.f / 2.f) * buttonScale, 1400.f * menuScale.y - (223.f / 2.f) * buttonScale);
+        // Set the position of the credit button to the bottom right
+        creditbuttonSprite.setPosition(1800.f * menuScale.x, 1200.f * menuScale.y);
+
+        // Rule and credit screens fill the logical space like the background
+        ruleSprite.setTexture(ruleTexture);
+        ruleSprite.setScale(ScaleX, ScaleY);
+        creditsSprite.setTexture(creditsTexture);
+        creditsSprite.setScale(ScaleX, ScaleY);
     }
 
+    // window.mapPixelToCoords(pixel, presentView), from the session's fixed copy
+    sf::Vector2f presentPixelToCoords(const sf::Vector2i& pixel) const {
+        sf::Vector2f normalized(-1.f + 2.f * (pixel.x - presentPixels.left) / presentPixels.width, 1.f - 2.f * (pixel.y - presentPixels.top) / presentPixels.height);
+        return presentInverse.transformPoint(normalized);
+    }
 
     void processEvents() {
         sf::Event event;
         while (window.pollEvent(event)) {
+            inputLayer.push(event, inputClock.getElapsedTime().asMicroseconds());
             if (event.type == sf::Event::Closed) {
                 window.close();
             }
-            if (event.type == sf::Event::Resized) {
-                window.setSize(sf::Vector2u(sf::VideoMode::getDesktopMode().width, sf::VideoMode::getDesktopMode().height));
-            }
+            // No setSize on Resized here: the render thread is drawing into the window,
+            // and it stays fullscreen at the desktop size anyway
             if (event.type == sf::Event::KeyPressed && isStarted) {
                 if (event.key.code == sf::Keyboard::Escape) {
+                    // The pause overlay is drawn by the render thread from the snapshot
                     isPaused = !isPaused;
-                    if (isPaused) {
-                        // Display pause text
-                        pauseText.setString("Game Paused");
-                        pauseText.setFillColor(sf::Color::White);
-                        pauseText.setPosition(window.getSize().x / 2 - pauseText.getLocalBounds().width / 2, window.getSize().y / 2 - pauseText.getLocalBounds().height / 2);
-                        //give exit option
-                        exitText.setString("Press Space to Exit");
-                        exitText.setFillColor(sf::Color::White);
-                        exitText.setPosition(window.getSize().x / 2 - exitText.getLocalBounds().width / 2, window.getSize().y / 2 - exitText.getLocalBounds().height / 2 + 100);
-                        window.display();
-                        window.draw(pauseText);
-                        window.draw(exitText);
-                        window.display();
-                    }
                 }
-                if (event.key.code == sf::Keyboard::Numpad0 && (shockwavecount > 0)) {
-                    Animation shockwave(shockwaveTexture, 864, 864, 7, 0.075f);
-                    shockwave.setPosition(player->getPosition());
-                    shockwavesound.play();
-                    poweranimations.push_back(shockwave);
-                    shockwavecount--;
+                if (event.key.code == sf::Keyboard::Numpad0) {
+                    // Fired by the world on the next update if a shockwave is left
+                    shockwaveRequested = true;
+                }
+                if (event.key.code == sf::Keyboard::BackSpace) {
+                    rewindRequested = true;
                 }
             }
         }
+        windowOrigin.store(window.getPosition(), std::memory_order_relaxed);
     }
 
 
@@ -778,541 +5627,1078 @@ private:
                 exitText.setFont(font);
                 medkitText.setFont(font);
                 shockwavecountText.setFont(font);
+
+                // Pause text
+                pauseText.setString("Game Paused");
+                pauseText.setFillColor(sf::Color::White);
+                pauseText.setPosition(logicalSize.x / 2 - pauseText.getLocalBounds().width / 2, logicalSize.y / 2 - pauseText.getLocalBounds().height / 2);
+                //give exit option
+                exitText.setString("Press Space to Exit");
+                exitText.setFillColor(sf::Color::White);
+                exitText.setPosition(logicalSize.x / 2 - exitText.getLocalBounds().width / 2, logicalSize.y / 2 - exitText.getLocalBounds().height / 2 + 100);
                 textintialized = true;
             }
         }
 
-        if (UFO_Bosses.size() > 0 && !MusicisPaused) {
+        if (world->getUFOBossCount() > 0 && !MusicisPaused) {
             gameloop.pause();
             MusicisPaused = true;
             UFOBattle.play();
 		}
-        else if (UFO_Bosses.size() == 0 && MusicisPaused) {
+        else if (world->getUFOBossCount() == 0 && MusicisPaused) {
 			MusicisPaused = false;
             UFOBattle.stop();
 			gameloop.play();
 		}
 
 
-        if (!isGameOver) {
+        if (!isSessionOver()) {
             gameOverText.setString("Game Over");
             gameOverText.setCharacterSize(100);
             gameOverText.setFillColor(sf::Color::White);
-            gameOverText.setPosition(window.getSize().x / 2 - gameOverText.getLocalBounds().width / 2, window.getSize().y / 2 - gameOverText.getLocalBounds().height / 2);
+            gameOverText.setPosition(logicalSize.x / 2 - gameOverText.getLocalBounds().width / 2, logicalSize.y / 2 - gameOverText.getLocalBounds().height / 2);
         }
 
 
-        if (health.getCurrentHearts() <= 0) {
-            isGameOver = true;
+        PlayerInput input;
+        if (autoplayer) {
+            input = autoplayer->next(*world);
         }
-
-        if (isGameOver) {
-            // Clear all game elements
-            projectiles.clear();
-            enemies.clear();
-            animations.clear();
-            return; // Skip updating the rest of the game elements
+        else {
+            InputLayer::Tick tick = inputLayer.nextTick();
+            input.aim = presentPixelToCoords(tick.mouse);
+            if (!netClient) {
+                // The mouse is in screen space; the camera says where that screen is in the world
+                input.aim += sf::Vector2f(world->getCamera().left, world->getCamera().top);
+            }
+            input.thrust = tick.thrust;
+            input.fire = tick.fire;
+            input.shockwave = shockwaveRequested;
+            if (tick.stamp >= 0 && pendingInputTime < 0) {
+                pendingInputTime = tick.stamp;
+            }
+        }
+        shockwaveRequested = false;
+        // Mapped through a scaled view and offset by the camera, the aim is fractional.
+        // Input logs and the co-op stream only carry whole pixels, so the world only
+        // ever sees those, or a replay would steer differently from the recorded session.
+        input.aim = InputLog::wholeAim(input.aim);
+
+        // The client only predicts its own ship; the host runs everything else
+        if (netClient) {
+            netClient->sendInput(input);
+            netClient->poll();
+            playEvents(netClient->takeEvents(), netClient->isThrusting());
+            return;
         }
 
-        sf::Vector2i mousePosition = sf::Mouse::getPosition(window);
-        player->updateRotation(static_cast<sf::Vector2f>(mousePosition));
-        player->update(deltaTime);
+        PlayerInput partnerInput;
+        if (netHost) {
+            netHost->poll();
+            partnerInput = netHost->nextInput();
+        }
 
-        for (size_t i = 0; i < projectiles.size(); ++i) {
-            //remove the Normal Bullets that are out of bounds
-            sf::Vector2f position = projectiles[i].getPosition();
-            if (position.x < 0 || position.x > WindowSize.x || position.y < 0 || position.y > WindowSize.y) {
-                projectiles.erase(projectiles.begin() + i);
-                --i;
-            }
+        // A rewound session no longer matches its input log, so rewinding is off while recording
+        if (rewindRequested && !recorder.isRecording() && history.rewind(rewindTicks, stateBuffer)) {
+            world->loadState(stateBuffer);
+        }
+        rewindRequested = false;
+
+        recorder.record(deltaTime, input);
+        // A replay has no record of the budget, so a recorded session spawns at the file's rates
+        world->setSpawnBudgetScale(recorder.isRecording() ? 1.f : spawnBudgetScale);
+        // Likewise the LOD interval, which changes when far entities move
+        const QualityLevel& settings = QualityGovernor::level(qualityLevel.load(std::memory_order_relaxed));
+        world->setFarUpdateInterval(recorder.isRecording() ? QualityGovernor::level(0).farUpdateInterval : settings.farUpdateInterval);
+        simClock.restart();
+        world->update(deltaTime, input, partnerInput);
+        adjustSpawnBudget(simClock.getElapsedTime().asSeconds());
+        effectsPending = true;
+        world->saveState(stateBuffer);
+        history.push(stateBuffer);
+        if (netHost) {
+            netHost->sendState(*world);
         }
 
-        for (auto& UFO_Boss : UFO_Bosses) {
-			UFO_Boss.update(player->getPosition(), deltaTime);
-		}
+        playEvents(world->getEvents(), world->isPlayerThrusting());
+    }
 
-        for (auto& projectile : projectiles) {
-            projectile.update(deltaTime);
+    // Most important first, so a voice cap drops the thrust before the shockwave
+    void playEvents(const WorldEvents& events, bool thrusting) {
+        int maxSounds = QualityGovernor::level(qualityLevel.load(std::memory_order_relaxed)).maxSounds;
+        int voices = 0;
+        for (const sf::Sound* sound : { &shockwavesound, &explosion, &shoot, &thrustsound }) {
+            voices += sound->getStatus() == sf::Sound::Playing;
         }
-
-        for (auto& enemy : enemies) {
-            enemy.update(player->getPosition(), deltaTime);
+        // Restarting a sound that is already playing takes no extra voice
+        auto play = [&](sf::Sound& sound) {
+            bool playing = sound.getStatus() == sf::Sound::Playing;
+            if (playing || voices < maxSounds) {
+                voices += !playing;
+                sound.play();
+            }
+        };
+        if (events.shockwave) {
+            play(shockwavesound);
+        }
+        if (events.explosion) {
+            play(explosion);
+        }
+        if (events.shot) {
+            play(shoot);
         }
+        if (thrusting) {
+            play(thrustsound);
+        }
+    }
 
-        // Check for collisions and create animations
-        checkCollisions();
 
-        // Update animations
-        for (size_t i = 0; i < animations.size(); ++i) {
-            animations[i].update(deltaTime);
-            if (animations[i].isFinished()) {
-                animations.erase(animations.begin() + i);
-                --i;
-            }
+    // Logical screen area, which the menus and HUD are laid out in
+    sf::FloatRect getViewBounds() const {
+        return sf::FloatRect(0.f, 0.f, static_cast<float>(logicalSize.x), static_cast<float>(logicalSize.y));
+    }
+
+    // Logical space at the largest size that fits the window without stretching, with bars on the other axis
+    sf::View letterboxView(const sf::Vector2u& windowSize) const {
+        sf::View view(getViewBounds());
+        float windowAspect = static_cast<float>(windowSize.x) / windowSize.y;
+        float logicalAspect = static_cast<float>(logicalSize.x) / logicalSize.y;
+        if (windowAspect > logicalAspect) {
+            float width = logicalAspect / windowAspect;
+            view.setViewport(sf::FloatRect((1.f - width) / 2.f, 0.f, width, 1.f));
+        }
+        else {
+            float height = windowAspect / logicalAspect;
+            view.setViewport(sf::FloatRect(0.f, (1.f - height) / 2.f, 1.f, height));
         }
+        return view;
+    }
 
-        for (size_t i = 0; i < poweranimations.size(); ++i) {
-			poweranimations[i].update(deltaTime);
-            if (poweranimations[i].isFinished()) {
-				poweranimations.erase(poweranimations.begin() + i);
-				--i;
-			}
-		}
+    void showGameOver() {
+        window.clear();
+        window.draw(gameOverText);
+        scoreText.setString("Score: " + std::to_string(netClient ? netClient->getScore() : world->getScore()));
+        shownScore = -1; // The next session's HUD lays the score out again
+        scoreText.setCharacterSize(45);
+        scoreText.setPosition(logicalSize.x / 2.f - scoreText.getLocalBounds().width / 2.f, logicalSize.y / 2.f - scoreText.getLocalBounds().height + 250.f / 2.f);
+        window.draw(scoreText);
+        window.display();
+        //wait 2 sec without clock
+        sf::sleep(sf::seconds(5));
+    }
 
-        // Spawn medkit 
-        if (medspawn == true && score != 0) {
-			sf::Vector2f position;
-            //position at a random location
-            position = sf::Vector2f(rand() % window.getSize().x, rand() % window.getSize().y);
-			Medkit newmedkit(medkitTexture, position);
-			medkitvector.push_back(newmedkit);
-		}
+    // Leave a finished session: music off and a fresh world for the next one
+    void endSession() {
+        gameloop.stop();
+        UFOBattle.stop();
+        MusicisPaused = false;
+        window.clear();
+        reset();
+    }
 
-        //Spawn a UFO 
-        if (medspawn == true && score != 0) {
-		    for(int i = 0; i < 2; i++){
-                sf::Vector2f position;
-                //random possibility of spawning at the frame boundaries
-                switch (rand() % 4) {
-                    case 0:
-					    position = sf::Vector2f(0, rand() % window.getSize().y);
-					    break;
-                    case 1:
-                        position = sf::Vector2f(window.getSize().x, rand() % window.getSize().y);
-                        break;
-                    case 2:
-					    position = sf::Vector2f(rand() % window.getSize().x, 0);
-					    break;
-                    case 3:
-                        position = sf::Vector2f(rand() % window.getSize().x, window.getSize().y);
-                        break;
-                }
-			
-			    UFO_Boss newUFO(position, window.getSize(), UFOtexture);
-			    UFO_Bosses.push_back(newUFO);
-            }
-            medspawn = false;
-		}
+    // Bot sessions back to back, restarting whenever one ends, until `ticks` have been played.
+    // `sessionTicks` cuts a session short if the bot survives that long; 0 lets it run.
+    void playScripted(size_t ticks, size_t sessionTicks) {
+        autoplayer = std::make_unique<Autoplay>(sessionSeed);
+        autoplayTicksLeft = ticks;
+        autoplaySessionTicks = sessionTicks;
+        while (window.isOpen() && autoplayTicksLeft > 0) {
+            isStarted = true;
+            run();
+            endSession();
+        }
+        autoplayer.reset();
+    }
 
+    // One soak sample: every container the world and the game keep, and how deep the stack is
+    void sampleSoak() {
+        world->forEachContainer([&](const char* name, size_t size) {
+            soakMonitor->record(name, static_cast<double>(size), 50.0);
+        });
+        soakMonitor->record("history_kb", history.bytesUsed() / 1024.0, 1024.0);
+        double heapCalls = static_cast<double>(HeapCalls::count.exchange(0, std::memory_order_relaxed));
+        if (world->getSize() == world->getViewSize()) {
+            soakMonitor->expectZero("tick_heap_calls", heapCalls);
+        }
+        else {
+            // Parking entities in a scrolling world allocates chunk storage as it goes
+            soakMonitor->record("tick_heap_calls", heapCalls, 50.0);
+        }
+        char marker;
+        soakMonitor->record("stack_bytes", static_cast<double>(reinterpret_cast<std::uintptr_t>(soakStackTop) - reinterpret_cast<std::uintptr_t>(&marker)), 256.0);
+        soakMonitor->finishSample(std::cout);
+    }
 
-        // Timer for spawning enemies
-        static float enemySpawnTimer = 0.f;
-        enemySpawnTimer += deltaTime;
-        if (enemySpawnTimer >= 1.f) {
-            EnemyType type = static_cast<EnemyType>(rand() % 3);
-            // Make direct enemies spawn very less often
-            if (type == EnemyType::Direct) {
-                if (rand() % 10 > 1) {
-                    type = EnemyType::Normal;
-                }
+    // The simulation side of the telemetry: container sizes, score, voices and session counters
+    void publishWorldTelemetry() {
+        WorldTelemetry sample{};
+        world->forEachContainer([&](const char* name, size_t size) {
+            if (sample.containerCount < WorldTelemetry::maxContainers) {
+                sample.containerNames[sample.containerCount] = name;
+                sample.containerSizes[sample.containerCount] = size;
+                ++sample.containerCount;
             }
+        });
+        sample.score = netClient ? netClient->getScore() : world->getScore();
+        for (const sf::Sound* sound : { &shoot, &explosion, &mainmenu, &gameloop, &shockwavesound, &creditsmusic, &UFOBattle, &thrustsound }) {
+            sample.audioVoices += sound->getStatus() == sf::Sound::Playing;
+        }
+        sample.sessions = sessionsStarted;
+        sample.sessionTicks = telemetrySessionTicks;
+        sample.totalTicks = telemetryTotalTicks;
+        telemetry->addWorld(sample);
+    }
 
-            sf::Vector2f position;
-            switch (rand() % 4) {
-            case 0:
-                position = sf::Vector2f(0, rand() % window.getSize().y);
-                break;
-            case 1:
-                position = sf::Vector2f(window.getSize().x, rand() % window.getSize().y);
-                break;
-            case 2:
-                position = sf::Vector2f(rand() % window.getSize().x, 0);
-                break;
-            case 3:
-                position = sf::Vector2f(rand() % window.getSize().x, window.getSize().y);
-                break;
+    // Copy this tick's drawable state into the triple buffer for the render thread
+    void publishSnapshot() {
+        RenderSnapshot& snapshot = snapshots.writeBuffer();
+        if (netClient) {
+            netClient->captureSnapshot(snapshot);
+        }
+        else {
+            world->captureSnapshot(snapshot, world->getCamera());
+            // Effects go through their own queue: a snapshot the render thread never
+            // sees is overwritten, and its one-shot effects with it. They belong to
+            // the tick that made them, not to paused frames that repeat it.
+            snapshot.effects.clear();
+            if (effectsPending) {
+                for (const EffectEvent& effect : world->getEvents().effects) {
+                    effectQueue.push(effect); // Only full when rendering is far behind, where a lost effect is the least of it
+                }
+                effectsPending = false;
             }
-            sf::Vector2f playerPosition = player->getPosition();
-            sf::Vector2f directionToPlayer = playerPosition - position;
-            float length = std::sqrt(directionToPlayer.x * directionToPlayer.x + directionToPlayer.y * directionToPlayer.y);
-            directionToPlayer /= length; // Normalize the vector
-            const float offset = 50.0f; // Adjust this offset value as needed
+        }
+        snapshot.paused = isPaused;
+        snapshot.lateAim = !autoplayer && !isPaused;
+        // Scripted runs tick faster than real time, so there is nothing to draw between ticks
+        if (!snapshot.lateAim) {
+            snapshot.shipVelocity = sf::Vector2f();
+            snapshot.viewVelocity = sf::Vector2f();
+        }
+        snapshot.publishTime = inputClock.getElapsedTime().asMicroseconds();
+        snapshot.inputTime = pendingInputTime;
+        pendingInputTime = -1;
+        snapshots.publish();
+    }
 
-            if (type == EnemyType::Normal) {
-                // Create the first enemy at the original position
-                enemies.push_back(Enemy(enemyTexture, enemy2Texture, position, directionToPlayer, type));
+    void startRenderThread() {
+        if (renderThread.joinable()) {
+            return;
+        }
+        // The GL context can only be active on one thread at a time
+        window.setActive(false);
+        renderThreadRunning = true;
+        renderThread = std::thread(&Game::renderLoop, this);
+    }
 
-                // Adjust the position for the second enemy to be next to the first one
-                sf::Vector2f adjacentPosition = position;
-                adjacentPosition.x += offset; // Adjust this line for horizontal placement
-                // adjacentPosition.y += offset; // Uncomment and adjust for vertical placement
+    void stopRenderThread() {
+        if (!renderThread.joinable()) {
+            return;
+        }
+        renderThreadRunning = false;
+        renderThread.join();
+        window.setActive(true);
+        // With the render thread gone, effects it did not get to are stale by the next session
+        EffectEvent stale;
+        while (effectQueue.pop(stale)) {
+        }
+    }
 
-                // Create the second enemy at the adjusted position
-                enemies.push_back(Enemy(enemyTexture, enemy2Texture, adjacentPosition, directionToPlayer, type));
+    // Presents once per display refresh, paced by vsync rather than by the
+    // simulation: a frame with no new tick redraws the last one, with the ship
+    // and view carried forward to the present time.
+    void renderLoop() {
+        window.setActive(true);
+        // The menus ran in between, which is not a frame
+        frameClock.restart();
+        bool hasSnapshot = false;
+        while (renderThreadRunning) {
+            bool fresh = snapshots.consume();
+            if (!fresh && !hasSnapshot) {
+                sf::sleep(sf::milliseconds(1));
+                // Time spent waiting on the simulation is not render cost
+                frameClock.restart();
+                continue;
             }
-            else {
-                enemies.push_back(Enemy(enemyTexture, enemy2Texture, position, directionToPlayer, type));
+            hasSnapshot = true;
+            const RenderSnapshot& snapshot = snapshots.readBuffer();
+            render(snapshot);
+            // display() has returned, so the frame is on its way to the screen
+            sf::Int64 presented = inputClock.getElapsedTime().asMicroseconds();
+            // A press shows in the first frame drawn from its tick, not in the repeats
+            if (fresh && snapshot.inputTime >= 0) {
+                pressLatency.add((presented - snapshot.inputTime) / 1000.f);
+            }
+            if (aimLatchTime >= 0) {
+                aimLatency.add((presented - aimLatchTime) / 1000.f);
+            }
+            float frameTime = frameClock.restart().asSeconds();
+            if (quality.addFrame(frameTime)) {
+                qualityLevel.store(quality.getLevel(), std::memory_order_relaxed);
+            }
+            // Clamped like the governor's samples, so a lone hitch does not cut spawns
+            averageFrameTime += (std::min(frameTime, tickDuration.asSeconds() * 2.f) - averageFrameTime) * 0.1f;
+            renderFrameTime.store(averageFrameTime, std::memory_order_relaxed);
+            if (telemetry) {
+                telemetry->addFrame(FrameTelemetry{ frameTime, static_cast<std::uint32_t>(sceneStats.drawCalls), static_cast<std::uint8_t>(quality.getLevel()) });
+            }
+            if (soakMonitor) {
+                soakMonitor->addFrameTime(frameTime);
             }
-            enemySpawnTimer = 0.f;
         }
+        sceneTarget.setActive(false);
+        window.setActive(false);
+    }
 
-        // Shooting logic
-        bool isShooting = sf::Mouse::isButtonPressed(sf::Mouse::Left);
-        static float shootCooldown = 0.2f; // Adjust as needed for your game
-        static float shootTimer = shootCooldown;
-
-        shootTimer += deltaTime;
-
-        if (shootTimer < shootCooldown) {
-            // Shooting on cooldown, do nothing
-            wasShooting = true;
+    // Let more spawn while ticks are cheap and fewer once the simulation eats into
+    // the frame, with the same hold-off as the render scale so waves do not pulse.
+    // Slow frames count too, but only once the quality governor is at its lowest
+    // level: until then it sheds render cost itself, and both acting at once would
+    // overshoot. More spawns are only let in while frames keep up.
+    void adjustSpawnBudget(float tickTime) {
+        averageTickTime += (tickTime - averageTickTime) * 0.1f;
+        ++ticksSinceBudgetChange;
+        float budget = tickDuration.asSeconds();
+        float frameTime = renderFrameTime.load(std::memory_order_relaxed);
+        bool renderBound = frameTime > budget * 1.1f && qualityLevel.load(std::memory_order_relaxed) == QualityGovernor::levelCount - 1;
+        bool overBudget = averageTickTime > budget * 0.5f || renderBound;
+        bool underBudget = averageTickTime < budget * 0.25f && frameTime < budget * 1.02f;
+        if (overBudget && ticksSinceBudgetChange >= 30 && spawnBudgetScale > minSpawnBudgetScale) {
+            spawnBudgetScale = std::max(minSpawnBudgetScale, spawnBudgetScale - spawnBudgetStep);
+            ticksSinceBudgetChange = 0;
         }
-        else if (isShooting && !wasShooting) {
-            sf::Vector2f playerPosition = player->getPosition();
-            sf::Vector2f direction = static_cast<sf::Vector2f>(mousePosition) - playerPosition;
-            float angle = std::atan2(direction.y, direction.x) * 180 / 3.14159265 + 90; // Convert to degrees and adjust
-            projectiles.push_back(Projectile(projectileTexture, playerPosition, angle));
-            shootTimer = 0.f;
-            shoot.play();
+        else if (underBudget && ticksSinceBudgetChange >= 240 && spawnBudgetScale < maxSpawnBudgetScale) {
+            spawnBudgetScale = std::min(maxSpawnBudgetScale, spawnBudgetScale + spawnBudgetStep);
+            ticksSinceBudgetChange = 0;
         }
+    }
 
-        if (!isShooting) {
-            wasShooting = false;
+    // Runs on the render thread and reads nothing but the snapshot and the HUD text objects
+    void render(const RenderSnapshot& snapshot) {
+        const QualityLevel& settings = QualityGovernor::level(quality.getLevel());
+        renderScale = settings.renderScale;
+        particles.setDensity(settings.particleDensity);
+
+        // Frames come faster than ticks on a fast display, so the ship and the view
+        // following it are moved on by however much of a tick has passed since this
+        // one was published. At most one tick: past that the simulation is late.
+        sf::Int64 now = inputClock.getElapsedTime().asMicroseconds();
+        float ticksAhead = std::min(std::max(static_cast<float>(now - snapshot.publishTime) / tickDuration.asMicroseconds(), 0.f), 1.f);
+        sf::Vector2f viewOffset = snapshot.viewVelocity * ticksAhead;
+
+        // The scene renders into the top-left renderScale of the target...
+        sf::View sceneView(snapshot.view);
+        sceneView.move(viewOffset);
+        sceneView.setViewport(sf::FloatRect(0.f, 0.f, renderScale, renderScale));
+        sceneTarget.setView(sceneView);
+        sceneTarget.clear();
+
+        // Late latch: the ship faces where the mouse is now rather than where it was
+        // at the last tick. Only the drawing turns; the tick already fired along its aim.
+        aimLatchTime = -1;
+        SpriteState ship{};
+        const SpriteState* shipOverride = nullptr;
+        if (snapshot.ownShipFirst && !snapshot.sprites.empty()) {
+            ship = snapshot.sprites[0];
+            ship.position += snapshot.shipVelocity * ticksAhead;
+            shipOverride = &ship;
+        }
+        if (snapshot.lateAim && shipOverride) {
+            aimLatchTime = now;
+            // Desktop coordinates, so the render thread never asks the window anything
+            sf::Vector2i mouse = sf::Mouse::getPosition() - windowOrigin.load(std::memory_order_relaxed);
+            sf::Vector2f aim = presentPixelToCoords(mouse) + sf::Vector2f(snapshot.view.left, snapshot.view.top) + viewOffset;
+            sf::Vector2f direction = aim - ship.position;
+            ship.rotation = std::atan2(direction.y, direction.x) * 180 / 3.14159265f + 90; // Same convention as Player::updateRotation
         }
 
-
-        //shoot the player every 2 seconds
-        static float enemyshootCooldown = 0.8f;
-        static float enemyshootTimer = enemyshootCooldown;
-        enemyshootTimer += deltaTime;
-
-        //shoot the player
-        for (size_t i = 0; i < UFO_Bosses.size(); ++i) {
-            if (enemyshootTimer >= enemyshootCooldown) {
-                sf::Vector2f playerPosition = player->getPosition();
-                sf::Vector2f direction = playerPosition - UFO_Bosses[i].getPosition();
-                float angle = std::atan2(direction.y, direction.x) * 180 / 3.14159265 + 90; // Convert to degrees and adjust
-                UFO_Bullets.push_back(UFO_Bullet(UFOBulletTexture, UFO_Bosses[i].getPosition(), angle));
-                enemyshootTimer = 0.f;
+        // Particles step with the render clock and stand still while paused. At a
+        // stride above 1 they step every few frames by the time of all of them.
+        float particleTime = 0.f;
+        pendingParticleTime = std::min(pendingParticleTime + particleClock.restart().asSeconds(), 0.1f);
+        if (snapshot.paused) {
+            pendingParticleTime = 0.f;
+        }
+        if (++particleFrames >= settings.particleStride) {
+            particleTime = pendingParticleTime;
+            pendingParticleTime = 0.f;
+            particleFrames = 0;
+        }
+        EffectEvent effect;
+        while (effectQueue.pop(effect)) {
+            particles.emit(effect);
+        }
+        sceneStats = RenderStats();
+        drawScene(sceneTarget, snapshot, particles, particleTime, sceneStats, shipOverride);
+        sceneTarget.display();
+
+        // ...and that part is stretched over logical space in the window
+        sf::Vector2i renderedSize(static_cast<int>(logicalSize.x * renderScale), static_cast<int>(logicalSize.y * renderScale));
+        sf::Sprite scene(sceneTarget.getTexture(), sf::IntRect(0, 0, renderedSize.x, renderedSize.y));
+        scene.setScale(static_cast<float>(logicalSize.x) / renderedSize.x, static_cast<float>(logicalSize.y) / renderedSize.y);
+        window.clear();
+        window.draw(scene);
+
+        // The HUD goes straight to the window so text stays sharp at any render scale
+
+        //display score shockwave and medkit, checking for changes every hudInterval frames
+        if (++framesSinceHud >= settings.hudInterval) {
+            framesSinceHud = 0;
+            if (snapshot.medkitsUsed != shownMedkitsUsed) {
+                shownMedkitsUsed = snapshot.medkitsUsed;
+                medkitText.setString(counterText("Medkit Used: ", snapshot.medkitsUsed).c_str());
+                medkitText.setCharacterSize(30);
+                medkitText.setPosition(logicalSize.x - medkitText.getLocalBounds().width - 20, 80);
+            }
+            if (snapshot.shockwaveCount != shownShockwaveCount) {
+                shownShockwaveCount = snapshot.shockwaveCount;
+                shockwavecountText.setString(counterText("Shockwave Count: ", snapshot.shockwaveCount).c_str());
+                shockwavecountText.setCharacterSize(30);
+                shockwavecountText.setPosition(logicalSize.x - shockwavecountText.getLocalBounds().width - 20, 50);
+            }
+            if (snapshot.score != shownScore) {
+                shownScore = snapshot.score;
+                scoreText.setString(counterText("Score: ", snapshot.score).c_str());
+                scoreText.setPosition(logicalSize.x - scoreText.getLocalBounds().width - 20, 20);
+                scoreText.setCharacterSize(30);
+                scoreText.setFillColor(sf::Color::White);
             }
         }
+        window.draw(medkitText);
+        window.draw(shockwavecountText);
+        window.draw(scoreText);
 
-        // Update UFO_Bullets
-        for (size_t i = 0; i < UFO_Bullets.size(); ++i) {
-            UFO_Bullets[i].update(deltaTime);
-        }
+        // Draw health bar
+        drawHearts(window, snapshot);
 
-        // Remove UFO_Bullets that are out of bounds
-        for (size_t i = 0; i < UFO_Bullets.size(); ++i) {
-            //remove the UFO_Bullets that are out of bounds
-            sf::Vector2f position = UFO_Bullets[i].getPosition();
-            if (position.x < 0 || position.x > WindowSize.x || position.y < 0 || position.y > WindowSize.y) {
-                UFO_Bullets.erase(UFO_Bullets.begin() + i);
-                --i;
-            }
+        if (snapshot.paused) {
+            window.draw(pauseText);
+            window.draw(exitText);
         }
 
+        window.display();
+        hudArena.reset();
+    }
 
+    // `label` followed by `value`, in the render thread's frame arena
+    std::pmr::string counterText(const char* label, int value) {
+        std::pmr::string text(label, &hudArena);
+        char digits[16];
+        char* end = std::to_chars(digits, digits + sizeof(digits), value).ptr;
+        text.append(digits, end);
+        return text;
     }
 
 
-    void checkCollisions() {
-        // Check for collisions between projectiles and enemies
-        for (size_t i = 0; i < projectiles.size(); ++i) {
-            for (size_t j = 0; j < enemies.size(); ++j) {
-                if (projectiles[i].getBounds().intersects(enemies[j].getBounds())) {
-                    // Create explosion animation
-                    //score according to enemy type
-                    if (enemies[j].getType() == EnemyType::Normal) {
-                        score += 20;
-                    }
-                    else if (enemies[j].getType() == EnemyType::Fast) {
-                        score += 40;
-                    }
-                    else if (enemies[j].getType() == EnemyType::Direct) {
-                        score += 80;
-                        if (rand() % 100 < 10) {
-                            //spawn a powerup
-                            medspawn = true;
-                            sf::Vector2f position = enemies[j].getPosition();
-                            Powerup newpowerup(powerUpTexture, position);
-                            powerupvector.push_back(newpowerup);
-                        }
-                    }
-                    explosion.play();
-                    Animation explosionAnim(explosionTexture, 126, 138, 8, 0.05f); // Assuming each frame is 64x64 and there are 16 frames
-                    explosionAnim.setPosition(enemies[j].getPosition());
-                    animations.push_back(explosionAnim);
-
-                    // Remove projectile and enemy
-                    projectiles.erase(projectiles.begin() + i);
-                    enemies.erase(enemies.begin() + j);
-                    --i;
-                    break;
-                }
-            }
-        }
+    sf::RenderWindow window;
+    WorldTextures worldTextures;
+
+    // Everything is laid out and simulated at this resolution and scaled to the window
+    sf::Vector2u logicalSize;
+    sf::View presentView;
+    // presentView's viewport in window pixels and its inverse transform, fixed for
+    // the session, so either thread can map the mouse without touching the window
+    sf::FloatRect presentPixels;
+    sf::Transform presentInverse;
+    std::atomic<sf::Vector2i> windowOrigin{ sf::Vector2i() }; // Desktop position of the window, published by the simulation thread
+    sf::RenderTexture sceneTarget;
+
+    // Quality levels, chosen by the render thread from its frame times and kept
+    // from one session to the next, since the machine stays the same. The scene
+    // renders at renderScale times the logical resolution and is upscaled from
+    // there. qualityLevel is the governor's level for the simulation thread.
+    QualityGovernor quality{ 1.f / 60.f };
+    std::atomic<int> qualityLevel{ 0 };
+    float renderScale = 1.f;
+    int framesSinceHud = std::numeric_limits<int>::max() - 1; // Build the HUD on the first frame
+
+    // HUD values the text currently shows, and the render thread's frame arena
+    int shownScore = -1;
+    int shownShockwaveCount = -1;
+    int shownMedkitsUsed = -1;
+    FrameArena hudArena{ 4 * 1024 };
+    sf::Clock frameClock;
+
+    // Spawn budget, owned by the simulation thread and driven by how long ticks
+    // and, through renderFrameTime, frames take
+    float spawnBudgetScale = 1.f;
+    const float minSpawnBudgetScale = 0.5f;
+    const float maxSpawnBudgetScale = 1.5f;
+    const float spawnBudgetStep = 0.1f;
+    float averageTickTime = 0.f;
+    int ticksSinceBudgetChange = 0;
+    sf::Clock simClock;
+    float averageFrameTime = 0.f;             // Render thread only
+    std::atomic<float> renderFrameTime{ 0.f }; // Its latest value, for the simulation thread
+
+    // Render-thread particles, capped at a fixed budget
+    ParticleSystem particles{ 4096 };
+    sf::Clock particleClock;
+    float pendingParticleTime = 0.f;
+    int particleFrames = 0;
+    bool effectsPending = false;
+    RenderStats sceneStats;
+    sf::Texture powerUpTexture1;
+    bool isPaused;
+    bool shockwaveRequested = false;
+
+    // Worker threads for entity updates and collision
+    JobSystem jobs;
+    std::unique_ptr<World> world;
+
+    // Mouse and thrust events for the next tick, stamped against inputClock.
+    // Latencies and the aim latch time belong to the render thread while it runs.
+    InputLayer inputLayer;
+    sf::Clock inputClock;
+    sf::Int64 pendingInputTime = -1;
+    sf::Int64 aimLatchTime = -1;
+    LatencyStats pressLatency;
+    LatencyStats aimLatency;
+
+    // Scripted input in place of the mouse and keyboard, for training runs
+    std::unique_ptr<Autoplay> autoplayer;
+    size_t autoplayTicksLeft = 0;
+    size_t autoplaySessionTicks = 0;
+    static const size_t ticksPerMinute = 3600;
+
+    // Soak run state, null and unused otherwise. Soak sessions end after 5 minutes.
+    SoakMonitor* soakMonitor = nullptr;
+    const char* soakStackTop = nullptr;
+    size_t soakTicks = 0;
+    const size_t soakSessionTicks = 5 * ticksPerMinute;
+
+    // Live metrics, null unless --telemetry was given. Counters belong to the simulation thread.
+    std::unique_ptr<TelemetryPublisher> telemetry;
+    sf::Clock telemetryClock;
+    std::uint64_t sessionsStarted = 0;
+    std::uint64_t telemetrySessionTicks = 0;
+    std::uint64_t telemetryTotalTicks = 0;
+
+    // Input recording, one log per session when a prefix is given
+    std::string recordPrefix;
+    int sessionIndex = 0;
+    std::uint64_t sessionSeed;
+    InputRecorder recorder;
+
+    // Co-op, at most one of these is set
+    std::unique_ptr<NetHost> netHost;
+    std::unique_ptr<NetClient> netClient;
+
+    // The last 10 seconds of world states; Backspace rewinds 3 seconds
+    StateHistory history{ 600, 60 };
+    std::vector<unsigned char> stateBuffer;
+    bool rewindRequested = false;
+    const size_t rewindTicks = 180;
+
+    // Render thread and the snapshots it consumes
+    TripleBuffer<RenderSnapshot> snapshots;
+    SpscQueue<EffectEvent, 4096> effectQueue;
+    std::thread renderThread;
+    std::atomic<bool> renderThreadRunning{ false };
+    sf::Time tickDuration = sf::seconds(1.f / 60.f);
+};
 
-        // Check for collision between shockwave and UFO_Bosses
-        for (size_t i = 0; i < poweranimations.size(); ++i) {
-            for (size_t j = 0; j < UFO_Bosses.size(); ++j) {
-                if (poweranimations[i].getBounds().intersects(UFO_Bosses[j].getBounds())) {
-					// Create explosion animation
-					score += 100;
-					explosion.play();
-					Animation explosionAnim(explosionTexture, 126, 138, 8, 0.05f); // Assuming each frame is 64x64 and there are 16 frames
-					explosionAnim.setPosition(UFO_Bosses[j].getPosition());
-					animations.push_back(explosionAnim);
+// Batch runner behind the C ABI in BhaataPhodBatch.h. Textures are loaded once
+// and shared; each instance owns a serial JobSystem so that whole instances,
+// not the entities inside them, are what gets spread across the batch pool.
+struct bp_game {
+    bp_game(const WorldTextures& textures, std::uint64_t seed)
+        : jobs(0), world(textures, sf::Vector2u(BP_WORLD_WIDTH, BP_WORLD_HEIGHT), jobs, seed) {}
 
-					// Remove projectile and UFO_Boss
-					poweranimations.erase(poweranimations.begin() + i);
-					UFO_Bosses.erase(UFO_Bosses.begin() + j);
-					--i;
-					break;
-				}
-			}
-		}
+    JobSystem jobs;
+    World world;
+};
 
+namespace {
+    std::once_flag batchInitFlag;
+    std::unique_ptr<WorldTextures> batchTextures;
+    std::unique_ptr<JobSystem> batchJobs;
 
-        // Check for collisions between projectiles and UFO_Bosses
-        for (size_t i = 0; i < projectiles.size(); ++i) {
-            for (size_t j = 0; j < UFO_Bosses.size(); ++j) {
-                if (projectiles[i].getBounds().intersects(UFO_Bosses[j].getBounds())) {
-					// Create explosion animation
-					score += 100;
-					explosion.play();
-					Animation explosionAnim(explosionTexture, 126, 138, 8, 0.05f); // Assuming each frame is 64x64 and there are 16 frames
-					explosionAnim.setPosition(UFO_Bosses[j].getPosition());
-					animations.push_back(explosionAnim);
+    bool initBatch() {
+        std::call_once(batchInitFlag, [] {
+            auto textures = std::make_unique<WorldTextures>();
+            if (textures->loadFromFiles(0.f)) {
+                batchTextures = std::move(textures);
+            }
+            else {
+                std::cerr << "Error loading resources from file" << std::endl;
+            }
+            batchJobs = std::make_unique<JobSystem>();
+        });
+        return batchTextures != nullptr;
+    }
+}
 
-					// Remove projectile and UFO_Boss
-					projectiles.erase(projectiles.begin() + i);
-					UFO_Bosses.erase(UFO_Bosses.begin() + j);
+extern "C" {
 
-					--i;
-					break;
-				}
-			}
-		}
+BP_API bp_game* bp_create(uint64_t seed) {
+    if (!initBatch()) {
+        return nullptr;
+    }
+    return new bp_game(*batchTextures, seed);
+}
 
+BP_API void bp_destroy(bp_game* game) {
+    delete game;
+}
 
-        // Check for collisions between player and enemies
-        for (size_t i = 0; i < enemies.size(); ++i) {
-            if (player->getBounds().intersects(enemies[i].getBounds())) {
-                // Create collision animation
-                explosion.play();
-                Animation collision(explosionTexture, 126, 138, 8, 0.05f); // Reusing explosion texture for collision
-                collision.setPosition(player->getPosition());
-                animations.push_back(collision);
-                
+BP_API void bp_reset(bp_game* game, uint64_t seed) {
+    game->world.reset(seed);
+}
 
-                // Handle player damage
-                health.takeDamage(1); // Each collision takes half a heart (1 unit)
+BP_API void bp_step(bp_game* const* handles, const bp_action* actions, size_t n) {
+    if (!initBatch()) {
+        return;
+    }
+    batchJobs->parallelFor(n, 4, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            PlayerInput input;
+            input.aim = sf::Vector2f(actions[i].aim_x, actions[i].aim_y);
+            input.thrust = actions[i].thrust != 0;
+            input.fire = actions[i].fire != 0;
+            input.shockwave = actions[i].shockwave != 0;
+            handles[i]->world.update(BP_TICK_SECONDS, input);
+        }
+    });
+}
 
-                // Remove enemy
-                enemies.erase(enemies.begin() + i);
+BP_API int bp_observe(bp_game* game, float* buffer) {
+    return game->world.observe(buffer);
+}
 
-                --i;
-                break;
-            }
-        }
+BP_API size_t bp_save_state(bp_game* game, void* buffer, size_t capacity) {
+    thread_local std::vector<unsigned char> state;
+    game->world.saveState(state);
+    if (buffer && state.size() <= capacity) {
+        std::memcpy(buffer, state.data(), state.size());
+    }
+    return state.size();
+}
 
-        //check for collision between player and UFO_Boss
-        for (size_t i = 0; i < UFO_Bosses.size(); ++i) {
-            if (player->getBounds().intersects(UFO_Bosses[i].getBounds())) {
-				// Create collision animation
-				explosion.play();
-				Animation collision(explosionTexture, 126, 138, 8, 0.05f); // Reusing explosion texture for collision
-				collision.setPosition(player->getPosition());
-				animations.push_back(collision);
-
-				// Handle player damage
-				health.takeDamage(4); // Each collision takes half a heart (1 unit)
-
-				// Remove UFO_Boss
-				UFO_Bosses.erase(UFO_Bosses.begin() + i);
-				--i;
-				break;
-			}
-		}
+BP_API void bp_load_state(bp_game* game, const void* buffer, size_t size) {
+    thread_local std::vector<unsigned char> state;
+    const unsigned char* bytes = static_cast<const unsigned char*>(buffer);
+    state.assign(bytes, bytes + size);
+    game->world.loadState(state);
+}
 
-        //check for collision between player and UFO_Bullet
-        for (size_t i = 0; i < UFO_Bullets.size(); ++i) {
-            if (player->getBounds().intersects(UFO_Bullets[i].getBounds())) {
-				// Create collision animation
-				explosion.play();
-				Animation collision(explosionTexture, 126, 138, 8, 0.05f); // Reusing explosion texture for collision
-				collision.setPosition(player->getPosition());
-				animations.push_back(collision);
-
-				// Handle player damage
-				health.takeDamage(1); // Each collision takes half a heart (1 unit)
-
-				// Remove UFO_Bullet
-				UFO_Bullets.erase(UFO_Bullets.begin() + i);
-				--i;
-				break;
-			}
-		}
+BP_API size_t bp_thread_count(void) {
+    return initBatch() ? batchJobs->threadCount() : 0;
+}
 
-        //check for collision between player and powerupsprite
-        for (size_t i = 0; i < powerupvector.size(); ++i) {
-            if (player->getBounds().intersects(powerupvector[i].getBounds())) {
-                shockwavecount++;
-				// Remove powerup
-				powerupvector.erase(powerupvector.begin() + i);
-				--i;
-				break;
-			}
-		}
-  
+}
 
-        //check for collision between powerup global bounds and enemy global bounds
-        for (size_t i = 0; i < poweranimations.size(); ++i) {
-            for (size_t j = 0; j < enemies.size(); ++j) {
-                //intersection of enemies and powerup
-                if (poweranimations[i].getBounds().intersects(enemies[j].getBounds())) {
-					// Create explosion animation
-					//score according to enemy type
-                    if (enemies[j].getType() == EnemyType::Normal) {
-						score += 20;
-					}
-                    else if (enemies[j].getType() == EnemyType::Fast) {
-						score += 40;
-					}
-                    else if (enemies[j].getType() == EnemyType::Direct) {
-						score += 80;
-					}
-					explosion.play();
-					Animation explosionAnim(explosionTexture, 126, 138, 8, 0.05f); // Assuming each frame is 64x64 and there are 16 frames
-					explosionAnim.setPosition(enemies[j].getPosition());
-					animations.push_back(explosionAnim);
+// Steps `instances` matches for `ticks` ticks with random inputs and reports
+// aggregate throughput. Matches that end are reset so every step does real work.
+int runBatchBenchmark(size_t instances, size_t ticks) {
+    std::vector<bp_game*> games;
+    for (size_t i = 0; i < instances; ++i) {
+        bp_game* game = bp_create(i + 1);
+        if (!game) {
+            return -1;
+        }
+        games.push_back(game);
+    }
 
-					// Remove projectile and enemy
-					enemies.erase(enemies.begin() + j);
-					--i;
-					break;
-				
-                }
+    Pcg32 inputRng;
+    inputRng.seed(12345, 0);
+    std::vector<bp_action> actions(instances);
+    sf::Clock clock;
+    for (size_t tick = 0; tick < ticks; ++tick) {
+        for (auto& action : actions) {
+            action.aim_x = static_cast<float>(inputRng() % BP_WORLD_WIDTH);
+            action.aim_y = static_cast<float>(inputRng() % BP_WORLD_HEIGHT);
+            action.thrust = inputRng() % 2;
+            action.fire = inputRng() % 2;
+            action.shockwave = inputRng() % 600 == 0;
+        }
+        bp_step(games.data(), actions.data(), games.size());
+        for (size_t i = 0; i < games.size(); ++i) {
+            if (games[i]->world.isOver()) {
+                bp_reset(games[i], tick * instances + i);
             }
         }
-
-        //check for collision between player and medkit
-        for (size_t i = 0; i < medkitvector.size(); ++i) {
-            if (player->getBounds().intersects(medkitvector[i].getBounds())) {
-				health.takeDamage(-2); // Each medkit heals 1 unit
-				medkituse++;
-				// Remove medkit
-				medkitvector.erase(medkitvector.begin() + i);
-				--i;
-				break;
-			}
-		}
     }
+    float seconds = clock.getElapsedTime().asSeconds();
 
-    void render() {
-        window.clear();
-
-        if (isGameOver) {
-            window.clear();
-            window.draw(gameOverText);
-            scoreText.setCharacterSize(45);
-            scoreText.setPosition(window.getSize().x / 2.f - scoreText.getLocalBounds().width / 2.f, window.getSize().y / 2.f - scoreText.getLocalBounds().height + 250.f / 2.f);
-            window.draw(scoreText);
-            window.display();
-            //wait 2 sec without clock
-            sf::sleep(sf::seconds(5));
-            gameloop.stop();
-            window.clear();
-            reset();
-            mainScreen();
+    float stepsPerSecond = instances * ticks / seconds;
+    std::cout << instances << " instances x " << ticks << " ticks in " << seconds << " s: "
+        << stepsPerSecond << " steps/s, " << stepsPerSecond / bp_thread_count() << " steps/s per core" << std::endl;
 
-        }
+    for (bp_game* game : games) {
+        bp_destroy(game);
+    }
+    return 0;
+}
 
-        else {
-            // Draw the game elements only if the game is not over
-            player->draw(window);
-
-            //display score shockwave and medkit
-            medkitText.setString("Medkit Used: " + std::to_string(medkituse));
-            medkitText.setCharacterSize(30);
-            medkitText.setPosition(window.getSize().x - medkitText.getLocalBounds().width - 20, 80);
-            window.draw(medkitText);
-            shockwavecountText.setString("Shockwave Count: " + std::to_string(shockwavecount));
-            shockwavecountText.setCharacterSize(30);
-            shockwavecountText.setPosition(window.getSize().x - shockwavecountText.getLocalBounds().width - 20, 50);
-            window.draw(shockwavecountText);
-            scoreText.setString("Score: " + std::to_string(score));
-            scoreText.setPosition(window.getSize().x - scoreText.getLocalBounds().width - 20, 20);
-            scoreText.setCharacterSize(30);
-            scoreText.setFillColor(sf::Color::White);
-            window.draw(scoreText);
-
-            for (const auto& UFO_Bullet : UFO_Bullets) {
-				UFO_Bullet.draw(window);
-			}
+// Draws synthetic frames offscreen through drawScene, the game's own scene path,
+// and reports what each frame submitted and how long it took at several
+// resolutions. The scene is laid out in 1920x1080 and scaled to each target like
+// the game's logical space, so higher resolutions add fill cost only. It needs a
+// GL context but no window: under Xvfb with LIBGL_ALWAYS_SOFTWARE=1 it measures llvmpipe.
+// `UFOBulletCount` sets the size of the UFO bullet batch, so a full pool can be drawn.
+int runRenderBenchmark(size_t asteroids, size_t frames, size_t UFOBulletCount) {
+    WorldTextures textures;
+    if (!textures.loadFromFiles(1.f)) {
+        return -1;
+    }
 
-            for (const auto& projectile : projectiles) {
-                projectile.draw(window);
-            }
+    // Projectiles and animations scale with the asteroids, roughly as in a busy match
+    size_t bullets = asteroids / 4;
+    size_t explosions = std::max<size_t>(asteroids / 10, 1);
+    size_t shockwaves = 2;
+
+    Pcg32 rng;
+    rng.seed(12345, 0);
+    auto randomPoint = [&] {
+        return sf::Vector2f(static_cast<float>(rng() % 1920), static_cast<float>(rng() % 1080));
+    };
+    auto addSprite = [&](RenderSnapshot& snapshot, const sf::Texture& texture, const sf::Vector2f& position) {
+        sf::Sprite sprite(texture);
+        sprite.setOrigin(texture.getSize().x / 2.f, texture.getSize().y / 2.f);
+        sprite.setPosition(position);
+        sprite.setRotation(static_cast<float>(rng() % 360));
+        snapshot.sprites.push_back(SpriteState::capture(sprite));
+    };
+
+    // Same order as World::captureSnapshot: UFO bullet batch, ship, projectiles, asteroids, then animations
+    RenderSnapshot snapshot;
+    snapshot.view = sf::FloatRect(0.f, 0.f, 1920.f, 1080.f);
+    addSprite(snapshot, textures.playerThrusting, sf::Vector2f(960.f, 540.f));
+    snapshot.thrusters.push_back(EffectEvent{ ParticlePreset::ThrustTrail, sf::Vector2f(960.f, 570.f), 90.f });
+    BulletPool UFOBullets(textures.UFOBullet, UFOBulletCount);
+    const BulletPattern single{ BulletPatternKind::AimedBurst, 1, 0.f, 0.f, 0.f, 0.f, 0.f, 1, 0.f };
+    for (size_t i = 0; i < UFOBulletCount; ++i) {
+        UFOBullets.emit(single, randomPoint(), static_cast<float>(rng() % 360), 0);
+    }
+    for (size_t i = 0; i < bullets; ++i) {
+        addSprite(snapshot, textures.projectile, randomPoint());
+    }
+    UFOBullets.capture(snapshot.view, snapshot.bulletQuads);
+    snapshot.bulletTexture = &textures.UFOBullet;
+    for (size_t i = 0; i < asteroids; ++i) {
+        addSprite(snapshot, i % 3 ? textures.enemy : textures.enemy2, randomPoint());
+    }
+    const AnimationClip& explosionClip = textures.animationClips[ExplosionClip];
+    const AnimationClip& shockwaveClip = textures.animationClips[ShockwaveClip];
+    for (size_t i = 0; i < shockwaves; ++i) {
+        snapshot.sprites.push_back(shockwaveClip.capture(i % shockwaveClip.frames.size(), randomPoint()));
+    }
+    for (size_t i = 0; i < explosions; ++i) {
+        snapshot.sprites.push_back(explosionClip.capture(i % explosionClip.frames.size(), randomPoint()));
+    }
 
-            for (const auto& UFO_Boss : UFO_Bosses) {
-                UFO_Boss.draw(window);
+    const size_t warmupFrames = 30;
+    const sf::Vector2u resolutions[] = { sf::Vector2u(1280, 720), sf::Vector2u(1920, 1080), sf::Vector2u(2560, 1440), sf::Vector2u(3840, 2160) };
+    std::cout << snapshot.sprites.size() + UFOBullets.size() << " sprites (" << asteroids << " asteroids, " << bullets << " projectiles, " << UFOBulletCount << " UFO bullets, "
+        << explosions << " explosions, " << shockwaves << " shockwaves), " << frames << " frames" << std::endl;
+    for (const sf::Vector2u& resolution : resolutions) {
+        sf::RenderTexture target;
+        if (!target.create(resolution.x, resolution.y)) {
+            std::cerr << "Error creating a " << resolution.x << "x" << resolution.y << " render target" << std::endl;
+            return -1;
+        }
+        target.setView(sf::View(snapshot.view));
+        ParticleSystem particles(4096);
+        RenderStats totals;
+        std::vector<float> times;
+        for (size_t frame = 0; frame < warmupFrames + frames; ++frame) {
+            // A fresh explosion every few frames keeps the particle pool busy
+            snapshot.effects.clear();
+            if (frame % 6 == 0) {
+                sf::Vector2f position = randomPoint();
+                snapshot.effects.push_back(EffectEvent{ ParticlePreset::ExplosionBurst, position, 0.f });
+                snapshot.effects.push_back(EffectEvent{ ParticlePreset::Debris, position, 0.f });
             }
 
-            for (const auto& enemy : enemies) {
-                enemy.draw(window);
+            RenderStats stats;
+            sf::Clock clock;
+            target.clear();
+            drawScene(target, snapshot, particles, 1.f / 60.f, stats);
+            target.display();
+            // Wait until the frame is drawn, not just queued
+            glFinish();
+            float milliseconds = clock.getElapsedTime().asMicroseconds() / 1000.f;
+
+            if (frame >= warmupFrames) {
+                times.push_back(milliseconds);
+                totals.drawCalls += stats.drawCalls;
+                totals.textureBinds += stats.textureBinds;
+                totals.vertices += stats.vertices;
             }
+        }
 
-            for (const auto& powerup : powerupvector) {
-				powerup.draw(window);
-			}
-
-            for (const auto& poweranimation : poweranimations) {
-				poweranimation.draw(window);
-			}
+        float mean = 0.f;
+        for (float time : times) {
+            mean += time / times.size();
+        }
+        std::sort(times.begin(), times.end());
+        float frameCount = static_cast<float>(std::max<size_t>(frames, 1));
+        std::cout << resolution.x << "x" << resolution.y << ": " << mean << " ms/frame (p99 "
+            << (times.empty() ? 0.f : times[std::min(times.size() - 1, times.size() * 99 / 100)]) << " ms), "
+            << totals.drawCalls / frameCount << " draw calls, " << totals.textureBinds / frameCount << " texture binds, "
+            << totals.vertices / frameCount << " vertices per frame" << std::endl;
+    }
+    return 0;
+}
 
-            for (const auto& medkit : medkitvector) {
-                medkit.draw(window);
-            }
+// Re-runs a recorded session with rendering and audio off, as fast as possible,
+// and checks the final state against the checksum stored in the log.
+int runReplay(const std::string& path) {
+    InputReplay replay;
+    WorldTextures textures;
+    if (!replay.open(path) || !textures.loadFromFiles(0.f)) {
+        return -1;
+    }
+    JobSystem jobs;
+    World world(textures, replay.worldSize, jobs, replay.seed, replay.viewSize);
+
+    float deltaTime = 0.f;
+    PlayerInput input;
+    size_t ticks = 0;
+    sf::Clock clock;
+    while (replay.next(deltaTime, input)) {
+        world.update(deltaTime, input);
+        ++ticks;
+    }
+    float seconds = clock.getElapsedTime().asSeconds();
+
+    std::uint64_t checksum = world.checksum();
+    std::cout << ticks << " ticks in " << seconds * 1000.f << " ms (" << ticks / seconds << " ticks/s), score " << world.getScore()
+        << ", checksum " << std::hex << checksum << std::dec << std::endl;
+    if (replay.hasChecksum && replay.expectedChecksum != checksum) {
+        std::cerr << "Replay diverged: recorded checksum " << std::hex << replay.expectedChecksum << std::dec << std::endl;
+        return 1;
+    }
+    return 0;
+}
 
+// Runs a co-op host and client in one process over loopback for `seconds`, with
+// both ends sending through a simulated link, and reports what the state stream
+// costs. The world is topped up to `asteroids` asteroids to show how it scales.
+// Returns 1 if the state stream averaged more than the 100 kbps budget.
+int runNetLoopback(float seconds, const LinkConditions& conditions, size_t asteroids) {
+    const float budgetKbps = 100.f;
+    if (!initBatch()) {
+        return -1;
+    }
+    JobSystem jobs(0);
+    World world(*batchTextures, sf::Vector2u(BP_WORLD_WIDTH, BP_WORLD_HEIGHT), jobs, 1);
+    world.setCoop(true);
+    world.reset(1);
+
+    NetHost host;
+    NetClient client(*batchTextures);
+    if (!host.start(sf::Socket::AnyPort, conditions) || !client.connect(sf::IpAddress::LocalHost, host.getPort(), conditions)) {
+        return -1;
+    }
 
-            // Draw animations
-            for (const auto& animation : animations) {
-                animation.draw(window);
-            }
+    Pcg32 inputRng;
+    inputRng.seed(12345, 0);
+    auto randomInput = [&] {
+        PlayerInput input;
+        input.aim = sf::Vector2f(static_cast<float>(inputRng() % BP_WORLD_WIDTH), static_cast<float>(inputRng() % BP_WORLD_HEIGHT));
+        input.thrust = inputRng() % 2;
+        input.fire = inputRng() % 2;
+        return input;
+    };
+
+    // Runs in real time, since the simulated latency is measured on the wall clock
+    size_t ticks = static_cast<size_t>(seconds / NetProtocol::tickSeconds);
+    const size_t ticksPerSecond = static_cast<size_t>(1.f / NetProtocol::tickSeconds + 0.5f);
+    std::uint64_t secondStartBytes = 0;
+    float peakKbps = 0.f;
+    sf::Clock tickClock;
+    for (size_t tick = 0; tick < ticks; ++tick) {
+        if (tick % ticksPerSecond == 0 && tick > 0) {
+            peakKbps = std::max(peakKbps, (host.getStats().bytesSent - secondStartBytes) * 8.f / 1000.f);
+            secondStartBytes = host.getStats().bytesSent;
+        }
+        if (world.getEnemyCount() < asteroids) {
+            world.spawnAsteroids(static_cast<int>(asteroids - world.getEnemyCount()));
+        }
+        client.sendInput(randomInput());
+        host.poll();
+        world.update(NetProtocol::tickSeconds, randomInput(), host.nextInput());
+        host.sendState(world);
+        client.poll();
+        if (world.isOver()) {
+            world.reset(tick);
+        }
 
-            // Draw health bar
-            health.draw(window);
+        sf::Time elapsed = tickClock.restart();
+        if (elapsed < sf::seconds(NetProtocol::tickSeconds)) {
+            sf::sleep(sf::seconds(NetProtocol::tickSeconds) - elapsed);
+            tickClock.restart();
         }
+    }
 
-        window.display();
+    const NetStats& hostStats = host.getStats();
+    const NetStats& clientStats = client.getStats();
+    std::uint64_t states = std::max<std::uint64_t>(host.getStatesSent(), 1);
+    std::uint64_t entities = std::max<std::uint64_t>(host.getEntitiesSent(), 1);
+    float hostKbps = hostStats.bytesSent * 8.f / seconds / 1000.f;
+    std::cout << "host -> client: " << hostKbps << " kbps (peak second " << peakKbps << ", budget " << budgetKbps << "), "
+        << static_cast<float>(hostStats.bytesSent) / states << " bytes/state, "
+        << static_cast<float>(hostStats.bytesSent) / entities << " bytes/entity, "
+        << static_cast<float>(entities) / states << " entities/state, "
+        << static_cast<float>(hostStats.packetsSent) / states << " datagrams/state, "
+        << host.getDeltaStatesSent() << "/" << host.getStatesSent() << " states delta-compressed, "
+        << hostStats.packetsDropped << " dropped" << std::endl;
+    std::cout << "client -> host: " << clientStats.bytesSent * 8.f / seconds / 1000.f << " kbps, "
+        << clientStats.packetsDropped << " dropped" << std::endl;
+    std::cout << "mean prediction correction: " << client.getMeanCorrection() << " px" << std::endl;
+    if (hostKbps > budgetKbps) {
+        std::cerr << "State stream over the " << budgetKbps << " kbps budget" << std::endl;
+        return 1;
     }
+    return 0;
+}
 
+#ifndef BHAATAPHOD_BATCH
+// The game's own operator new, so HeapCalls can count. The array, sized and
+// nothrow forms all come back here; aligned allocations are left alone, and the
+// frame arenas report their own heap fallbacks.
+void* operator new(std::size_t size) {
+    if (HeapCalls::counted) {
+        HeapCalls::count.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (void* pointer = std::malloc(size ? size : 1)) {
+        return pointer;
+    }
+    throw std::bad_alloc();
+}
 
-    sf::RenderWindow window;
-    std::unique_ptr<Player> player;
-    std::vector<Projectile> projectiles;
-    std::vector<UFO_Bullet> UFO_Bullets;
-    std::vector<Enemy> enemies;
-    std::vector<Animation> animations, poweranimations;
-    std::vector<Powerup> powerupvector;
-    std::vector<Medkit> medkitvector;
-    std::vector<UFO_Boss> UFO_Bosses;
-    sf::Texture medkitTexture;
-    sf::Texture playerTextureIdle;
-    sf::Texture playerTextureThrusting;
-    sf::Texture projectileTexture;
-    sf::Texture enemyTexture;
-    sf::Texture enemy2Texture;
-    sf::Texture powerUpTexture;
-    sf::Texture powerUpTexture1;
-    sf::Texture explosionTexture;
-    sf::Texture shockwaveTexture;
-    sf::Texture fullHeartTexture;
-    sf::Texture halfHeartTexture;
-    sf::Texture UFOtexture;
-    sf::Texture UFOBulletTexture;
-    int score = 0;
-    bool medspawn = false;
-    int shockwavecount = 1;
-    int medkituse = 0;
-    bool isPaused;
-    bool wasShooting = false;
-};
+void operator delete(void* pointer) noexcept {
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, std::size_t) noexcept {
+    std::free(pointer);
+}
+
+int main(int argc, char* argv[]) {
+    // BhaataPhod --batch-bench [instances] [ticks]
+    if (argc > 1 && std::string(argv[1]) == "--batch-bench") {
+        size_t instances = argc > 2 ? std::stoul(argv[2]) : 256;
+        size_t ticks = argc > 3 ? std::stoul(argv[3]) : 3600;
+        return runBatchBenchmark(instances, ticks);
+    }
+    // BhaataPhod --render-bench [asteroids] [frames] [ufo-bullets]
+    if (argc > 1 && std::string(argv[1]) == "--render-bench") {
+        size_t asteroids = argc > 2 ? std::stoul(argv[2]) : 300;
+        size_t frames = argc > 3 ? std::stoul(argv[3]) : 300;
+        size_t UFOBulletCount = argc > 4 ? std::stoul(argv[4]) : asteroids / 4;
+        return runRenderBenchmark(asteroids, frames, UFOBulletCount);
+    }
+    // BhaataPhod --replay session.bprl
+    if (argc > 2 && std::string(argv[1]) == "--replay") {
+        return runReplay(argv[2]);
+    }
+    // BhaataPhod --build-asset-tiers  (build step: writes Materials/half and Materials/quarter)
+    if (argc > 1 && std::string(argv[1]) == "--build-asset-tiers") {
+        return AssetTiers::build() ? 0 : -1;
+    }
+    // Simulated link for co-op testing, applied to whichever mode follows:
+    // BhaataPhod --net-sim latencyMs lossPercent ...
+    LinkConditions conditions;
+    int arg = 1;
+    if (argc > arg + 2 && std::string(argv[arg]) == "--net-sim") {
+        conditions.latency = std::stof(argv[arg + 1]) / 1000.f;
+        conditions.jitter = conditions.latency / 4.f;
+        conditions.loss = std::stof(argv[arg + 2]) / 100.f;
+        arg += 3;
+    }
+    // BhaataPhod --resolution 1280x720 ...  (logical resolution, 1920x1080 by default)
+    sf::Vector2u logicalSize(1920, 1080);
+    if (argc > arg + 1 && std::string(argv[arg]) == "--resolution") {
+        std::string size = argv[arg + 1];
+        size_t separator = size.find('x');
+        if (separator != std::string::npos) {
+            logicalSize = sf::Vector2u(std::stoul(size.substr(0, separator)), std::stoul(size.substr(separator + 1)));
+        }
+        arg += 2;
+    }
+    // BhaataPhod --world-size 19200x10800 ...  (scrolling world, one screen by default)
+    sf::Vector2u worldSize;
+    if (argc > arg + 1 && std::string(argv[arg]) == "--world-size") {
+        std::string size = argv[arg + 1];
+        size_t separator = size.find('x');
+        if (separator != std::string::npos) {
+            // Input logs store the aim in 16 bits
+            worldSize = sf::Vector2u(std::min(std::stoul(size.substr(0, separator)), 32767ul), std::min(std::stoul(size.substr(separator + 1)), 32767ul));
+            worldSize = sf::Vector2u(std::max(worldSize.x, logicalSize.x), std::max(worldSize.y, logicalSize.y));
+        }
+        arg += 2;
+    }
+    // Live metrics once a second, applied to whichever game mode follows:
+    // BhaataPhod --telemetry unix:/run/bhaataphod.sock ...   (Unix socket the game connects to)
+    // BhaataPhod --telemetry metrics.jsonl [json|prometheus] ...   (rotating file)
+    TelemetryOptions telemetry;
+    if (argc > arg + 1 && std::string(argv[arg]) == "--telemetry") {
+        telemetry.target = argv[arg + 1];
+        arg += 2;
+        if (argc > arg && (std::string(argv[arg]) == "json" || std::string(argv[arg]) == "prometheus")) {
+            telemetry.format = std::string(argv[arg]) == "json" ? TelemetryOptions::Format::JsonLines : TelemetryOptions::Format::Prometheus;
+            ++arg;
+        }
+    }
+    // BhaataPhod --autoplay [ticks]  (scripted session with rendering, the PGO training workload)
+    if (argc > arg && std::string(argv[arg]) == "--autoplay") {
+        size_t ticks = argc > arg + 1 ? std::stoul(argv[arg + 1]) : 18000;
+        Game game("", NetOptions(), logicalSize, worldSize, true);
+        if (!telemetry.target.empty() && !game.enableTelemetry(telemetry)) {
+            return -1;
+        }
+        game.autoplay(ticks);
+        return 0;
+    }
+    // BhaataPhod --soak [minutes] [allowed growth %]  (simulated minutes; exits 1 if something keeps growing)
+    if (argc > arg && std::string(argv[arg]) == "--soak") {
+        size_t minutes = argc > arg + 1 ? std::stoul(argv[arg + 1]) : 30;
+        double allowedGrowth = argc > arg + 2 ? std::stod(argv[arg + 2]) / 100.0 : 0.25;
+        Game game("", NetOptions(), logicalSize, worldSize, true);
+        if (!telemetry.target.empty() && !game.enableTelemetry(telemetry)) {
+            return -1;
+        }
+        return game.soak(minutes, allowedGrowth);
+    }
+    // BhaataPhod --net-loopback [seconds] [asteroids]  (exits 1 if the state stream is over 100 kbps)
+    if (argc > arg && std::string(argv[arg]) == "--net-loopback") {
+        float seconds = argc > arg + 1 ? std::stof(argv[arg + 1]) : 10.f;
+        size_t asteroids = argc > arg + 2 ? std::stoul(argv[arg + 2]) : 300;
+        return runNetLoopback(seconds, conditions, asteroids);
+    }
+    // BhaataPhod --host [port]  /  BhaataPhod --join address [port]
+    NetOptions net;
+    net.conditions = conditions;
+    if (argc > arg && std::string(argv[arg]) == "--host") {
+        net.mode = NetOptions::Mode::Host;
+        if (argc > arg + 1) {
+            net.port = static_cast<unsigned short>(std::stoul(argv[arg + 1]));
+        }
+    }
+    else if (argc > arg + 1 && std::string(argv[arg]) == "--join") {
+        net.mode = NetOptions::Mode::Client;
+        net.hostAddress = argv[arg + 1];
+        if (argc > arg + 2) {
+            net.port = static_cast<unsigned short>(std::stoul(argv[arg + 2]));
+        }
+    }
+    // BhaataPhod --record sessions/run  (writes sessions/run-1.bprl, sessions/run-2.bprl, ...)
+    std::string recordPrefix = argc > arg + 1 && std::string(argv[arg]) == "--record" ? argv[arg + 1] : "";
 
-int main() {
-    Game game;
+    // The co-op state stream only carries a one-screen world
+    if (worldSize != sf::Vector2u() && net.mode != NetOptions::Mode::Offline) {
+        std::cerr << "--world-size cannot be combined with --host or --join" << std::endl;
+        return -1;
+    }
+
+    Game game(recordPrefix, net, logicalSize, worldSize);
+    if (!telemetry.target.empty() && !game.enableTelemetry(telemetry)) {
+        return -1;
+    }
     game.mainScreen();
     return 0;
-}
\ No newline at end of file
+}
+#endif
@@ -0,0 +1,94 @@
+/*
+ * C interface for running many headless Bhaata Phod matches at once, for bots
+ * and automated playtesting. Every handle is an independent simulation with
+ * its own seed. bp_step advances a whole batch of handles in parallel on a
+ * shared thread pool.
+ *
+ * Build BhaataPhod.cpp with BHAATAPHOD_BATCH defined to get a library without
+ * main(). Textures are still loaded from Materials/ because sprite sizes drive
+ * collision, so the host needs a GL context (a software one such as llvmpipe
+ * works). No window is opened and no audio is played.
+ */
+#ifndef BHAATAPHOD_BATCH_H
+#define BHAATAPHOD_BATCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(_WIN32)
+#define BP_API __declspec(dllexport)
+#else
+#define BP_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Every batch world is this size, in pixels, and steps this many seconds per tick. */
+#define BP_WORLD_WIDTH 1920
+#define BP_WORLD_HEIGHT 1080
+#define BP_TICK_SECONDS (1.0f / 60.0f)
+
+/*
+ * Observation layout: BP_OBSERVATION_HEADER_FLOATS header floats
+ *   [score, hearts (half-heart units), shockwaves left, game over (0/1),
+ *    player x, player y, player rotation (degrees), entity count]
+ * followed by BP_MAX_OBSERVED_ENTITIES slots of BP_OBSERVATION_ENTITY_FLOATS
+ *   [kind, x, y, width]
+ * sorted nearest to the player first. Unused slots are zero.
+ */
+#define BP_MAX_OBSERVED_ENTITIES 64
+#define BP_OBSERVATION_HEADER_FLOATS 8
+#define BP_OBSERVATION_ENTITY_FLOATS 4
+#define BP_OBSERVATION_FLOATS (BP_OBSERVATION_HEADER_FLOATS + BP_MAX_OBSERVED_ENTITIES * BP_OBSERVATION_ENTITY_FLOATS)
+
+/* Entity kinds in the observation. Asteroids are ASTEROID + EnemyType (Normal, Fast, Direct). */
+enum {
+    BP_KIND_NONE = 0,
+    BP_KIND_ASTEROID = 1,
+    BP_KIND_UFO = 4,
+    BP_KIND_UFO_BULLET = 5,
+    BP_KIND_PROJECTILE = 6,
+    BP_KIND_POWERUP = 7,
+    BP_KIND_MEDKIT = 8
+};
+
+typedef struct bp_game bp_game;
+
+/* One tick of input. aim is the world point the ship turns toward and fires at. */
+typedef struct bp_action {
+    float aim_x;
+    float aim_y;
+    uint8_t thrust;
+    uint8_t fire;
+    uint8_t shockwave;
+} bp_action;
+
+/* Returns NULL if the textures could not be loaded. */
+BP_API bp_game* bp_create(uint64_t seed);
+BP_API void bp_destroy(bp_game* game);
+BP_API void bp_reset(bp_game* game, uint64_t seed);
+
+/* Advance handles[i] by one tick with actions[i], for i in [0, n). */
+BP_API void bp_step(bp_game* const* handles, const bp_action* actions, size_t n);
+
+/* Write BP_OBSERVATION_FLOATS floats into buffer. Returns the number of entities written. */
+BP_API int bp_observe(bp_game* game, float* buffer);
+
+/*
+ * Snapshot the whole match into buffer. Returns the size the state needs; nothing
+ * is written if that is more than capacity, so pass NULL first to size a buffer.
+ * States name textures by id, so they load into any game built from the same assets.
+ */
+BP_API size_t bp_save_state(bp_game* game, void* buffer, size_t capacity);
+BP_API void bp_load_state(bp_game* game, const void* buffer, size_t size);
+
+/* Worker threads bp_step spreads a batch over, including the caller. */
+BP_API size_t bp_thread_count(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* BHAATAPHOD_BATCH_H */
@@ -0,0 +1,996 @@
+// Pieces of the game that need no window, GL context or audio: state
+// serialization, swept collision, the frame arena, the render thread hand-off,
+// the rewind history, input latching, the spawn schedule and the quality
+// governor. BhaataPhod.cpp includes this, and so do the tests in tests/.
+#ifndef BHAATAPHOD_CORE_H
+#define BHAATAPHOD_CORE_H
+
+#include <SFML/Graphics/Rect.hpp>
+#include <SFML/Graphics/Sprite.hpp>
+#include <SFML/Graphics/Texture.hpp>
+#include <SFML/System/Vector2.hpp>
+#include <SFML/Window/Event.hpp>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <memory_resource>
+#include <new>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// The textures saved state can name, numbered in the order they were added.
+// States store the number, so they load into any process that built its table
+// from the same assets in the same order.
+class TextureTable {
+public:
+    static constexpr std::uint32_t none = 0xFFFFFFFF;
+
+    void add(const sf::Texture& texture) {
+        textures.push_back(&texture);
+    }
+
+    std::uint32_t idOf(const sf::Texture* texture) const {
+        for (size_t i = 0; i < textures.size(); ++i) {
+            if (textures[i] == texture) {
+                return static_cast<std::uint32_t>(i);
+            }
+        }
+        return none;
+    }
+
+    // Null for `none` or an id this table does not have
+    const sf::Texture* get(std::uint32_t id) const {
+        return id < textures.size() ? textures[id] : nullptr;
+    }
+
+private:
+    std::vector<const sf::Texture*> textures;
+};
+
+// Appends trivially copyable values to a flat byte buffer, in host byte order.
+// The buffer is reused between saves, so once it has grown to size a save does
+// not allocate.
+class StateWriter {
+public:
+    explicit StateWriter(std::vector<unsigned char>& buffer, const TextureTable* textures = nullptr) : buffer(buffer), textures(textures) {
+        buffer.clear();
+    }
+
+    template <typename T>
+    void write(const T& value) {
+        static_assert(std::is_trivially_copyable<T>::value, "state must be trivially copyable");
+        size_t offset = buffer.size();
+        buffer.resize(offset + sizeof(T));
+        std::memcpy(buffer.data() + offset, &value, sizeof(T));
+    }
+
+    void writeBytes(const void* data, size_t size) {
+        size_t offset = buffer.size();
+        buffer.resize(offset + size);
+        if (size > 0) {
+            std::memcpy(buffer.data() + offset, data, size);
+        }
+    }
+
+    // What sprites are saved against; may be null
+    const TextureTable* textureTable() const {
+        return textures;
+    }
+
+private:
+    std::vector<unsigned char>& buffer;
+    const TextureTable* textures;
+};
+
+// Reads values back in the order StateWriter wrote them
+class StateReader {
+public:
+    StateReader(const unsigned char* data, size_t size, const TextureTable* textures = nullptr) : data(data), size(size), textures(textures) {}
+
+    template <typename T>
+    void read(T& value) {
+        static_assert(std::is_trivially_copyable<T>::value, "state must be trivially copyable");
+        if (offset + sizeof(T) <= size) {
+            std::memcpy(&value, data + offset, sizeof(T));
+        }
+        offset += sizeof(T);
+    }
+
+    void readBytes(void* out, size_t count) {
+        if (offset + count <= size && count > 0) {
+            std::memcpy(out, data + offset, count);
+        }
+        offset += count;
+    }
+
+    void skip(size_t count) {
+        offset += count;
+    }
+
+    // False once a read has run past the end
+    bool isValid() const {
+        return offset <= size;
+    }
+
+    size_t remaining() const {
+        return offset < size ? size - offset : 0;
+    }
+
+    const unsigned char* cursor() const {
+        return data + std::min(offset, size);
+    }
+
+    const TextureTable* textureTable() const {
+        return textures;
+    }
+
+private:
+    const unsigned char* data;
+    size_t size;
+    size_t offset = 0;
+    const TextureTable* textures;
+};
+
+// A sprite as saved state holds it, its texture named by TextureTable id. All
+// fields are 4 bytes, so there is no padding to leave unset bytes in a state.
+struct SavedSprite {
+    std::uint32_t texture;
+    sf::IntRect textureRect;
+    sf::Vector2f position;
+    sf::Vector2f origin;
+    sf::Vector2f scale;
+    float rotation;
+};
+
+inline void writeSprite(StateWriter& writer, const sf::Sprite& sprite) {
+    const TextureTable* textures = writer.textureTable();
+    writer.write(SavedSprite{ textures ? textures->idOf(sprite.getTexture()) : TextureTable::none, sprite.getTextureRect(),
+        sprite.getPosition(), sprite.getOrigin(), sprite.getScale(), sprite.getRotation() });
+}
+
+// A sprite whose id the reader's table does not know keeps the texture it has
+inline void readSprite(StateReader& reader, sf::Sprite& sprite) {
+    SavedSprite saved{};
+    reader.read(saved);
+    const sf::Texture* texture = reader.textureTable() ? reader.textureTable()->get(saved.texture) : nullptr;
+    if (texture) {
+        sprite.setTexture(*texture);
+    }
+    sprite.setTextureRect(saved.textureRect);
+    sprite.setPosition(saved.position);
+    sprite.setOrigin(saved.origin);
+    sprite.setScale(saved.scale);
+    sprite.setRotation(saved.rotation);
+}
+
+// Swept collision for fast movers, so a hit does not depend on how long the tick
+// was. The mover is a box of `halfSize` whose centre went from `from` to `to`;
+// against a still `target` that is a segment against the target grown by the
+// half size (slab test). Returns the fraction of the move at first contact, 0 if
+// they already overlapped at the start, or -1 for a miss.
+inline float sweepBox(const sf::Vector2f& from, const sf::Vector2f& to, const sf::Vector2f& halfSize, const sf::FloatRect& target) {
+    float enter = 0.f;
+    float exit = 1.f;
+    const float start[2] = { from.x, from.y };
+    const float delta[2] = { to.x - from.x, to.y - from.y };
+    const float low[2] = { target.left - halfSize.x, target.top - halfSize.y };
+    const float high[2] = { target.left + target.width + halfSize.x, target.top + target.height + halfSize.y };
+    for (int axis = 0; axis < 2; ++axis) {
+        if (delta[axis] == 0.f) {
+            if (start[axis] < low[axis] || start[axis] > high[axis]) {
+                return -1.f;
+            }
+            continue;
+        }
+        float t0 = (low[axis] - start[axis]) / delta[axis];
+        float t1 = (high[axis] - start[axis]) / delta[axis];
+        if (t0 > t1) {
+            std::swap(t0, t1);
+        }
+        enter = std::max(enter, t0);
+        exit = std::min(exit, t1);
+        if (enter > exit) {
+            return -1.f;
+        }
+    }
+    return enter;
+}
+
+// Everything a box of `bounds` touched on its way from `from` to where it is now, for the broadphase
+inline sf::FloatRect sweptBounds(const sf::FloatRect& bounds, const sf::Vector2f& from, const sf::Vector2f& to) {
+    sf::Vector2f shift = from - to;
+    float left = std::min(bounds.left, bounds.left + shift.x);
+    float top = std::min(bounds.top, bounds.top + shift.y);
+    return sf::FloatRect(left, top, bounds.width + std::abs(shift.x), bounds.height + std::abs(shift.y));
+}
+
+// Bump allocator for scratch data that only lives for one frame, handed to
+// std::pmr containers. Deallocation is a no-op and reset() frees the whole frame
+// at once by rewinding the offset. A frame that does not fit takes the rest from
+// the heap and the buffer grows to fit it at the next reset, so the heap is only
+// touched while the arena warms up. Debug builds poison freed bytes so a value
+// that outlives its frame reads as garbage. One arena per thread.
+class FrameArena : public std::pmr::memory_resource {
+public:
+    explicit FrameArena(size_t capacity) : buffer(capacity) {}
+
+    FrameArena(const FrameArena&) = delete;
+    FrameArena& operator=(const FrameArena&) = delete;
+
+    ~FrameArena() override {
+        releaseOverflow();
+    }
+
+    void reset() {
+        if (!overflow.empty()) {
+            releaseOverflow();
+            buffer = std::vector<unsigned char>(requested + requested / 2);
+        }
+#ifndef NDEBUG
+        std::memset(buffer.data(), poisonByte, used);
+#endif
+        used = 0;
+        requested = 0;
+    }
+
+    // Allocations that did not fit and went to the heap, since the arena was made
+    size_t heapFallbacks() const {
+        return fallbacks;
+    }
+
+private:
+    static const unsigned char poisonByte = 0xDD;
+
+    struct OverflowBlock {
+        void* pointer;
+        size_t size;
+        size_t alignment;
+    };
+
+    void* do_allocate(size_t bytes, size_t alignment) override {
+        requested += bytes + alignment - 1;
+        std::uintptr_t base = reinterpret_cast<std::uintptr_t>(buffer.data());
+        size_t offset = ((base + used + alignment - 1) & ~(static_cast<std::uintptr_t>(alignment) - 1)) - base;
+        if (offset + bytes <= buffer.size()) {
+            used = offset + bytes;
+            return buffer.data() + offset;
+        }
+        ++fallbacks;
+        void* pointer = ::operator new(bytes, std::align_val_t(alignment));
+        overflow.push_back(OverflowBlock{ pointer, bytes, alignment });
+        return pointer;
+    }
+
+    void do_deallocate([[maybe_unused]] void* pointer, [[maybe_unused]] size_t bytes, size_t) override {
+#ifndef NDEBUG
+        unsigned char* bytePointer = static_cast<unsigned char*>(pointer);
+        if (bytePointer >= buffer.data() && bytePointer < buffer.data() + buffer.size()) {
+            std::memset(bytePointer, poisonByte, bytes);
+        }
+#endif
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+
+    void releaseOverflow() {
+        for (const OverflowBlock& block : overflow) {
+            ::operator delete(block.pointer, block.size, std::align_val_t(block.alignment));
+        }
+        overflow.clear();
+    }
+
+    std::vector<unsigned char> buffer;
+    size_t used = 0;
+    size_t requested = 0; // Bytes this frame asked for, padding included, wherever they landed
+    size_t fallbacks = 0;
+    std::vector<OverflowBlock> overflow;
+};
+
+// Lock-free triple buffer. The writer fills writeBuffer() and publishes it, the
+// reader picks up the newest published buffer; neither ever waits on the other.
+template <typename T>
+class TripleBuffer {
+public:
+    T& writeBuffer() {
+        return buffers[backIndex];
+    }
+
+    void publish() {
+        int previous = middle.exchange(backIndex | freshBit, std::memory_order_acq_rel);
+        backIndex = previous & indexMask;
+    }
+
+    // Swaps in the newest published buffer. Returns false if nothing new arrived.
+    bool consume() {
+        if (!(middle.load(std::memory_order_relaxed) & freshBit)) {
+            return false;
+        }
+        int previous = middle.exchange(frontIndex, std::memory_order_acq_rel);
+        frontIndex = previous & indexMask;
+        return true;
+    }
+
+    const T& readBuffer() const {
+        return buffers[frontIndex];
+    }
+
+private:
+    static const int indexMask = 3;
+    static const int freshBit = 4;
+    T buffers[3];
+    int backIndex = 0;
+    int frontIndex = 1;
+    std::atomic<int> middle{ 2 };
+};
+
+// Lock-free single-producer, single-consumer ring of fixed capacity. push fails
+// rather than waits when the ring is full, so the producer never blocks.
+template <typename T, size_t Capacity>
+class SpscQueue {
+public:
+    bool push(const T& value) {
+        size_t tailIndex = tail.load(std::memory_order_relaxed);
+        size_t next = (tailIndex + 1) % Capacity;
+        if (next == head.load(std::memory_order_acquire)) {
+            return false;
+        }
+        slots[tailIndex] = value;
+        tail.store(next, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T& value) {
+        size_t headIndex = head.load(std::memory_order_relaxed);
+        if (headIndex == tail.load(std::memory_order_acquire)) {
+            return false;
+        }
+        value = slots[headIndex];
+        head.store((headIndex + 1) % Capacity, std::memory_order_release);
+        return true;
+    }
+
+private:
+    std::array<T, Capacity> slots{};
+    // Apart, so the two threads do not fight over one cache line
+    alignas(64) std::atomic<size_t> head{ 0 };
+    alignas(64) std::atomic<size_t> tail{ 0 };
+};
+
+// Byte-level delta encoding shared by the rewind history and the network state
+// stream. A delta lists the runs of bytes that changed since the previous state.
+namespace DeltaCodec {
+    inline void writeVarint(std::vector<unsigned char>& out, size_t value) {
+        while (value >= 0x80) {
+            out.push_back(static_cast<unsigned char>(value | 0x80));
+            value >>= 7;
+        }
+        out.push_back(static_cast<unsigned char>(value));
+    }
+
+    inline bool readVarint(const unsigned char*& data, const unsigned char* end, size_t& value) {
+        value = 0;
+        for (int shift = 0; data < end && shift < 64; shift += 7) {
+            unsigned char byte = *data++;
+            value |= static_cast<size_t>(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Bytes past the end of the previous state count as zero
+    inline unsigned char byteAt(const std::vector<unsigned char>& state, size_t index) {
+        return index < state.size() ? state[index] : 0;
+    }
+
+    // Encodes `current` as (unchanged run length, changed run length, changed bytes) triples.
+    // A changed run only ends at four unchanged bytes in a row, to keep short gaps cheap.
+    inline void encodeDelta(const std::vector<unsigned char>& previous, const std::vector<unsigned char>& current, std::vector<unsigned char>& out) {
+        out.clear();
+        size_t i = 0;
+        while (i < current.size()) {
+            size_t unchangedStart = i;
+            while (i < current.size() && current[i] == byteAt(previous, i)) {
+                ++i;
+            }
+            if (i == current.size()) {
+                break;
+            }
+            size_t changedStart = i;
+            size_t unchangedRun = 0;
+            while (i < current.size() && unchangedRun < 4) {
+                unchangedRun = current[i] == byteAt(previous, i) ? unchangedRun + 1 : 0;
+                ++i;
+            }
+            size_t changedEnd = i - unchangedRun;
+            i = changedEnd;
+            writeVarint(out, changedStart - unchangedStart);
+            writeVarint(out, changedEnd - changedStart);
+            out.insert(out.end(), current.begin() + changedStart, current.begin() + changedEnd);
+        }
+    }
+
+    // Rebuilds `state` in place from the previous state it holds and an encoded delta.
+    // Returns false if the delta is malformed, which only happens with network input.
+    inline bool applyDelta(const unsigned char* data, size_t size, size_t rawSize, std::vector<unsigned char>& state) {
+        state.resize(rawSize);
+        const unsigned char* end = data + size;
+        size_t offset = 0;
+        while (data < end) {
+            size_t unchanged = 0;
+            size_t changed = 0;
+            if (!readVarint(data, end, unchanged) || !readVarint(data, end, changed) ||
+                unchanged > rawSize - offset || changed > rawSize - offset - unchanged || changed > static_cast<size_t>(end - data)) {
+                return false;
+            }
+            offset += unchanged;
+            std::memcpy(state.data() + offset, data, changed);
+            data += changed;
+            offset += changed;
+        }
+        return true;
+    }
+}
+
+// Ring of recent World states. Each frame is stored as the runs of bytes that
+// changed since the frame before it, with a full keyframe every
+// `keyframeInterval` frames so a restore only decodes a short chain.
+// Frame buffers are reused as the ring wraps, so pushing does not allocate
+// once every slot has grown to size.
+class StateHistory {
+public:
+    StateHistory(size_t capacity, size_t keyframeInterval)
+        : frames(capacity), keyframeInterval(keyframeInterval) {}
+
+    void push(const std::vector<unsigned char>& state) {
+        Frame& frame = frames[head];
+        frame.keyframe = count == 0 || framesSinceKeyframe + 1 >= keyframeInterval;
+        frame.rawSize = state.size();
+        if (frame.keyframe) {
+            frame.data.assign(state.begin(), state.end());
+            framesSinceKeyframe = 0;
+        }
+        else {
+            DeltaCodec::encodeDelta(previous, state, frame.data);
+            ++framesSinceKeyframe;
+        }
+        previous.assign(state.begin(), state.end());
+        head = (head + 1) % frames.size();
+        count = std::min(count + 1, frames.size());
+    }
+
+    // Rebuilds the state from `framesBack` frames before the newest one into `out`
+    // and drops every frame after it. Returns false if that frame is no longer held.
+    bool rewind(size_t framesBack, std::vector<unsigned char>& out) {
+        if (framesBack >= count) {
+            return false;
+        }
+        size_t target = (head + frames.size() - 1 - framesBack) % frames.size();
+
+        // Walk back to the keyframe the target was encoded against
+        size_t keyframe = target;
+        size_t chain = 0;
+        while (!frames[keyframe].keyframe) {
+            keyframe = (keyframe + frames.size() - 1) % frames.size();
+            if (++chain + framesBack >= count) {
+                return false; // The keyframe has already been overwritten
+            }
+        }
+
+        out.assign(frames[keyframe].data.begin(), frames[keyframe].data.end());
+        for (size_t index = (keyframe + 1) % frames.size(); chain > 0; index = (index + 1) % frames.size(), --chain) {
+            const Frame& frame = frames[index];
+            DeltaCodec::applyDelta(frame.data.data(), frame.data.size(), frame.rawSize, out);
+        }
+
+        head = (target + 1) % frames.size();
+        count -= framesBack;
+        framesSinceKeyframe = chain;
+        for (size_t index = target; !frames[index].keyframe; index = (index + frames.size() - 1) % frames.size()) {
+            ++framesSinceKeyframe;
+        }
+        previous.assign(out.begin(), out.end());
+        return true;
+    }
+
+    void clear() {
+        head = 0;
+        count = 0;
+        framesSinceKeyframe = 0;
+        previous.clear();
+    }
+
+    size_t size() const {
+        return count;
+    }
+
+    // Encoded bytes held for the frames currently in the ring
+    size_t bytesUsed() const {
+        size_t bytes = 0;
+        for (size_t i = 0; i < count; ++i) {
+            bytes += frames[(head + frames.size() - 1 - i) % frames.size()].data.size();
+        }
+        return bytes;
+    }
+
+private:
+    struct Frame {
+        bool keyframe = false;
+        size_t rawSize = 0;
+        std::vector<unsigned char> data;
+    };
+
+    std::vector<Frame> frames;
+    size_t keyframeInterval;
+    size_t head = 0;
+    size_t count = 0;
+    size_t framesSinceKeyframe = 0;
+    std::vector<unsigned char> previous;
+};
+
+// Input for one simulation tick, whether it comes from the mouse and keyboard or a bot
+struct PlayerInput {
+    sf::Vector2f aim;       // Point the ship turns toward and fires at
+    bool thrust = false;
+    bool fire = false;
+    bool shockwave = false; // Set for the one tick the shockwave was requested
+};
+
+// Mouse and thrust events in the order they came off the window's queue, each
+// stamped with when it was read, folded into one tick's input at a time. Polling
+// the button once a tick drops clicks shorter than a tick; replaying the events
+// keeps every press, and a press that lands while the trigger still reads as
+// held is carried into a later tick so the world still sees a fresh press.
+class InputLayer {
+public:
+    struct Tick {
+        sf::Vector2i mouse;   // Newest pointer position, in window pixels
+        bool fire = false;
+        bool thrust = false;
+        sf::Int64 stamp = -1; // When the oldest press acted on this tick was read, -1 if none
+    };
+
+    void reset(const sf::Vector2i& mouse) {
+        queue.clear();
+        pendingPresses.clear();
+        mousePosition = mouse;
+        fireHeld = thrustHeld = lastFire = false;
+    }
+
+    // Queues the events the layer handles and returns false for everything else
+    bool push(const sf::Event& event, sf::Int64 stamp) {
+        switch (event.type) {
+        case sf::Event::MouseMoved:
+            queue.push_back(Queued{ Move, sf::Vector2i(event.mouseMove.x, event.mouseMove.y), stamp });
+            return true;
+        case sf::Event::MouseButtonPressed:
+        case sf::Event::MouseButtonReleased:
+            if (event.mouseButton.button != sf::Mouse::Left) {
+                return false;
+            }
+            queue.push_back(Queued{ event.type == sf::Event::MouseButtonPressed ? FireDown : FireUp,
+                sf::Vector2i(event.mouseButton.x, event.mouseButton.y), stamp });
+            return true;
+        case sf::Event::KeyPressed:
+        case sf::Event::KeyReleased:
+            if (event.key.code != sf::Keyboard::Up) {
+                return false;
+            }
+            queue.push_back(Queued{ event.type == sf::Event::KeyPressed ? ThrustDown : ThrustUp, mousePosition, stamp });
+            return true;
+        case sf::Event::LostFocus:
+            // Releases that happen in another window never arrive
+            queue.push_back(Queued{ FireUp, mousePosition, stamp });
+            queue.push_back(Queued{ ThrustUp, mousePosition, stamp });
+            return false;
+        default:
+            return false;
+        }
+    }
+
+    // Replays everything queued since the last tick, in order
+    Tick nextTick() {
+        Tick tick;
+        bool thrustTapped = false;
+        for (const Queued& entry : queue) {
+            switch (entry.kind) {
+            case Move:
+                mousePosition = entry.position;
+                break;
+            case FireDown:
+                mousePosition = entry.position;
+                fireHeld = true;
+                pendingPresses.push_back(entry.stamp);
+                break;
+            case FireUp:
+                fireHeld = false;
+                break;
+            case ThrustDown:
+                // Key repeat sends more presses while the key is held
+                if (!thrustHeld) {
+                    thrustTapped = true;
+                    tick.stamp = tick.stamp < 0 ? entry.stamp : std::min(tick.stamp, entry.stamp);
+                }
+                thrustHeld = true;
+                break;
+            case ThrustUp:
+                thrustHeld = false;
+                break;
+            }
+        }
+        queue.clear();
+
+        // The world fires on a released-then-pressed trigger, so a press right after
+        // a held tick needs one released tick first
+        if (!pendingPresses.empty() && !lastFire) {
+            tick.fire = true;
+            tick.stamp = tick.stamp < 0 ? pendingPresses.front() : std::min(tick.stamp, pendingPresses.front());
+            pendingPresses.pop_front();
+        }
+        else if (!pendingPresses.empty()) {
+            tick.fire = false;
+        }
+        else {
+            tick.fire = fireHeld;
+        }
+        lastFire = tick.fire;
+        tick.thrust = thrustHeld || thrustTapped;
+        tick.mouse = mousePosition;
+        return tick;
+    }
+
+private:
+    enum Kind : std::uint8_t { Move, FireDown, FireUp, ThrustDown, ThrustUp };
+
+    struct Queued {
+        Kind kind;
+        sf::Vector2i position;
+        sf::Int64 stamp;
+    };
+
+    std::vector<Queued> queue;
+    std::deque<sf::Int64> pendingPresses;
+    sf::Vector2i mousePosition;
+    bool fireHeld = false;
+    bool thrustHeld = false;
+    bool lastFire = false;
+};
+
+// Binary input log, in the recording machine's byte order (values are copied
+// as they sit in memory), so a log replays on machines of the same endianness:
+//   header  "BPR2", u64 seed, u32 world width, u32 world height, u32 view width, u32 view height
+//           ("BPR1" logs stop after the world size; their view is the whole world)
+//   tick    u8 1, f32 deltaTime, i16 aim x, i16 aim y, u8 flags (thrust, fire, shockwave)
+//   end     u8 2, u64 World::checksum() after the last tick
+// The aim is stored in whole pixels; the game rounds it with wholeAim before
+// the world sees it, so a replay steers exactly as the recorded session did.
+namespace InputLog {
+    const char magic[4] = { 'B', 'P', 'R', '2' };
+    const char singleScreenMagic[4] = { 'B', 'P', 'R', '1' };
+    const std::uint8_t tickRecord = 1;
+    const std::uint8_t endRecord = 2;
+    const std::uint8_t thrustFlag = 1;
+    const std::uint8_t fireFlag = 2;
+    const std::uint8_t shockwaveFlag = 4;
+
+    // The aim as a log or the co-op stream carries it: rounded to the nearest pixel within 16 bits
+    inline sf::Vector2f wholeAim(const sf::Vector2f& aim) {
+        auto whole = [](float value) {
+            return static_cast<float>(std::clamp(std::lround(value), -32768l, 32767l));
+        };
+        return sf::Vector2f(whole(aim.x), whole(aim.y));
+    }
+
+    template <typename T>
+    void write(std::ostream& stream, T value) {
+        unsigned char bytes[sizeof(T)];
+        std::memcpy(bytes, &value, sizeof(T));
+        stream.write(reinterpret_cast<const char*>(bytes), sizeof(T));
+    }
+
+    template <typename T>
+    bool read(std::istream& stream, T& value) {
+        unsigned char bytes[sizeof(T)];
+        if (!stream.read(reinterpret_cast<char*>(bytes), sizeof(T))) {
+            return false;
+        }
+        std::memcpy(&value, bytes, sizeof(T));
+        return true;
+    }
+}
+
+class InputRecorder {
+public:
+    bool begin(const std::string& path, std::uint64_t seed, const sf::Vector2u& worldSize, const sf::Vector2u& viewSize) {
+        file.open(path, std::ios::binary | std::ios::trunc);
+        if (!file) {
+            std::cerr << "Error opening input log " << path << std::endl;
+            return false;
+        }
+        file.write(InputLog::magic, sizeof(InputLog::magic));
+        InputLog::write<std::uint64_t>(file, seed);
+        InputLog::write<std::uint32_t>(file, worldSize.x);
+        InputLog::write<std::uint32_t>(file, worldSize.y);
+        InputLog::write<std::uint32_t>(file, viewSize.x);
+        InputLog::write<std::uint32_t>(file, viewSize.y);
+        return true;
+    }
+
+    void record(float deltaTime, const PlayerInput& input) {
+        if (!file.is_open()) {
+            return;
+        }
+        std::uint8_t flags = (input.thrust ? InputLog::thrustFlag : 0) | (input.fire ? InputLog::fireFlag : 0) | (input.shockwave ? InputLog::shockwaveFlag : 0);
+        InputLog::write<std::uint8_t>(file, InputLog::tickRecord);
+        InputLog::write<float>(file, deltaTime);
+        sf::Vector2f aim = InputLog::wholeAim(input.aim);
+        InputLog::write<std::int16_t>(file, static_cast<std::int16_t>(aim.x));
+        InputLog::write<std::int16_t>(file, static_cast<std::int16_t>(aim.y));
+        InputLog::write<std::uint8_t>(file, flags);
+    }
+
+    void end(std::uint64_t checksum) {
+        if (!file.is_open()) {
+            return;
+        }
+        InputLog::write<std::uint8_t>(file, InputLog::endRecord);
+        InputLog::write<std::uint64_t>(file, checksum);
+        file.close();
+    }
+
+    bool isRecording() const {
+        return file.is_open();
+    }
+
+private:
+    std::ofstream file;
+};
+
+class InputReplay {
+public:
+    bool open(const std::string& path) {
+        file.open(path, std::ios::binary);
+        char header[4];
+        bool singleScreen = false;
+        if (file && file.read(header, sizeof(header))) {
+            singleScreen = std::memcmp(header, InputLog::singleScreenMagic, sizeof(header)) == 0;
+        }
+        if (!file || (!singleScreen && std::memcmp(header, InputLog::magic, sizeof(header)) != 0) ||
+            !InputLog::read(file, seed) || !InputLog::read(file, worldSize.x) || !InputLog::read(file, worldSize.y) ||
+            (!singleScreen && (!InputLog::read(file, viewSize.x) || !InputLog::read(file, viewSize.y)))) {
+            std::cerr << "Error reading input log " << path << std::endl;
+            return false;
+        }
+        if (singleScreen) {
+            viewSize = worldSize;
+        }
+        return true;
+    }
+
+    // Reads the next tick. Returns false at the end of the log.
+    bool next(float& deltaTime, PlayerInput& input) {
+        std::uint8_t tag = 0;
+        if (!InputLog::read(file, tag)) {
+            return false;
+        }
+        if (tag == InputLog::endRecord) {
+            hasChecksum = InputLog::read(file, expectedChecksum);
+            return false;
+        }
+        std::int16_t aimX = 0, aimY = 0;
+        std::uint8_t flags = 0;
+        if (tag != InputLog::tickRecord || !InputLog::read(file, deltaTime) || !InputLog::read(file, aimX) || !InputLog::read(file, aimY) || !InputLog::read(file, flags)) {
+            return false;
+        }
+        input.aim = sf::Vector2f(aimX, aimY);
+        input.thrust = (flags & InputLog::thrustFlag) != 0;
+        input.fire = (flags & InputLog::fireFlag) != 0;
+        input.shockwave = (flags & InputLog::shockwaveFlag) != 0;
+        return true;
+    }
+
+    std::uint64_t seed = 0;
+    sf::Vector2u worldSize;
+    sf::Vector2u viewSize;
+    bool hasChecksum = false;
+    std::uint64_t expectedChecksum = 0;
+
+private:
+    std::ifstream file;
+};
+
+// One wave of the spawn director. Waves play in order and the last one never ends.
+struct SpawnWave {
+    float duration = 0.f;         // Seconds before the next wave takes over
+    float interval = 1.f;         // Seconds between asteroid spawns
+    int weights[3] = { 9, 5, 1 }; // Relative chance of each EnemyType: Normal, Fast, Direct
+    int group = 2;                // Normal asteroids arrive side by side, this many at a time
+    int maxAsteroids = 60;        // Live asteroid cap
+    int UFOsPerDrop = 2;          // UFOs that come in with each medkit
+    int maxUFOs = 4;              // Live UFO cap
+};
+
+// Hard limits the director keeps to whatever the waves ask for
+struct SpawnBudget {
+    int maxEntities = 400;    // Live asteroids, UFOs, shots and pickups together
+    int maxSpawnsPerTick = 4; // Asteroid spawns one tick may add; the rest wait for later ticks
+    int maxDeferred = 4;      // Spawns allowed to wait; the director skips any beyond this
+};
+
+// Contents of Materials/waves.txt. Lines are a keyword and its values, '#' starts a comment:
+//   initial <asteroids at the start>
+//   budget <max entities> <max spawns per tick> <max deferred>
+//   wave <duration> <interval> <normal> <fast> <direct> <group> <max asteroids> <UFOs per drop> <max UFOs>
+struct SpawnConfig {
+    int initialAsteroids = 10;
+    SpawnBudget budget;
+    std::vector<SpawnWave> waves = std::vector<SpawnWave>(1);
+
+    // A missing file keeps the built-in single wave. Returns false if the file is malformed.
+    bool loadFromFile(const std::string& path) {
+        std::ifstream file(path);
+        if (!file) {
+            return true;
+        }
+        std::vector<SpawnWave> loadedWaves;
+        std::string line;
+        int lineNumber = 0;
+        while (std::getline(file, line)) {
+            ++lineNumber;
+            line = line.substr(0, line.find('#'));
+            std::istringstream fields(line);
+            std::string keyword;
+            if (!(fields >> keyword)) {
+                continue;
+            }
+            bool valid = false;
+            if (keyword == "initial") {
+                valid = static_cast<bool>(fields >> initialAsteroids);
+            }
+            else if (keyword == "budget") {
+                valid = static_cast<bool>(fields >> budget.maxEntities >> budget.maxSpawnsPerTick >> budget.maxDeferred);
+            }
+            else if (keyword == "wave") {
+                SpawnWave wave;
+                valid = static_cast<bool>(fields >> wave.duration >> wave.interval >> wave.weights[0] >> wave.weights[1] >> wave.weights[2]
+                    >> wave.group >> wave.maxAsteroids >> wave.UFOsPerDrop >> wave.maxUFOs) &&
+                    wave.interval > 0.f && wave.weights[0] + wave.weights[1] + wave.weights[2] > 0;
+                loadedWaves.push_back(wave);
+            }
+            if (!valid) {
+                std::cerr << "Error in " << path << " line " << lineNumber << ": " << line << std::endl;
+                return false;
+            }
+        }
+        if (!loadedWaves.empty()) {
+            waves = loadedWaves;
+        }
+        return true;
+    }
+};
+
+// What one quality level keeps. Level 0 is full quality; every level after it
+// gives up a little more to hold the frame rate.
+struct QualityLevel {
+    float particleDensity; // Fraction of each effect's particles that are emitted
+    int particleStride;    // Particles animate every this many frames, with the time of all of them
+    float renderScale;     // Scene resolution as a fraction of the logical resolution
+    int hudInterval;       // Frames between HUD text rebuilds
+    int farUpdateInterval; // Ticks between updates of far, off-screen entities
+    int maxSounds;         // Effect voices that may play at once
+};
+
+// Picks the quality level from a rolling window of frame times. It drops a level
+// once the window averages over the target and climbs back only after a long
+// stretch under it. A climb that drops straight back doubles the wait before the
+// next one, so a machine that cannot hold a level settles below it on its own.
+class QualityGovernor {
+public:
+    static constexpr int levelCount = 5;
+
+    static const QualityLevel& level(int index) {
+        static const QualityLevel levels[levelCount] = {
+            { 1.f, 1, 1.f, 1, 4, 4 },
+            { 0.75f, 1, 0.9f, 2, 4, 4 },
+            { 0.5f, 2, 0.8f, 4, 6, 3 },
+            { 0.35f, 2, 0.7f, 6, 8, 2 },
+            { 0.2f, 3, 0.5f, 10, 8, 2 }
+        };
+        return levels[index];
+    }
+
+    explicit QualityGovernor(float targetFrameTime) : target(targetFrameTime) {}
+
+    // Returns true if the frame changed the level
+    bool addFrame(float seconds) {
+        // A lone hitch, such as a level load, should not count as sustained load
+        seconds = std::min(seconds, target * 2.f);
+        windowSum += seconds - window[windowNext];
+        window[windowNext] = seconds;
+        windowNext = (windowNext + 1) % windowSize;
+        windowFilled = std::min(windowFilled + 1, windowSize);
+        ++framesAtLevel;
+        ++framesPerLevel[current];
+
+        // Only judge a level once the whole window was drawn at it
+        if (windowFilled < windowSize || framesAtLevel < windowSize) {
+            return false;
+        }
+        if (onProbation && framesAtLevel >= probationFrames) {
+            onProbation = false;
+            climbWait = baseClimbWait;
+        }
+        float average = static_cast<float>(windowSum / windowSize);
+        if (average > target * 1.1f && current < levelCount - 1) {
+            if (onProbation) {
+                climbWait = std::min(climbWait * 2, maxClimbWait);
+                onProbation = false;
+            }
+            setLevel(current + 1);
+            return true;
+        }
+        if (average < target * 1.02f && framesAtLevel >= climbWait && current > 0) {
+            setLevel(current - 1);
+            onProbation = true;
+            return true;
+        }
+        return false;
+    }
+
+    int getLevel() const {
+        return current;
+    }
+
+    // Share of frames spent at each level since the game started
+    void report(std::ostream& out) const {
+        size_t total = 0;
+        for (size_t frames : framesPerLevel) {
+            total += frames;
+        }
+        if (total == 0) {
+            return;
+        }
+        out << "quality:";
+        for (int i = 0; i < levelCount; ++i) {
+            out << " L" << i << " " << 100.0 * framesPerLevel[i] / total << "%";
+        }
+        out << ", " << changes << " level changes over " << total << " frames" << std::endl;
+    }
+
+private:
+    void setLevel(int index) {
+        current = index;
+        framesAtLevel = 0;
+        ++changes;
+    }
+
+    static constexpr int windowSize = 60;
+    static constexpr int baseClimbWait = 240;
+    static constexpr int maxClimbWait = 240 * 16;
+    static constexpr int probationFrames = 600; // A climb that lasts this long has held
+
+    float target;
+    std::array<float, windowSize> window{};
+    double windowSum = 0.0;
+    int windowNext = 0;
+    int windowFilled = 0;
+    int current = 0;
+    int framesAtLevel = 0;
+    int climbWait = baseClimbWait;
+    bool onProbation = false;
+    size_t changes = 0;
+    std::array<size_t, levelCount> framesPerLevel{};
+};
+
+#endif // BHAATAPHOD_CORE_H
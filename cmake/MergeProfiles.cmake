@@ -0,0 +1,14 @@
+# Merges the raw profiles of a Clang training run into the one file -fprofile-instr-use reads.
+#   cmake -DPROFDATA_TOOL=llvm-profdata -DPROFILE_DIR=dir -DOUTPUT=file.profdata -P MergeProfiles.cmake
+
+file(GLOB raw_profiles "${PROFILE_DIR}/*.profraw")
+if(NOT raw_profiles)
+    message(FATAL_ERROR "The training run left no profiles in ${PROFILE_DIR}")
+endif()
+
+execute_process(
+    COMMAND "${PROFDATA_TOOL}" merge "-output=${OUTPUT}" ${raw_profiles}
+    RESULT_VARIABLE result)
+if(NOT result EQUAL 0)
+    message(FATAL_ERROR "llvm-profdata merge failed")
+endif()
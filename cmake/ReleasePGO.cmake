@@ -0,0 +1,17 @@
+# The whole release-pgo build: instrumented build, training run, then the
+# optimized rebuild from the recorded profile. Run from the source directory:
+#   cmake -P cmake/ReleasePGO.cmake
+# Prefix with xvfb-run on a machine without a display.
+
+function(run_step)
+    execute_process(COMMAND ${ARGN} WORKING_DIRECTORY "${CMAKE_CURRENT_LIST_DIR}/.." RESULT_VARIABLE result)
+    if(NOT result EQUAL 0)
+        message(FATAL_ERROR "release-pgo step failed: ${ARGN}")
+    endif()
+endfunction()
+
+run_step(${CMAKE_COMMAND} --preset release-pgo-generate)
+run_step(${CMAKE_COMMAND} --build --preset release-pgo-generate)
+run_step(${CMAKE_COMMAND} --build --preset release-pgo-train)
+run_step(${CMAKE_COMMAND} --preset release-pgo)
+run_step(${CMAKE_COMMAND} --build --preset release-pgo)
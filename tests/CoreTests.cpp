@@ -0,0 +1,446 @@
+// Tests for the window-free pieces in BhaataPhodCore.h. Run through CTest, or
+// directly from the build directory; the exit code is the number of failures.
+#include "BhaataPhodCore.h"
+#include <cstdio>
+#include <filesystem>
+#include <thread>
+
+namespace {
+
+int failures = 0;
+
+void check(bool condition, const char* what, int line) {
+    if (!condition) {
+        std::printf("  FAILED line %d: %s\n", line, what);
+        ++failures;
+    }
+}
+
+#define CHECK(condition) check((condition), #condition, __LINE__)
+
+sf::Event mouseButton(sf::Event::EventType type, int x, int y) {
+    sf::Event event;
+    event.type = type;
+    event.mouseButton.button = sf::Mouse::Left;
+    event.mouseButton.x = x;
+    event.mouseButton.y = y;
+    return event;
+}
+
+void sweepBoxTests() {
+    sf::FloatRect target(100.f, 0.f, 10.f, 10.f);
+    sf::Vector2f half(1.f, 1.f);
+    // A mover that crosses the whole target in one step still hits it, on the way in
+    float hit = sweepBox(sf::Vector2f(0.f, 5.f), sf::Vector2f(300.f, 5.f), half, target);
+    CHECK(hit > 0.3f && hit < 0.34f);
+    CHECK(sweepBox(sf::Vector2f(0.f, 50.f), sf::Vector2f(300.f, 50.f), half, target) < 0.f);
+    CHECK(sweepBox(sf::Vector2f(105.f, 5.f), sf::Vector2f(105.f, 5.f), half, target) == 0.f);
+    // Stopping short is a miss
+    CHECK(sweepBox(sf::Vector2f(0.f, 5.f), sf::Vector2f(90.f, 5.f), half, target) < 0.f);
+}
+
+void tripleBufferTests() {
+    TripleBuffer<int> buffer;
+    CHECK(!buffer.consume());
+    for (int value = 1; value <= 3; ++value) {
+        buffer.writeBuffer() = value;
+        buffer.publish();
+    }
+    CHECK(buffer.consume());
+    CHECK(buffer.readBuffer() == 3);
+    CHECK(!buffer.consume());
+
+    // The reader only ever sees newer values, and ends on the last one
+    TripleBuffer<int> shared;
+    const int last = 200000;
+    std::thread writer([&] {
+        for (int value = 1; value <= last; ++value) {
+            shared.writeBuffer() = value;
+            shared.publish();
+        }
+    });
+    int seen = 0;
+    bool ordered = true;
+    while (seen < last) {
+        if (shared.consume()) {
+            ordered = ordered && shared.readBuffer() > seen;
+            seen = shared.readBuffer();
+        }
+        else {
+            std::this_thread::yield();
+        }
+    }
+    writer.join();
+    CHECK(ordered);
+}
+
+void spscQueueTests() {
+    SpscQueue<int, 4> small;
+    CHECK(small.push(1) && small.push(2) && small.push(3));
+    CHECK(!small.push(4)); // One slot stays free to tell full from empty
+    int value = 0;
+    CHECK(small.pop(value) && value == 1);
+    CHECK(small.push(4));
+    CHECK(small.pop(value) && value == 2);
+    CHECK(small.pop(value) && value == 3);
+    CHECK(small.pop(value) && value == 4);
+    CHECK(!small.pop(value));
+
+    SpscQueue<int, 64> shared;
+    const int count = 200000;
+    std::thread producer([&] {
+        for (int i = 0; i < count;) {
+            if (shared.push(i)) {
+                ++i;
+            }
+            else {
+                std::this_thread::yield();
+            }
+        }
+    });
+    bool inOrder = true;
+    for (int expected = 0; expected < count;) {
+        if (shared.pop(value)) {
+            inOrder = inOrder && value == expected;
+            ++expected;
+        }
+        else {
+            std::this_thread::yield();
+        }
+    }
+    producer.join();
+    CHECK(inOrder);
+}
+
+void inputLayerTests() {
+    InputLayer input;
+    input.reset(sf::Vector2i(0, 0));
+
+    // A click shorter than a tick still fires
+    input.push(mouseButton(sf::Event::MouseButtonPressed, 10, 20), 100);
+    input.push(mouseButton(sf::Event::MouseButtonReleased, 10, 20), 200);
+    InputLayer::Tick tick = input.nextTick();
+    CHECK(tick.fire);
+    CHECK(tick.stamp == 100);
+    CHECK(tick.mouse == sf::Vector2i(10, 20));
+    CHECK(!input.nextTick().fire);
+
+    // Two clicks in one tick: the second waits for a released tick, so the world sees two presses
+    input.push(mouseButton(sf::Event::MouseButtonPressed, 0, 0), 300);
+    input.push(mouseButton(sf::Event::MouseButtonReleased, 0, 0), 310);
+    input.push(mouseButton(sf::Event::MouseButtonPressed, 0, 0), 320);
+    input.push(mouseButton(sf::Event::MouseButtonReleased, 0, 0), 330);
+    CHECK(input.nextTick().fire);
+    CHECK(!input.nextTick().fire);
+    tick = input.nextTick();
+    CHECK(tick.fire);
+    CHECK(tick.stamp == 320);
+    CHECK(!input.nextTick().fire);
+
+    // A held button keeps firing
+    input.push(mouseButton(sf::Event::MouseButtonPressed, 0, 0), 400);
+    CHECK(input.nextTick().fire);
+    CHECK(input.nextTick().fire);
+    sf::Event lost;
+    lost.type = sf::Event::LostFocus;
+    input.push(lost, 500);
+    CHECK(!input.nextTick().fire);
+}
+
+void qualityGovernorTests() {
+    const float target = 1.f / 60.f;
+    QualityGovernor governor(target);
+    auto frames = [&](int count, float seconds) {
+        int changes = 0;
+        for (int i = 0; i < count; ++i) {
+            changes += governor.addFrame(seconds) ? 1 : 0;
+        }
+        return changes;
+    };
+
+    // Not judged before a full window, then dropped for sustained slow frames
+    CHECK(frames(59, target * 1.5f) == 0);
+    CHECK(frames(1, target * 1.5f) == 1);
+    CHECK(governor.getLevel() == 1);
+
+    // Fast frames climb back only after the climb wait
+    CHECK(frames(239, target * 0.5f) == 0);
+    CHECK(frames(1, target * 0.5f) == 1);
+    CHECK(governor.getLevel() == 0);
+
+    // A climb that drops straight back doubles the wait before the next one
+    CHECK(frames(60, target * 1.5f) == 1);
+    CHECK(governor.getLevel() == 1);
+    CHECK(frames(479, target * 0.5f) == 0);
+    CHECK(frames(1, target * 0.5f) == 1);
+    CHECK(governor.getLevel() == 0);
+
+    // Frames between the two thresholds hold the level
+    QualityGovernor steady(target);
+    for (int i = 0; i < 2000; ++i) {
+        steady.addFrame(target * 1.05f);
+    }
+    CHECK(steady.getLevel() == 0);
+}
+
+void inputLogTests() {
+    CHECK(InputLog::wholeAim(sf::Vector2f(100.6f, -0.6f)) == sf::Vector2f(101.f, -1.f));
+    CHECK(InputLog::wholeAim(sf::Vector2f(40000.f, -40000.f)) == sf::Vector2f(32767.f, -32768.f));
+
+    // Aims mapped through a scaled view and a camera offset are fractional. The
+    // game rounds them once, and a replay has to hand back exactly what it applied.
+    std::filesystem::path directory = std::filesystem::temp_directory_path() / "bhaataphod-tests";
+    std::filesystem::create_directories(directory);
+    std::string path = (directory / "session.bprl").string();
+    const sf::Vector2f mapped[] = { sf::Vector2f(640.4f, 359.5f), sf::Vector2f(1023.75f, 12.25f), sf::Vector2f(5120.5f, 3071.49f) };
+    std::vector<PlayerInput> applied;
+    InputRecorder recorder;
+    CHECK(recorder.begin(path, 42, sf::Vector2u(19200, 10800), sf::Vector2u(1920, 1080)));
+    for (const sf::Vector2f& aim : mapped) {
+        PlayerInput input;
+        input.aim = InputLog::wholeAim(aim);
+        input.fire = applied.size() == 1;
+        recorder.record(1.f / 60.f, input);
+        applied.push_back(input);
+    }
+    recorder.end(0x1234);
+
+    InputReplay replay;
+    CHECK(replay.open(path));
+    CHECK(replay.seed == 42 && replay.viewSize == sf::Vector2u(1920, 1080));
+    float deltaTime = 0.f;
+    PlayerInput input;
+    size_t ticks = 0;
+    bool identical = true;
+    while (replay.next(deltaTime, input)) {
+        identical = identical && ticks < applied.size() && input.aim == applied[ticks].aim && input.fire == applied[ticks].fire && deltaTime == 1.f / 60.f;
+        ++ticks;
+    }
+    CHECK(identical && ticks == applied.size());
+    CHECK(replay.hasChecksum && replay.expectedChecksum == 0x1234);
+    std::filesystem::remove_all(directory);
+}
+
+void spawnConfigTests() {
+    std::filesystem::path directory = std::filesystem::temp_directory_path() / "bhaataphod-tests";
+    std::filesystem::create_directories(directory);
+    auto load = [&](const char* contents, SpawnConfig& config) {
+        std::string path = (directory / "waves.txt").string();
+        std::ofstream(path) << contents;
+        return config.loadFromFile(path);
+    };
+
+    SpawnConfig missing;
+    CHECK(missing.loadFromFile((directory / "no-such-file.txt").string()));
+    CHECK(missing.waves.size() == 1);
+
+    SpawnConfig good;
+    CHECK(load("# comment\ninitial 12\nbudget 300 3 2\nwave 30 0.5 9 5 1 2 60 2 4  # trailing\nwave 0 0.25 1 1 1 3 90 3 6\n", good));
+    CHECK(good.initialAsteroids == 12);
+    CHECK(good.budget.maxEntities == 300 && good.budget.maxDeferred == 2);
+    CHECK(good.waves.size() == 2 && good.waves[1].maxUFOs == 6);
+
+    SpawnConfig bad;
+    CHECK(!load("wave 30 0.5 9 5\n", bad));          // Too few values
+    CHECK(!load("wave 30 0 9 5 1 2 60 2 4\n", bad)); // Zero interval
+    CHECK(!load("wave 30 1 0 0 0 2 60 2 4\n", bad)); // No asteroid type can spawn
+    CHECK(!load("initial many\n", bad));
+    CHECK(!load("speed 3\n", bad));                  // Unknown keyword
+    std::filesystem::remove_all(directory);
+}
+
+void frameArenaTests() {
+    FrameArena arena(256);
+    {
+        std::pmr::vector<int> small(&arena);
+        small.reserve(16);
+        CHECK(arena.heapFallbacks() == 0);
+    }
+    arena.reset();
+
+    // A frame too big for the buffer spills to the heap once, then fits after the reset
+    for (int frame = 0; frame < 3; ++frame) {
+        std::pmr::vector<int> large(&arena);
+        large.reserve(1000);
+        for (int i = 0; i < 1000; ++i) {
+            large.push_back(i);
+        }
+        CHECK(large[999] == 999);
+        arena.reset();
+    }
+    CHECK(arena.heapFallbacks() == 1);
+
+    // Alignment is honoured
+    void* aligned = arena.allocate(8, 64);
+    CHECK(reinterpret_cast<std::uintptr_t>(aligned) % 64 == 0);
+#ifndef NDEBUG
+    // Debug builds poison a reset frame, so stale reads are obvious
+    std::memset(aligned, 0x11, 8);
+    arena.reset();
+    CHECK(static_cast<unsigned char*>(aligned)[0] == 0xDD);
+#endif
+    arena.reset();
+}
+
+void deltaCodecTests() {
+    std::vector<unsigned char> before(4096), after;
+    for (size_t i = 0; i < before.size(); ++i) {
+        before[i] = static_cast<unsigned char>(i * 7);
+    }
+    after = before;
+    after[3] = 1;
+    after[1000] = 2;
+    after[1001] = 3;
+    after.resize(5000, 9); // States grow as entities spawn
+
+    std::vector<unsigned char> delta;
+    DeltaCodec::encodeDelta(before, after, delta);
+    CHECK(delta.size() < after.size() / 4);
+    std::vector<unsigned char> rebuilt = before;
+    CHECK(DeltaCodec::applyDelta(delta.data(), delta.size(), after.size(), rebuilt));
+    CHECK(rebuilt == after);
+
+    // And shrink as they die
+    DeltaCodec::encodeDelta(after, before, delta);
+    CHECK(DeltaCodec::applyDelta(delta.data(), delta.size(), before.size(), rebuilt));
+    CHECK(rebuilt == before);
+
+    // A truncated delta is refused rather than read past its end
+    DeltaCodec::encodeDelta(before, after, delta);
+    rebuilt = before;
+    CHECK(!DeltaCodec::applyDelta(delta.data(), delta.size() / 2, after.size(), rebuilt));
+}
+
+void stateHistoryTests() {
+    auto stateFor = [](int tick) {
+        std::vector<unsigned char> state;
+        StateWriter writer(state);
+        writer.write(tick);
+        writer.write(static_cast<float>(tick) * 0.5f);
+        for (int i = 0; i < 60 + tick % 17; ++i) {
+            writer.write(static_cast<std::uint32_t>(i == tick % 60 ? tick : i));
+        }
+        return state;
+    };
+
+    StateHistory history(100, 10);
+    for (int tick = 0; tick < 250; ++tick) {
+        history.push(stateFor(tick));
+    }
+    CHECK(history.size() == 100);
+
+    std::vector<unsigned char> state;
+    CHECK(history.rewind(0, state) && state == stateFor(249));
+    // Rewinding drops the frames after the one returned
+    CHECK(history.rewind(37, state) && state == stateFor(212));
+    CHECK(history.size() == 63);
+    int tick = 0;
+    StateReader reader(state.data(), state.size());
+    reader.read(tick);
+    CHECK(tick == 212 && reader.isValid());
+
+    // Play continues from there
+    history.push(stateFor(1000));
+    CHECK(history.rewind(1, state) && state == stateFor(212));
+    // Nothing older than the ring holds
+    CHECK(!history.rewind(history.size(), state));
+}
+
+void savedSpriteTests() {
+    // Two processes load the same assets into different Texture objects
+    sf::Texture hostTextures[3], clientTextures[3];
+    TextureTable host, client;
+    for (int i = 0; i < 3; ++i) {
+        host.add(hostTextures[i]);
+        client.add(clientTextures[i]);
+    }
+    CHECK(host.idOf(&hostTextures[2]) == 2);
+    CHECK(host.idOf(&clientTextures[2]) == TextureTable::none);
+    CHECK(host.get(TextureTable::none) == nullptr);
+
+    auto save = [](const TextureTable* textures, const sf::Sprite& sprite) {
+        std::vector<unsigned char> state;
+        StateWriter writer(state, textures);
+        writeSprite(writer, sprite);
+        writer.write(7);
+        return state;
+    };
+    sf::Sprite sprite(hostTextures[1]);
+    sprite.setTextureRect(sf::IntRect(4, 8, 16, 32));
+    sprite.setPosition(sf::Vector2f(100.f, 200.f));
+    sprite.setOrigin(sf::Vector2f(8.f, 16.f));
+    sprite.setScale(sf::Vector2f(0.5f, 2.f));
+    sprite.setRotation(45.f);
+    std::vector<unsigned char> state = save(&host, sprite);
+
+    // The bytes name the texture, not where it lives
+    sf::Sprite same(clientTextures[1]);
+    same.setTextureRect(sprite.getTextureRect());
+    same.setPosition(sprite.getPosition());
+    same.setOrigin(sprite.getOrigin());
+    same.setScale(sprite.getScale());
+    same.setRotation(sprite.getRotation());
+    CHECK(save(&client, same) == state);
+
+    sf::Sprite loaded(clientTextures[0]);
+    StateReader reader(state.data(), state.size(), &client);
+    readSprite(reader, loaded);
+    int after = 0;
+    reader.read(after);
+    CHECK(reader.isValid() && after == 7);
+    CHECK(loaded.getTexture() == &clientTextures[1]);
+    CHECK(loaded.getTextureRect() == sf::IntRect(4, 8, 16, 32));
+    CHECK(loaded.getPosition() == sf::Vector2f(100.f, 200.f));
+    CHECK(loaded.getOrigin() == sf::Vector2f(8.f, 16.f));
+    CHECK(loaded.getScale() == sf::Vector2f(0.5f, 2.f));
+    CHECK(loaded.getRotation() == 45.f);
+
+    // An id the table lacks, or no table at all, keeps the sprite's own texture
+    sf::Texture other;
+    sf::Sprite unknown(other);
+    std::vector<unsigned char> unnamed = save(&host, unknown);
+    sf::Sprite target(clientTextures[2]);
+    StateReader unnamedReader(unnamed.data(), unnamed.size(), &client);
+    readSprite(unnamedReader, target);
+    CHECK(target.getTexture() == &clientTextures[2]);
+    StateReader tableless(state.data(), state.size());
+    readSprite(tableless, target);
+    CHECK(target.getTexture() == &clientTextures[2]);
+
+    // Through the rewind history and back, still in the other table
+    StateHistory history(8, 4);
+    for (int i = 0; i < 6; ++i) {
+        sprite.setPosition(sf::Vector2f(static_cast<float>(i), 0.f));
+        history.push(save(&host, sprite));
+    }
+    std::vector<unsigned char> rewound;
+    CHECK(history.rewind(2, rewound));
+    StateReader rewoundReader(rewound.data(), rewound.size(), &client);
+    readSprite(rewoundReader, loaded);
+    CHECK(loaded.getPosition() == sf::Vector2f(3.f, 0.f));
+    CHECK(loaded.getTexture() == &clientTextures[1]);
+}
+
+} // namespace
+
+int main() {
+    const std::pair<const char*, void (*)()> suites[] = {
+        { "sweepBox", sweepBoxTests },
+        { "TripleBuffer", tripleBufferTests },
+        { "SpscQueue", spscQueueTests },
+        { "InputLayer", inputLayerTests },
+        { "InputLog", inputLogTests },
+        { "QualityGovernor", qualityGovernorTests },
+        { "SpawnConfig", spawnConfigTests },
+        { "FrameArena", frameArenaTests },
+        { "DeltaCodec", deltaCodecTests },
+        { "StateHistory", stateHistoryTests },
+        { "SavedSprite", savedSpriteTests },
+    };
+    for (const auto& suite : suites) {
+        int before = failures;
+        suite.second();
+        std::printf("%s: %s\n", suite.first, failures == before ? "ok" : "FAILED");
+    }
+    return failures;
+}